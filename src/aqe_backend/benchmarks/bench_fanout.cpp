@@ -0,0 +1,90 @@
+/**
+ * Fanout sweep for CustomBPlusDB.
+ *
+ * Times random inserts, rank lookups and a full column scan on the engine
+ * at the fanout it was compiled with. The fanout is fixed at
+ * build time, so CMake builds one bench_fanout_<F> per entry of
+ * AQE_FANOUT_SWEEP (16 to 1024 by default); run each in turn, pick the
+ * fanout with the best mix for the workload, then build the module with
+ * -DAQE_BPLUS_FANOUT=<F>.
+ *
+ * Usage: bench_fanout_<F> [rows] [lookups]
+ */
+
+#include "custom_bplus_db.hpp"
+#include "leaf_cursor.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t row_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    size_t lookup_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    if (row_count == 0) return 1;
+
+    std::mt19937_64 rng(42);
+    std::vector<int64_t> ids(row_count);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    std::vector<Record> rows;
+    rows.reserve(row_count);
+    for (int64_t id : ids) {
+        rows.emplace_back(id, (id % 10000) / 100.0, static_cast<int32_t>(id % 5),
+                          static_cast<int32_t>(id % 1000), 1700000000 + id);
+    }
+    std::vector<int64_t> probes(lookup_count);
+    std::uniform_int_distribution<int64_t> pick(0, static_cast<int64_t>(row_count) - 1);
+    for (auto& key : probes) key = pick(rng);
+
+    CustomBPlusDB db;
+    if (!db.create_database("")) return 1;
+
+    auto start = Clock::now();
+    for (const Record& r : rows) db.insert_record(r);
+    double insert_s = seconds_since(start);
+
+    size_t found = 0;
+    Record out;
+    start = Clock::now();
+    for (int64_t key : probes) found += db.get_record_at_rank(static_cast<size_t>(key), out);
+    double rank_s = seconds_since(start);
+
+    // Every leaf's amount column, read in place
+    start = Clock::now();
+    double sum = 0.0;
+    const int passes = 5;
+    for (int p = 0; p < passes; p++) {
+        db.scan_leaves([&](const LeafSpan& span) {
+            for (size_t i = 0; i < span.size; i++) sum += span.amounts[i];
+        });
+    }
+    double scan_s = seconds_since(start) / passes;
+
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    printf("rows %zu, lookups %zu, L1d %ld KiB, L2 %ld KiB, page %ld B\n\n",
+           row_count, lookup_count, l1 / 1024, l2 / 1024, sysconf(_SC_PAGESIZE));
+    printf("%6s  %8s  %6s  %9s  %9s  %9s  %8s  %s\n", "fanout", "node(B)", "height",
+           "insert/s", "rank/s", "scan", "mem(MiB)", "(check)");
+    printf("%6s  %8s  %6s  %9s  %9s  %9s\n", "", "", "", "(M)", "(M)", "(Grow/s)");
+    printf("%6d  %8zu  %6zu  %9.1f  %9.1f  %9.2f  %8.1f  (%zu/%.0f)\n",
+           AQE_BPLUS_FANOUT, sizeof(BPlusTreeNode), db.get_tree_height(),
+           rows.size() / insert_s / 1e6, probes.size() / rank_s / 1e6,
+           rows.size() / scan_s / 1e9, db.get_node_count() * sizeof(BPlusTreeNode) / 1048576.0, found, sum);
+    return 0;
+}
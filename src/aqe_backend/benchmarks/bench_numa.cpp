@@ -0,0 +1,133 @@
+/**
+ * Per-socket leaf-scan bandwidth for CustomBPlusDB memory policies.
+ *
+ * Loads the same rows under each memory policy (first touch, huge pages,
+ * huge pages interleaved across NUMA nodes, huge pages partitioned across
+ * them). For every node it pins a thread there and times a scan of all
+ * five columns of the leaves placed on each node, so the local and remote
+ * rows of the table show what a socket reads at from its own memory and
+ * from the other socket's. Leaves on no particular node (first touch,
+ * interleaved) are listed as node "any". The last line per policy times
+ * parallel_block_sample() over the whole table with one worker per CPU.
+ *
+ * Usage: bench_numa [rows] [passes]
+ */
+
+#include "custom_bplus_db.hpp"
+#include "leaf_cursor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// id, amount, region, product_id, timestamp
+constexpr size_t ROW_BYTES = sizeof(int64_t) + sizeof(double) + 2 * sizeof(int32_t) + sizeof(int64_t);
+
+struct ScanResult {
+    size_t rows = 0;
+    double seconds = 1e30;
+    int64_t check = 0;  // Printed, so the compiler must keep the column reads
+};
+
+// Best of `passes` scans of the leaves on `node`, from the calling thread
+ScanResult scan_node(const CustomBPlusDB& db, int node, int passes) {
+    ScanResult result;
+    for (int p = 0; p < passes; p++) {
+        size_t rows = 0;
+        int64_t check = 0;
+        auto start = Clock::now();
+        db.scan_node_leaves(node, [&](const LeafSpan& span) {
+            double amounts = 0.0;
+            for (size_t i = 0; i < span.size; i++) {
+                check += span.ids[i] + span.regions[i] + span.product_ids[i] + span.timestamps[i];
+                amounts += span.amounts[i];
+            }
+            check += static_cast<int64_t>(amounts);
+            rows += span.size;
+        });
+        result.seconds = std::min(result.seconds, seconds_since(start));
+        result.rows = rows;
+        result.check = check;
+    }
+    return result;
+}
+
+std::string node_name(int node) {
+    return node < 0 ? "any" : std::to_string(NumaTopology::system().node_id(static_cast<size_t>(node)));
+}
+
+void run(const char* name, const MemoryPolicy& policy, const std::vector<Record>& rows, int passes) {
+    CustomBPlusDB db;
+    db.set_memory_policy(policy);
+    db.create_database("");
+    db.bulk_load(rows);
+
+    const NumaTopology& topology = NumaTopology::system();
+    for (size_t cpu_node = 0; cpu_node < topology.node_count(); cpu_node++) {
+        // Each measurement runs on a fresh thread pinned to the node
+        std::thread([&] {
+            topology.pin_current_thread(cpu_node);
+            for (int data_node = -1; data_node < static_cast<int>(topology.node_count()); data_node++) {
+                ScanResult scan = scan_node(db, data_node, passes);
+                if (scan.rows == 0) continue;
+                printf("%-12s  %8s  %8s  %12zu  %10.2f  %lld\n", name, node_name(static_cast<int>(cpu_node)).c_str(),
+                       node_name(data_node).c_str(), scan.rows, scan.rows * ROW_BYTES / scan.seconds / 1e9,
+                       static_cast<long long>(scan.check));
+            }
+        }).join();
+    }
+
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    double best = 1e30;
+    size_t sampled = 0;
+    for (int p = 0; p < passes; p++) {
+        auto start = Clock::now();
+        sampled = db.parallel_block_sample(100.0, 1024, threads).size();
+        best = std::min(best, seconds_since(start));
+    }
+    printf("%-12s  %8s  %8s  %12zu  %10.2f  (parallel_block_sample, %d threads)\n", name, "all", "all",
+           sampled, sampled * ROW_BYTES / best / 1e9, threads);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t row_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+    int passes = argc > 2 ? std::atoi(argv[2]) : 3;
+    if (row_count == 0 || passes <= 0) return 1;
+
+    std::vector<Record> rows;
+    rows.reserve(row_count);
+    for (size_t id = 0; id < row_count; id++) {
+        rows.emplace_back(static_cast<int64_t>(id), (id % 10000) / 100.0, static_cast<int32_t>(id % 5),
+                          static_cast<int32_t>(id % 1000), 1700000000 + static_cast<int64_t>(id));
+    }
+
+    const NumaTopology& topology = NumaTopology::system();
+    printf("rows %zu, best of %d, %zu NUMA node(s):", row_count, passes, topology.node_count());
+    for (size_t n = 0; n < topology.node_count(); n++) {
+        printf(" node%d (%zu CPUs)", topology.node_id(n), topology.cpus(n).size());
+    }
+    printf("\n\n%-12s  %8s  %8s  %12s  %10s  %s\n", "policy", "cpu node", "data on", "rows", "GB/s", "(check)");
+
+    MemoryPolicy policy;
+    run("first-touch", policy, rows, passes);
+    policy.huge_pages = true;
+    run("huge", policy, rows, passes);
+    policy.placement = NumaPlacement::Interleave;
+    run("interleave", policy, rows, passes);
+    policy.placement = NumaPlacement::Partition;
+    run("partition", policy, rows, passes);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * Leaf-scan prefetch sweep for CustomBPlusDB.
+ *
+ * Loads the same rows twice: bulk loaded, so consecutive leaves sit next to
+ * each other in the arena, and inserted in random order, so splits scatter
+ * the leaf chain across it. For a range of prefetch distances it times a
+ * full leaf-chain scan (sum_column), a filtered scan (count_where), a block
+ * sampler and a stride sampler. Pick the distance with the best mix, then
+ * set it with CustomBPlusDB::set_prefetch_distance().
+ *
+ * Usage: bench_scan [rows] [passes]
+ */
+
+#include "custom_bplus_db.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Best of `passes` runs, in seconds
+template <typename Run>
+double best_of(int passes, Run&& run) {
+    double best = 1e30;
+    for (int p = 0; p < passes; p++) {
+        auto start = Clock::now();
+        run();
+        best = std::min(best, seconds_since(start));
+    }
+    return best;
+}
+
+void sweep(const char* layout, CustomBPlusDB& db, int passes) {
+    const size_t distances[] = {0, 1, 2, 4, 8, 16, 32};
+    const size_t rows = db.get_total_records();
+    size_t check = 0;
+    for (size_t distance : distances) {
+        db.set_prefetch_distance(distance);
+        double sum = 0.0;
+        double scan_s = best_of(passes, [&] { db.sum_column("amount", sum); });
+        size_t matches = 0;
+        double filter_s = best_of(passes, [&] { db.count_where("region", 1, 2, matches); });
+        double block_s = best_of(passes, [&] { check += db.block_sample(1.0, 64).size(); });
+        double stride_s = best_of(passes, [&] { check += db.memory_stride_sample(1.0, 0).size(); });
+        printf("%-6s  %8zu  %10.1f  %10.1f  %10.2f  %10.2f  (%zu/%.0f)\n", layout, distance,
+               rows / scan_s / 1e6, rows / filter_s / 1e6, block_s * 1e3, stride_s * 1e3, matches, sum);
+    }
+    (void)check;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t row_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    int passes = argc > 2 ? std::atoi(argv[2]) : 3;
+    if (row_count == 0 || passes <= 0) return 1;
+
+    std::mt19937_64 rng(42);
+    std::vector<Record> rows;
+    rows.reserve(row_count);
+    for (size_t id = 0; id < row_count; id++) {
+        rows.emplace_back(static_cast<int64_t>(id), (id % 10000) / 100.0, static_cast<int32_t>(id % 5),
+                          static_cast<int32_t>(id % 1000), 1700000000 + static_cast<int64_t>(id));
+    }
+
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE), l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    printf("rows %zu, best of %d, L2 %ld KiB, L3 %ld KiB, built with AQE_BPLUS_FANOUT=%d\n\n",
+           row_count, passes, l2 / 1024, l3 / 1024, AQE_BPLUS_FANOUT);
+    printf("%-6s  %8s  %10s  %10s  %10s  %10s  %s\n", "layout", "distance", "scan", "filter",
+           "block 1%", "stride 1%", "(check)");
+    printf("%-6s  %8s  %10s  %10s  %10s  %10s\n", "", "(leaves)", "(Mrow/s)", "(Mrow/s)", "(ms)", "(ms)");
+
+    {
+        CustomBPlusDB db;
+        db.create_database("");
+        db.bulk_load(rows);
+        sweep("bulk", db, passes);
+    }
+
+    std::shuffle(rows.begin(), rows.end(), rng);
+    {
+        CustomBPlusDB db;
+        db.create_database("");
+        for (const Record& r : rows) db.insert_record(r);
+        sweep("random", db, passes);
+    }
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/chrono.h>
+#include <pybind11/functional.h>
 #include "../core/custom_scheduler.hpp"
 #include "../core/custom_bplus_db.hpp"
+#include "../core/online_aggregation.hpp"
 #include "../executor.h"
 
 namespace py = pybind11;
@@ -19,6 +21,28 @@ PYBIND11_MODULE(aqe_backend, m) {
         .def_readwrite("product_id", &Record::product_id)
         .def_readwrite("timestamp", &Record::timestamp);
     
+    py::enum_<ColumnType>(m, "ColumnType")
+        .value("INT32", ColumnType::Int32)
+        .value("INT64", ColumnType::Int64)
+        .value("DOUBLE", ColumnType::Double)
+        .value("DICT_STRING", ColumnType::DictString);
+    
+    py::class_<ColumnDef>(m, "ColumnDef")
+        .def(py::init<>())
+        .def(py::init<std::string, ColumnType>(), py::arg("name"), py::arg("type"))
+        .def_readwrite("name", &ColumnDef::name)
+        .def_readwrite("type", &ColumnDef::type);
+    
+    py::enum_<NumaPlacement>(m, "NumaPlacement")
+        .value("NONE", NumaPlacement::None)
+        .value("INTERLEAVE", NumaPlacement::Interleave)
+        .value("PARTITION", NumaPlacement::Partition);
+    
+    py::class_<MemoryPolicy>(m, "MemoryPolicy")
+        .def(py::init<>())
+        .def_readwrite("huge_pages", &MemoryPolicy::huge_pages)
+        .def_readwrite("placement", &MemoryPolicy::placement);
+    
     py::enum_<CustomApproximationStatus>(m, "CustomApproximationStatus")
         .value("STABLE", CustomApproximationStatus::STABLE)
         .value("DRIFTING", CustomApproximationStatus::DRIFTING)
@@ -31,7 +55,8 @@ PYBIND11_MODULE(aqe_backend, m) {
         .def_readonly("confidence_level", &CustomValidationResult::confidence_level)
         .def_readonly("error_margin", &CustomValidationResult::error_margin)
         .def_readonly("samples_used", &CustomValidationResult::samples_used)
-        .def_readonly("computation_time", &CustomValidationResult::computation_time);
+        .def_readonly("computation_time", &CustomValidationResult::computation_time)
+        .def_readonly("snapshot_id", &CustomValidationResult::snapshot_id);
 
     // Expose QueryResult for confidence intervals
     py::class_<QueryResult>(m, "QueryResult")
@@ -39,18 +64,210 @@ PYBIND11_MODULE(aqe_backend, m) {
         .def_readonly("ci_lower", &QueryResult::ci_lower)
         .def_readonly("ci_upper", &QueryResult::ci_upper);
 
+    py::class_<ColumnAggregate>(m, "ColumnAggregate")
+        .def_readonly("count", &ColumnAggregate::count)
+        .def_readonly("sum", &ColumnAggregate::sum)
+        .def_readonly("sum_squares", &ColumnAggregate::sum_squares)
+        .def_readonly("min", &ColumnAggregate::min)
+        .def_readonly("max", &ColumnAggregate::max)
+        .def("mean", &ColumnAggregate::mean)
+        .def("variance", &ColumnAggregate::variance);
+    
+    py::class_<StratumStats>(m, "StratumStats")
+        .def_readonly("value", &StratumStats::value)
+        .def_readonly("aggregate", &StratumStats::aggregate);
+    
+    py::class_<StratifiedEstimate>(m, "StratifiedEstimate")
+        .def_readonly("sum", &StratifiedEstimate::sum)
+        .def_readonly("sum_margin", &StratifiedEstimate::sum_margin)
+        .def_readonly("mean", &StratifiedEstimate::mean)
+        .def_readonly("mean_margin", &StratifiedEstimate::mean_margin)
+        .def_readonly("population", &StratifiedEstimate::population)
+        .def_readonly("sampled", &StratifiedEstimate::sampled)
+        .def_readonly("strata", &StratifiedEstimate::strata);
+
+    py::class_<SynopsisEstimate>(m, "SynopsisEstimate")
+        .def_readonly("sum", &SynopsisEstimate::sum)
+        .def_readonly("sum_margin", &SynopsisEstimate::sum_margin)
+        .def_readonly("count", &SynopsisEstimate::count)
+        .def_readonly("count_margin", &SynopsisEstimate::count_margin)
+        .def_readonly("mean", &SynopsisEstimate::mean)
+        .def_readonly("mean_margin", &SynopsisEstimate::mean_margin)
+        .def_readonly("sample_percent", &SynopsisEstimate::sample_percent)
+        .def_readonly("sampled", &SynopsisEstimate::sampled)
+        .def_readonly("matched", &SynopsisEstimate::matched)
+        .def_readonly("population", &SynopsisEstimate::population)
+        .def_readonly("snapshot_id", &SynopsisEstimate::snapshot_id);
+
+    py::class_<OnlineEstimate>(m, "OnlineEstimate")
+        .def_readonly("sum", &OnlineEstimate::sum)
+        .def_readonly("sum_margin", &OnlineEstimate::sum_margin)
+        .def_readonly("count", &OnlineEstimate::count)
+        .def_readonly("count_margin", &OnlineEstimate::count_margin)
+        .def_readonly("mean", &OnlineEstimate::mean)
+        .def_readonly("mean_margin", &OnlineEstimate::mean_margin)
+        .def_readonly("rows_seen", &OnlineEstimate::rows_seen)
+        .def_readonly("leaves_seen", &OnlineEstimate::leaves_seen)
+        .def_readonly("population", &OnlineEstimate::population)
+        .def_readonly("snapshot_id", &OnlineEstimate::snapshot_id)
+        .def_readonly("complete", &OnlineEstimate::complete)
+        .def_readonly("interrupted", &OnlineEstimate::interrupted);
+
+    // Iterating yields a fresh estimate every 10000 rows until the scan ends
+    py::class_<OnlineAggregation>(m, "OnlineAggregation")
+        .def("advance", &OnlineAggregation::advance, py::arg("rows") = 10000)
+        .def("estimate", &OnlineAggregation::estimate)
+        .def("done", &OnlineAggregation::done)
+        .def("cancel", &OnlineAggregation::cancel)
+        .def("__iter__", [](py::object self) { return self; })
+        .def("__next__", [](OnlineAggregation& scan) {
+            if (scan.done()) throw py::stop_iteration();
+            return scan.advance(10000);
+        });
+
     py::class_<CustomBPlusDB>(m, "CustomBPlusDB")
         .def(py::init<>())
-        .def("create_database", &CustomBPlusDB::create_database)
+        .def("create_database", py::overload_cast<const std::string&>(&CustomBPlusDB::create_database))
+        .def("create_database", py::overload_cast<const std::string&, const std::vector<ColumnDef>&>(
+             &CustomBPlusDB::create_database), py::arg("db_path"), py::arg("schema"))
         .def("open_database", &CustomBPlusDB::open_database)
         .def("close_database", &CustomBPlusDB::close_database)
+        .def("checkpoint", &CustomBPlusDB::checkpoint)
+        .def("set_checkpoint_bytes", &CustomBPlusDB::set_checkpoint_bytes, py::arg("bytes"))
+        .def("wal_bytes", &CustomBPlusDB::wal_bytes)
         .def("insert_record", &CustomBPlusDB::insert_record)
+        .def("insert_batch", &CustomBPlusDB::insert_batch)
+        .def("delete_record", &CustomBPlusDB::delete_record, py::arg("id"))
+        .def("update_amount", &CustomBPlusDB::update_amount, py::arg("id"), py::arg("amount"))
+        .def("delete_batch", &CustomBPlusDB::delete_batch, py::arg("ids"))
+        .def("update_amount_batch", &CustomBPlusDB::update_amount_batch, py::arg("updates"))
+        .def("get_schema", &CustomBPlusDB::get_schema)
+        .def("insert_row", &CustomBPlusDB::insert_row, py::arg("values"))
+        .def("row_values", &CustomBPlusDB::row_values, py::arg("record"))
+        .def("bulk_load", &CustomBPlusDB::bulk_load,
+             py::arg("records"), py::arg("fill_factor") = 1.0, py::arg("num_threads") = 1)
         .def("sum_amount", &CustomBPlusDB::sum_amount)
+        .def("aggregate_amount", &CustomBPlusDB::aggregate_amount)
+        .def("aggregate_amount_by_id", &CustomBPlusDB::aggregate_amount_by_id,
+             py::arg("start_id"), py::arg("end_id"))
+        .def("search_range", &CustomBPlusDB::search_range, py::arg("start_id"), py::arg("end_id"))
+        .def("aggregate_range", [](const CustomBPlusDB& db, const std::string& column, int64_t start_id,
+                                   int64_t end_id, int num_threads) -> py::object {
+            ColumnAggregate result;
+            if (!db.aggregate_range(column, start_id, end_id, num_threads, result)) return py::none();
+            return py::cast(result);
+        }, py::arg("column"), py::arg("start_id"), py::arg("end_id"), py::arg("num_threads") = 1)
         .def("sum_amount_where", &CustomBPlusDB::sum_amount_where)
+        .def("sum_column", [](CustomBPlusDB& db, const std::string& column) -> py::object {
+            double sum;
+            if (!db.sum_column(column, sum)) return py::none();
+            return py::float_(sum);
+        }, py::arg("column"))
+        .def("avg_column", [](CustomBPlusDB& db, const std::string& column) -> py::object {
+            double avg;
+            if (!db.avg_column(column, avg)) return py::none();
+            return py::float_(avg);
+        }, py::arg("column"))
+        .def("parallel_sum_column_sample", [](CustomBPlusDB& db, const std::string& column,
+                                              double sample_percent, int num_threads) -> py::object {
+            double sum;
+            if (!db.parallel_sum_column_sample(column, sample_percent, num_threads, sum)) return py::none();
+            return py::float_(sum);
+        }, py::arg("column"), py::arg("sample_percent"), py::arg("num_threads") = 4)
+        .def("parallel_avg_column_sample", [](CustomBPlusDB& db, const std::string& column,
+                                              double sample_percent, int num_threads) -> py::object {
+            double avg;
+            if (!db.parallel_avg_column_sample(column, sample_percent, num_threads, avg)) return py::none();
+            return py::float_(avg);
+        }, py::arg("column"), py::arg("sample_percent"), py::arg("num_threads") = 4)
         .def("sample_records", &CustomBPlusDB::sample_records)
         .def("optimized_sequential_sample", &CustomBPlusDB::optimized_sequential_sample)
         .def("get_total_records", &CustomBPlusDB::get_total_records)
         .def("get_node_count", &CustomBPlusDB::get_node_count)
+        .def("get_record_at_rank", [](const CustomBPlusDB& db, size_t rank) -> py::object {
+            Record record;
+            if (!db.get_record_at_rank(rank, record)) return py::none();
+            return py::cast(record);
+        }, py::arg("rank"))
+        .def("get_records_at_ranks", &CustomBPlusDB::get_records_at_ranks, py::arg("sorted_ranks"))
+        .def("find_record", [](const CustomBPlusDB& db, int64_t id) -> py::object {
+            Record record;
+            if (!db.find_record(id, record)) return py::none();
+            return py::cast(record);
+        }, py::arg("id"))
+        .def("create_index", &CustomBPlusDB::create_index, py::arg("column"))
+        .def("drop_index", &CustomBPlusDB::drop_index, py::arg("column"))
+        .def("get_indexed_columns", &CustomBPlusDB::get_indexed_columns)
+        .def("dictionary_code", [](const CustomBPlusDB& db, const std::string& column,
+                                   const std::string& value) -> py::object {
+            int32_t code;
+            if (!db.dictionary_code(column, value, code)) return py::none();
+            return py::int_(code);
+        }, py::arg("column"), py::arg("value"))
+        .def("count_where", [](const CustomBPlusDB& db, const std::string& filter_column,
+                               int64_t lo, int64_t hi) -> py::object {
+            size_t count;
+            if (!db.count_where(filter_column, lo, hi, count)) return py::none();
+            return py::int_(count);
+        }, py::arg("filter_column"), py::arg("lo"), py::arg("hi"))
+        .def("records_where", [](const CustomBPlusDB& db, const std::string& filter_column,
+                                 int64_t lo, int64_t hi) -> py::object {
+            std::vector<Record> rows;
+            if (!db.records_where(filter_column, lo, hi, rows)) return py::none();
+            return py::cast(rows);
+        }, py::arg("filter_column"), py::arg("lo"), py::arg("hi"))
+        .def("sum_column_where", [](const CustomBPlusDB& db, const std::string& column,
+                                    const std::string& filter_column, int64_t lo, int64_t hi) -> py::object {
+            double sum;
+            if (!db.sum_column_where(column, filter_column, lo, hi, sum)) return py::none();
+            return py::float_(sum);
+        }, py::arg("column"), py::arg("filter_column"), py::arg("lo"), py::arg("hi"))
+        .def("sample_where", [](const CustomBPlusDB& db, const std::string& filter_column,
+                                int64_t lo, int64_t hi, double sample_percent) -> py::object {
+            std::vector<Record> rows;
+            if (!db.sample_where(filter_column, lo, hi, sample_percent, rows)) return py::none();
+            return py::cast(rows);
+        }, py::arg("filter_column"), py::arg("lo"), py::arg("hi"), py::arg("sample_percent"))
+        .def("sum_column_where_sample", [](const CustomBPlusDB& db, const std::string& column,
+                                           const std::string& filter_column, int64_t lo, int64_t hi,
+                                           double sample_percent) -> py::object {
+            double sum;
+            if (!db.sum_column_where_sample(column, filter_column, lo, hi, sample_percent, sum)) return py::none();
+            return py::float_(sum);
+        }, py::arg("column"), py::arg("filter_column"), py::arg("lo"), py::arg("hi"), py::arg("sample_percent"))
+        .def("analyze_strata", &CustomBPlusDB::analyze_strata, py::arg("strata_column"), py::arg("column"))
+        .def("strata_statistics", &CustomBPlusDB::strata_statistics, py::arg("strata_column"), py::arg("column"))
+        .def("stratified_estimate", [](const CustomBPlusDB& db, const std::string& column,
+                                       const std::string& strata_column, size_t sample_size,
+                                       double confidence_level) -> py::object {
+            StratifiedEstimate estimate;
+            if (!db.stratified_estimate(column, strata_column, sample_size, estimate, confidence_level)) return py::none();
+            return py::cast(estimate);
+        }, py::arg("column"), py::arg("strata_column"), py::arg("sample_size"), py::arg("confidence_level") = 0.95)
+        .def("start_online_aggregation", &CustomBPlusDB::start_online_aggregation, py::keep_alive<0, 1>(),
+             py::arg("column"), py::arg("min_value") = -std::numeric_limits<double>::infinity(),
+             py::arg("max_value") = std::numeric_limits<double>::infinity(),
+             py::arg("confidence_level") = 0.95, py::arg("seed") = 0)
+        .def("build_synopses", &CustomBPlusDB::build_synopses,
+             py::arg("sample_percents") = std::vector<double>{0.01, 0.1, 1.0, 10.0})
+        .def("drop_synopses", &CustomBPlusDB::drop_synopses)
+        .def("synopsis_percents", &CustomBPlusDB::synopsis_percents)
+        .def("synopsis_bytes", &CustomBPlusDB::synopsis_bytes)
+        .def("synopsis_estimate", [](CustomBPlusDB& db, size_t rung, const std::string& column,
+                                     double min_value, double max_value, double confidence_level) -> py::object {
+            SynopsisEstimate estimate;
+            if (!db.synopsis_estimate(rung, column, min_value, max_value, estimate, confidence_level)) return py::none();
+            return py::cast(estimate);
+        }, py::arg("rung"), py::arg("column"), py::arg("min_value") = -std::numeric_limits<double>::infinity(),
+           py::arg("max_value") = std::numeric_limits<double>::infinity(), py::arg("confidence_level") = 0.95)
+        .def("compress_leaves", &CustomBPlusDB::compress_leaves, py::arg("num_threads") = 1)
+        .def("drop_compressed_leaves", &CustomBPlusDB::drop_compressed_leaves)
+        .def("compressed_leaf_bytes", &CustomBPlusDB::compressed_leaf_bytes)
+        .def("raw_leaf_bytes", &CustomBPlusDB::raw_leaf_bytes)
+        .def("set_prefetch_distance", &CustomBPlusDB::set_prefetch_distance, py::arg("distance"))
+        .def("prefetch_distance", &CustomBPlusDB::prefetch_distance)
+        .def("set_memory_policy", &CustomBPlusDB::set_memory_policy, py::arg("policy"))
+        .def("memory_policy", &CustomBPlusDB::memory_policy)
         .def("save_to_file", &CustomBPlusDB::save_to_file)
         .def("load_from_file", &CustomBPlusDB::load_from_file)
         .def("fast_pointer_sample", &CustomBPlusDB::fast_pointer_sample, 
@@ -61,6 +278,17 @@ PYBIND11_MODULE(aqe_backend, m) {
              py::arg("sample_percent"), py::arg("num_threads") = 4)
         .def("random_pointer_sample", &CustomBPlusDB::random_pointer_sample,
              py::arg("sample_percent"), py::arg("seed") = 42)
+        .def("bernoulli_sample", &CustomBPlusDB::bernoulli_sample,
+             py::arg("sample_percent"), py::arg("seed") = 0)
+        .def("reservoir_sample", [](CustomBPlusDB& db, size_t k, int num_threads, unsigned int seed) {
+            return db.reservoir_sample(k, num_threads, seed);
+        }, py::arg("k"), py::arg("num_threads") = 4, py::arg("seed") = 0)
+        .def("reservoir_aggregate", [](CustomBPlusDB& db, const std::string& column, size_t k, int num_threads) -> py::object {
+            ColumnAggregate aggregate;
+            size_t population;
+            if (!db.reservoir_aggregate(column, k, num_threads, aggregate, population)) return py::none();
+            return py::make_tuple(aggregate, population);
+        }, py::arg("column"), py::arg("k"), py::arg("num_threads") = 4)
         .def("clt_validated_dual_pointer_sample", &CustomBPlusDB::clt_validated_dual_pointer_sample,
              py::arg("sample_percent"), py::arg("confidence_level") = 0.95, 
              py::arg("check_interval") = 10, py::arg("num_threads") = 4, 
@@ -79,6 +307,8 @@ PYBIND11_MODULE(aqe_backend, m) {
              py::arg("sample_percent"), py::arg("min_block_size") = 500, py::arg("max_block_size") = 2000)
         .def("stratified_block_sample", &CustomBPlusDB::stratified_block_sample,
              py::arg("sample_percent"), py::arg("block_size") = 1000, py::arg("strata_count") = 4)
+        .def("block_sample_where", &CustomBPlusDB::block_sample_where,
+             py::arg("min_amount"), py::arg("max_amount"), py::arg("sample_percent"))
         .def("index_based_sample", &CustomBPlusDB::index_based_sample)
         .def("node_skip_sample", &CustomBPlusDB::node_skip_sample,
              py::arg("sample_percent"), py::arg("skip_factor") = 2)
@@ -107,12 +337,20 @@ PYBIND11_MODULE(aqe_backend, m) {
         .def("close_database", &CustomApproximateScheduler::close_database)
         .def("insert_record", &CustomApproximateScheduler::insert_record)
         .def("insert_batch", &CustomApproximateScheduler::insert_batch)
+        .def("build_synopses", &CustomApproximateScheduler::build_synopses,
+             py::arg("sample_percents") = std::vector<double>{0.01, 0.1, 1.0, 10.0})
         .def("execute_sum_query", &CustomApproximateScheduler::execute_sum_query,
              py::arg("query"), py::arg("sample_percent") = 10.0, py::arg("num_threads") = 4)
         .def("execute_avg_query", &CustomApproximateScheduler::execute_avg_query,
              py::arg("query"), py::arg("sample_percent") = 10.0, py::arg("num_threads") = 4)
         .def("execute_count_query", &CustomApproximateScheduler::execute_count_query,
              py::arg("query"), py::arg("sample_percent") = 10.0, py::arg("num_threads") = 4)
+        .def("execute_reservoir_query", &CustomApproximateScheduler::execute_reservoir_query,
+             py::arg("query"), py::arg("sample_size") = 10000, py::arg("num_threads") = 4)
+        .def("execute_synopsis_query", &CustomApproximateScheduler::execute_synopsis_query, py::arg("query"))
+        .def("execute_online_query", &CustomApproximateScheduler::execute_online_query,
+             py::arg("query"), py::arg("target_error"), py::arg("report_rows") = 10000,
+             py::arg("progress") = nullptr)
         .def("execute_exact_sum", &CustomApproximateScheduler::execute_exact_sum)
         .def("execute_exact_avg", &CustomApproximateScheduler::execute_exact_avg)
         .def("execute_exact_count", &CustomApproximateScheduler::execute_exact_count)
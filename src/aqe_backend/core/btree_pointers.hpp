@@ -17,15 +17,15 @@ public:
      * Fast pointer method: Skip nodes with configurable step size
      */
     static std::vector<Record> fast_pointer_sample(
-        std::shared_ptr<BPlusTreeNode> root, 
+        const BPlusTreeArena& nodes, NodeId root, 
         double sample_percent,
         int step_size = 2) {
         
         std::vector<Record> samples;
-        if (!root) return samples;
+        if (root == INVALID_NODE) return samples;
         
         // Calculate target sample count
-        auto all_records = collect_leaf_records(root);
+        auto all_records = collect_leaf_records(nodes, root);
         int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
         
         // Fast pointer traversal with step_size
@@ -43,13 +43,13 @@ public:
      * Slow pointer method: Systematic sampling with small steps
      */
     static std::vector<Record> slow_pointer_sample(
-        std::shared_ptr<BPlusTreeNode> root,
+        const BPlusTreeArena& nodes, NodeId root,
         double sample_percent) {
         
         std::vector<Record> samples;
-        if (!root) return samples;
+        if (root == INVALID_NODE) return samples;
         
-        auto all_records = collect_leaf_records(root);
+        auto all_records = collect_leaf_records(nodes, root);
         int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
         
         // Slow pointer: smaller, more systematic steps
@@ -66,13 +66,13 @@ public:
      * Dual pointer method: Fast and slow pointers working together
      */
     static std::vector<Record> dual_pointer_sample(
-        std::shared_ptr<BPlusTreeNode> root,
+        const BPlusTreeArena& nodes, NodeId root,
         double sample_percent) {
         
         std::vector<Record> samples;
-        if (!root) return samples;
+        if (root == INVALID_NODE) return samples;
         
-        auto all_records = collect_leaf_records(root);
+        auto all_records = collect_leaf_records(nodes, root);
         int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
         
         // Split target between fast and slow pointers
@@ -102,14 +102,14 @@ public:
      * Parallel pointer method: Multiple threads with different starting positions
      */
     static std::vector<Record> parallel_pointer_sample(
-        std::shared_ptr<BPlusTreeNode> root,
+        const BPlusTreeArena& nodes, NodeId root,
         double sample_percent,
         int num_threads = 4) {
         
         std::vector<Record> samples;
-        if (!root) return samples;
+        if (root == INVALID_NODE) return samples;
         
-        auto all_records = collect_leaf_records(root);
+        auto all_records = collect_leaf_records(nodes, root);
         int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
         
         // Divide work among threads
@@ -147,14 +147,14 @@ public:
      * Random pointer method: Random positions for unbiased sampling
      */
     static std::vector<Record> random_pointer_sample(
-        std::shared_ptr<BPlusTreeNode> root,
+        const BPlusTreeArena& nodes, NodeId root,
         double sample_percent,
         unsigned int seed = 42) {
         
         std::vector<Record> samples;
-        if (!root) return samples;
+        if (root == INVALID_NODE) return samples;
         
-        auto all_records = collect_leaf_records(root);
+        auto all_records = collect_leaf_records(nodes, root);
         int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
         
         // Generate random positions
@@ -178,23 +178,21 @@ private:
     /**
      * Helper: Collect all records from leaf nodes (left-to-right traversal)
      */
-    static std::vector<Record> collect_leaf_records(std::shared_ptr<BPlusTreeNode> root) {
+    static std::vector<Record> collect_leaf_records(const BPlusTreeArena& nodes, NodeId root) {
         std::vector<Record> records;
         
-        if (!root) return records;
+        if (root == INVALID_NODE) return records;
         
         // Find leftmost leaf
-        auto current = root;
-        while (!current->is_leaf && !current->children.empty()) {
-            current = current->children[0];
+        const BPlusTreeNode* current = &nodes[root];
+        while (!current->is_leaf) {
+            current = &nodes[current->children[0]];
         }
         
-        // Traverse all leaf nodes
+        // Traverse all leaf nodes, rebuilding rows from the columns
         while (current) {
-            for (int i = 0; i < current->key_count; ++i) {
-                records.push_back(current->records[i]);
-            }
-            current = current->next_leaf;
+            current->append_records_to(records);
+            current = current->next_leaf == INVALID_NODE ? nullptr : &nodes[current->next_leaf];
         }
         
         return records;
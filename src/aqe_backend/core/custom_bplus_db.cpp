@@ -1,8 +1,14 @@
 #include "custom_bplus_db.hpp"
+#include "leaf_cursor.hpp"
+#include "leaf_codec.hpp"
+#include "secondary_index.hpp"
+#include "online_aggregation.hpp"
+#include "sample_synopsis.hpp"
 #include <algorithm>
 #include <fstream>
 #include <future>
 #include <random>
+#include <map>
 #include <set>
 #include <thread>
 #include <random>
@@ -12,185 +18,1032 @@
 #include <shared_mutex>
 #include <cmath>
 #include <atomic>
+#include <unordered_set>
+#include <numeric>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// BPlusTreeNode Implementation
+namespace {
 
-BPlusTreeNode::BPlusTreeNode(bool leaf) : is_leaf(leaf), key_count(0), subtree_record_count(0) {
-    keys.reserve(MAX_KEYS);
-    if (is_leaf) {
-        records.reserve(MAX_KEYS);
-    } else {
-        children.reserve(MAX_KEYS + 1);
+// Page file layout: one header page, then the node arena slab by slab. Every
+// slab starts on a page boundary and is padded to whole pages, so the mapped
+// file can be handed to NodeArena::adopt() without copying or fixing up ids.
+// The serialized schema catalog, the secondary index postings and the sample
+// synopses follow the last slab.
+constexpr size_t FILE_PAGE_SIZE = 4096;
+constexpr uint64_t PAGE_FILE_MAGIC = 0x3130545042455141ULL;  // "AQEBPT01"
+constexpr uint32_t PAGE_FILE_VERSION = 4;  // 2: zone maps, 3: subtree aggregates, 4: leaf write epochs
+
+struct PageFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t node_size;    // sizeof(BPlusTreeNode) of the writer
+    uint64_t slab_nodes;
+    uint64_t slab_stride;  // Bytes from one slab to the next
+    uint64_t node_count;
+    uint64_t total_records;
+    uint64_t tree_height;
+    uint32_t root;
+    uint32_t reserved;
+    uint64_t schema_offset;  // Serialized SchemaCatalog after the last slab; 0 for the built-in schema
+    uint64_t schema_bytes;
+    uint64_t index_offset;  // Secondary index postings after the schema; 0 if there are none
+    uint64_t index_bytes;
+    uint64_t checkpoint_id;  // Checkpoint the write-ahead log continues; 0 for plain saves
+    uint64_t write_epoch;    // LeafVersionStore epoch; no leaf is stamped later
+    uint64_t synopsis_offset;  // SynopsisLadder image after the indexes; 0 without a ladder
+    uint64_t synopsis_bytes;   // (zero in files written before ladders, which read as none)
+};
+
+constexpr size_t DEFAULT_CHECKPOINT_BYTES = size_t(64) << 20;
+constexpr size_t DEFAULT_PREFETCH_DISTANCE = 4;  // Leaves, blocks or strides; see bench_scan
+constexpr size_t LOG_FRAME_RECORDS = size_t(1) << 16;  // Records per insert frame of a bulk insert
+
+// insert_row() values for the log: per value its variant index, then the
+// int64 or double, or a u32 length and the string bytes
+std::string encode_row(const std::vector<ColumnValue>& values) {
+    std::string image;
+    for (const ColumnValue& value : values) {
+        image.push_back(static_cast<char>(value.index()));
+        if (const int64_t* i = std::get_if<int64_t>(&value)) {
+            image.append(reinterpret_cast<const char*>(i), sizeof(*i));
+        } else if (const double* d = std::get_if<double>(&value)) {
+            image.append(reinterpret_cast<const char*>(d), sizeof(*d));
+        } else {
+            const std::string& text = std::get<std::string>(value);
+            uint32_t size = static_cast<uint32_t>(text.size());
+            image.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            image += text;
+        }
+    }
+    return image;
+}
+
+bool decode_row(const std::string& image, std::vector<ColumnValue>& values) {
+    values.clear();
+    size_t pos = 0;
+    auto read = [&](void* dst, size_t bytes) {
+        if (image.size() - pos < bytes) return false;
+        std::memcpy(dst, image.data() + pos, bytes);
+        pos += bytes;
+        return true;
+    };
+    while (pos < image.size()) {
+        uint8_t kind = static_cast<uint8_t>(image[pos++]);
+        if (kind == 0) {
+            int64_t i;
+            if (!read(&i, sizeof(i))) return false;
+            values.emplace_back(i);
+        } else if (kind == 1) {
+            double d;
+            if (!read(&d, sizeof(d))) return false;
+            values.emplace_back(d);
+        } else {
+            uint32_t size;
+            if (kind != 2 || !read(&size, sizeof(size)) || image.size() - pos < size) return false;
+            values.emplace_back(image.substr(pos, size));
+            pos += size;
+        }
+    }
+    return true;
+}
+
+// fsync() a file, or the directory holding it so a rename is durable
+bool sync_path(const std::string& path, bool directory) {
+    std::string target = path;
+    if (directory) {
+        size_t slash = path.find_last_of('/');
+        target = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    }
+    int fd = ::open(target.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+size_t page_file_slab_stride() {
+    size_t bytes = BPlusTreeArena::SLAB_NODES * sizeof(BPlusTreeNode);
+    return (bytes + FILE_PAGE_SIZE - 1) / FILE_PAGE_SIZE * FILE_PAGE_SIZE;
+}
+
+// Widen [lo, hi] to cover v. A NaN amount makes the range NaN for good, so
+// zone tests never skip or take whole a leaf that holds one.
+template <typename T>
+void widen_zone(T& lo, T& hi, T v) {
+    if (v < lo || v != v) lo = v;
+    if (v > hi || v != v) hi = v;
+}
+
+// widen_zone() for a node whose range other writers widen concurrently
+void atomic_widen(double& lo, double& hi, double v) {
+    atomic_update(lo, [v](double current) { return v < current || v != v ? v : current; });
+    atomic_update(hi, [v](double current) { return v > current || v != v ? v : current; });
+}
+
+// A node's subtree aggregates. Sums are read first: inserts widen the range
+// before growing the sums (see insert_optimistic()), so a sum that already
+// includes a row comes with a range that covers it.
+ColumnAggregate subtree_aggregate(const BPlusTreeNode& node) {
+    auto read = [&node] {
+        ColumnAggregate part;
+        part.sum = load_acquire(node.subtree_sum);
+        part.sum_squares = load_acquire(node.subtree_sum_squares);
+        part.min = load_acquire(node.subtree_min);
+        part.max = load_acquire(node.subtree_max);
+        part.count = __atomic_load_n(&node.subtree_record_count, __ATOMIC_RELAXED);
+        return part;
+    };
+    // A leaf's aggregates change under its latch together with its rows
+    return node.is_leaf ? NodeLatch::optimistic_read(node.version, read) : read();
+}
+
+// Uniform sample of sample_size distinct ranks below total (Floyd's
+// algorithm), ascending
+std::vector<size_t> sample_ranks(size_t total, size_t sample_size, std::mt19937& gen) {
+    if (sample_size >= total) {
+        std::vector<size_t> all(total);
+        std::iota(all.begin(), all.end(), size_t(0));
+        return all;
     }
+    std::unordered_set<size_t> chosen;
+    chosen.reserve(sample_size * 2);
+    for (size_t j = total - sample_size; j < total; ++j) {
+        size_t candidate = std::uniform_int_distribution<size_t>(0, j)(gen);
+        if (!chosen.insert(candidate).second) {
+            chosen.insert(j);
+        }
+    }
+    std::vector<size_t> ranks(chosen.begin(), chosen.end());
+    std::sort(ranks.begin(), ranks.end());
+    return ranks;
+}
+
+// One worker's share of a parallel scan: items to visit, in order, and the
+// NUMA node (topology index) to run on, or -1 for any CPU
+struct NodeShare {
+    int node;
+    std::vector<size_t> items;
+};
+
+// Split `items` into about `workers` contiguous shares. Items whose
+// node_of() is a NUMA node go to workers on that node, each node getting
+// workers in proportion to its items; the rest go to unpinned workers.
+// When nothing is placed on a node this is a plain even split.
+template <typename NodeOf>
+std::vector<NodeShare> split_by_node(const std::vector<size_t>& items, int workers, NodeOf&& node_of) {
+    std::map<int, std::vector<size_t>> groups;
+    for (size_t item : items) groups[std::max(-1, node_of(item))].push_back(item);
+    
+    std::vector<NodeShare> shares;
+    for (auto& group : groups) {
+        size_t group_workers = std::max<size_t>(1, (workers * group.second.size() + items.size() / 2) / items.size());
+        size_t per_worker = (group.second.size() + group_workers - 1) / group_workers;
+        for (size_t first = 0; first < group.second.size(); first += per_worker) {
+            size_t last = std::min(first + per_worker, group.second.size());
+            shares.push_back(NodeShare{group.first, std::vector<size_t>(group.second.begin() + first,
+                                                                        group.second.begin() + last)});
+        }
+    }
+    return shares;
+}
+
+// Merge two uniform reservoirs of `a_rows` and `b_rows` rows into one of
+// min(k, a_rows + b_rows): each draw comes from a side with probability
+// proportional to the rows it still stands for, which makes the count from
+// each side hypergeometric, as for a reservoir over both. Each reservoir
+// must hold min(k, its rows).
+std::vector<Record> merge_reservoirs(std::vector<Record> a, size_t a_rows, std::vector<Record> b, size_t b_rows,
+                                     size_t k, std::mt19937& gen) {
+    std::shuffle(a.begin(), a.end(), gen);
+    std::shuffle(b.begin(), b.end(), gen);
+    std::vector<Record> merged;
+    merged.reserve(std::min(k, a_rows + b_rows));
+    while (merged.size() < k && a_rows + b_rows > 0) {
+        if (std::uniform_int_distribution<size_t>(0, a_rows + b_rows - 1)(gen) < a_rows) {
+            merged.push_back(a.back());
+            a.pop_back();
+            a_rows--;
+        } else {
+            merged.push_back(b.back());
+            b.pop_back();
+            b_rows--;
+        }
+    }
+    return merged;
+}
+
+// Run a worker on its share's node, if it has one
+void pin_to_share_node(const NodeShare& share) {
+    if (share.node >= 0) NumaTopology::system().pin_current_thread(static_cast<size_t>(share.node));
+}
+
+}  // namespace
+
+// BPlusTreeNode Implementation
+
+BPlusTreeNode::BPlusTreeNode(bool leaf)
+    : is_leaf(leaf), key_count(0), subtree_record_count(0),
+      subtree_sum(0.0), subtree_sum_squares(0.0),
+      subtree_min(std::numeric_limits<double>::infinity()), subtree_max(-std::numeric_limits<double>::infinity()),
+      next_leaf(INVALID_NODE), version(0), write_epoch(0) {
+    // Readers that race a split may follow a child slot before it is written;
+    // node 0 always exists, so even a stale slot is a valid id
+    if (!leaf) children.fill(0);
 }
 
 void BPlusTreeNode::insert_record(const Record& record) {
-    std::lock_guard<std::mutex> lock(node_mutex);
-    
     if (is_leaf) {
         // Find insertion position
-        auto pos = std::lower_bound(keys.begin(), keys.begin() + key_count, record.id);
+        auto pos = std::upper_bound(keys.begin(), keys.begin() + key_count, record.id);
         int index = pos - keys.begin();
         
-        // Insert key and record
-        keys.insert(keys.begin() + index, record.id);
-        records.insert(records.begin() + index, record);
+        // Shift the tail of every column one slot right, then scatter the row
+        std::copy_backward(keys.begin() + index, keys.begin() + key_count, keys.begin() + key_count + 1);
+        std::copy_backward(amounts.begin() + index, amounts.begin() + key_count, amounts.begin() + key_count + 1);
+        std::copy_backward(regions.begin() + index, regions.begin() + key_count, regions.begin() + key_count + 1);
+        std::copy_backward(product_ids.begin() + index, product_ids.begin() + key_count, product_ids.begin() + key_count + 1);
+        std::copy_backward(timestamps.begin() + index, timestamps.begin() + key_count, timestamps.begin() + key_count + 1);
+        
+        keys[index] = record.id;
+        amounts[index] = record.amount;
+        regions[index] = record.region;
+        product_ids[index] = record.product_id;
+        timestamps[index] = record.timestamp;
+        
+        if (key_count == 0) {
+            zone = Zone{record.amount, record.amount, record.timestamp, record.timestamp,
+                        record.region, record.region, record.product_id, record.product_id};
+        } else {
+            widen_zone(zone.amount_min, zone.amount_max, record.amount);
+            widen_zone(zone.timestamp_min, zone.timestamp_max, record.timestamp);
+            widen_zone(zone.region_min, zone.region_max, record.region);
+            widen_zone(zone.product_id_min, zone.product_id_max, record.product_id);
+        }
         key_count++;
         subtree_record_count++;  // Update count for leaf
+        add_to_aggregates(record.amount);
     }
 }
 
-std::shared_ptr<BPlusTreeNode> BPlusTreeNode::split() {
-    auto new_node = std::make_shared<BPlusTreeNode>(is_leaf);
+int64_t BPlusTreeNode::split_into(BPlusTreeNode& new_node, NodeId new_id) {
     int mid = MAX_KEYS / 2;
     
     if (is_leaf) {
-        // Copy second half to new node
-        new_node->keys.assign(keys.begin() + mid, keys.begin() + key_count);
-        new_node->records.assign(records.begin() + mid, records.begin() + key_count);
-        new_node->key_count = key_count - mid;
+        // Move second half of every column to new node
+        int moved = key_count - mid;
+        std::copy(keys.begin() + mid, keys.begin() + key_count, new_node.keys.begin());
+        std::copy(amounts.begin() + mid, amounts.begin() + key_count, new_node.amounts.begin());
+        std::copy(regions.begin() + mid, regions.begin() + key_count, new_node.regions.begin());
+        std::copy(product_ids.begin() + mid, product_ids.begin() + key_count, new_node.product_ids.begin());
+        std::copy(timestamps.begin() + mid, timestamps.begin() + key_count, new_node.timestamps.begin());
+        new_node.key_count = moved;
+        new_node.subtree_record_count = moved;
         
         // Update current node
-        keys.resize(mid);
-        records.resize(mid);
         key_count = mid;
+        subtree_record_count = mid;
+        recompute_zone();
+        new_node.recompute_zone();
         
         // Link leaf nodes
-        new_node->next_leaf = this->next_leaf;
-        this->next_leaf = new_node;
-    } else {
-        // Split internal node
-        new_node->keys.assign(keys.begin() + mid + 1, keys.begin() + key_count);
-        new_node->children.assign(children.begin() + mid + 1, children.begin() + key_count + 1);
-        new_node->key_count = key_count - mid - 1;
-        
-        // Update current node
-        keys.resize(mid);
-        children.resize(mid + 1);
-        key_count = mid;
+        new_node.next_leaf = next_leaf;
+        next_leaf = new_id;
+        return new_node.keys[0];
     }
     
-    return new_node;
+    // Split internal node: keys[mid] moves up to the parent
+    int64_t separator = keys[mid];
+    std::copy(keys.begin() + mid + 1, keys.begin() + key_count, new_node.keys.begin());
+    std::copy(children.begin() + mid + 1, children.begin() + key_count + 1, new_node.children.begin());
+    new_node.key_count = key_count - mid - 1;
+    
+    // Update current node
+    key_count = mid;
+    return separator;
 }
 
-std::vector<Record> BPlusTreeNode::get_all_records() const {
-    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(node_mutex));
-    
+void BPlusTreeNode::recompute_zone() {
+    if (key_count == 0) return;
+    zone = Zone{amounts[0], amounts[0], timestamps[0], timestamps[0],
+                regions[0], regions[0], product_ids[0], product_ids[0]};
+    for (int i = 1; i < key_count; i++) {
+        widen_zone(zone.amount_min, zone.amount_max, amounts[i]);
+        widen_zone(zone.timestamp_min, zone.timestamp_max, timestamps[i]);
+        widen_zone(zone.region_min, zone.region_max, regions[i]);
+        widen_zone(zone.product_id_min, zone.product_id_max, product_ids[i]);
+    }
+}
+
+void BPlusTreeNode::remove_at(int index) {
+    std::copy(keys.begin() + index + 1, keys.begin() + key_count, keys.begin() + index);
+    std::copy(amounts.begin() + index + 1, amounts.begin() + key_count, amounts.begin() + index);
+    std::copy(regions.begin() + index + 1, regions.begin() + key_count, regions.begin() + index);
+    std::copy(product_ids.begin() + index + 1, product_ids.begin() + key_count, product_ids.begin() + index);
+    std::copy(timestamps.begin() + index + 1, timestamps.begin() + key_count, timestamps.begin() + index);
+    key_count--;
+    subtree_record_count--;
+    recompute_zone();
+}
+
+void BPlusTreeNode::copy_rows(const BPlusTreeNode& from, int first, int count, int at) {
+    std::copy(from.keys.begin() + first, from.keys.begin() + first + count, keys.begin() + at);
+    std::copy(from.amounts.begin() + first, from.amounts.begin() + first + count, amounts.begin() + at);
+    std::copy(from.regions.begin() + first, from.regions.begin() + first + count, regions.begin() + at);
+    std::copy(from.product_ids.begin() + first, from.product_ids.begin() + first + count, product_ids.begin() + at);
+    std::copy(from.timestamps.begin() + first, from.timestamps.begin() + first + count, timestamps.begin() + at);
+}
+
+Record BPlusTreeNode::record_at(int index) const {
+    return NodeLatch::optimistic_read(version, [&] {
+        // A split since the caller read key_count may have moved the slot away
+        int i = key_count > 0 ? std::min(index, key_count - 1) : index;
+        return Record(keys[i], amounts[i], regions[i], product_ids[i], timestamps[i]);
+    });
+}
+
+void BPlusTreeNode::append_records_to(std::vector<Record>& out) const {
+    size_t start = out.size();
+    out.reserve(start + MAX_KEYS);
+    for (;;) {
+        uint64_t seen = NodeLatch::read_begin(version);
+        int count = key_count;
+        for (int i = 0; i < count; i++) {
+            out.emplace_back(keys[i], amounts[i], regions[i], product_ids[i], timestamps[i]);
+        }
+        if (NodeLatch::read_validate(version, seen)) return;
+        out.resize(start);  // A writer got in - copy the leaf again
+    }
+}
+
+std::vector<Record> BPlusTreeNode::search_range(int64_t start_id, int64_t end_id) const {
+    std::vector<Record> rows;
+    if (!is_leaf) return rows;
+    for (;;) {
+        uint64_t seen = NodeLatch::read_begin(version);
+        int count = std::min(key_count, MAX_KEYS);
+        int first = std::lower_bound(keys.begin(), keys.begin() + count, start_id) - keys.begin();
+        int last = std::upper_bound(keys.begin() + first, keys.begin() + count, end_id) - keys.begin();
+        for (int i = first; i < last; i++) {
+            rows.emplace_back(keys[i], amounts[i], regions[i], product_ids[i], timestamps[i]);
+        }
+        if (NodeLatch::read_validate(version, seen)) return rows;
+        rows.clear();
+    }
+}
+
+std::vector<Record> BPlusTreeNode::get_all_records(const BPlusTreeArena& nodes) const {
+    std::vector<Record> all_records;
     if (is_leaf) {
-        return std::vector<Record>(records.begin(), records.begin() + key_count);
+        append_records_to(all_records);
+        return all_records;
     }
     
-    std::vector<Record> all_records;
     for (int i = 0; i <= key_count; i++) {
-        if (children[i]) {
-            auto child_records = children[i]->get_all_records();
-            all_records.insert(all_records.end(), child_records.begin(), child_records.end());
-        }
+        auto child_records = nodes[children[i]].get_all_records(nodes);
+        all_records.insert(all_records.end(), child_records.begin(), child_records.end());
     }
     return all_records;
 }
 
-size_t BPlusTreeNode::get_record_count() const {
+size_t BPlusTreeNode::get_record_count(const BPlusTreeArena& nodes) const {
     if (is_leaf) {
         return key_count;
     }
     
     size_t count = 0;
     for (int i = 0; i <= key_count; i++) {
-        if (children[i]) {
-            count += children[i]->get_record_count();
-        }
+        count += nodes[children[i]].get_record_count(nodes);
     }
     return count;
 }
 
-void BPlusTreeNode::update_subtree_counts() {
+void BPlusTreeNode::update_subtree_counts(BPlusTreeArena& nodes) {
     if (is_leaf) {
         subtree_record_count = key_count;
     } else {
         subtree_record_count = 0;
         for (int i = 0; i <= key_count; i++) {
-            if (children[i]) {
-                children[i]->update_subtree_counts();
-                subtree_record_count += children[i]->subtree_record_count;
-            }
+            BPlusTreeNode& child = nodes[children[i]];
+            child.update_subtree_counts(nodes);
+            subtree_record_count += child.subtree_record_count;
+        }
+    }
+    recompute_aggregates(nodes);
+}
+
+void BPlusTreeNode::add_to_aggregates(double amount) {
+    widen_zone(subtree_min, subtree_max, amount);
+    subtree_sum += amount;
+    subtree_sum_squares += amount * amount;
+}
+
+void BPlusTreeNode::recompute_aggregates(const BPlusTreeArena& nodes) {
+    subtree_sum = 0.0;
+    subtree_sum_squares = 0.0;
+    subtree_min = std::numeric_limits<double>::infinity();
+    subtree_max = -std::numeric_limits<double>::infinity();
+    if (is_leaf) {
+        for (int i = 0; i < key_count; i++) {
+            add_to_aggregates(amounts[i]);
         }
+        return;
+    }
+    for (int i = 0; i <= key_count; i++) {
+        const BPlusTreeNode& child = nodes[children[i]];
+        if (child.subtree_record_count == 0) continue;  // Its +inf/-inf range would widen ours
+        subtree_sum += child.subtree_sum;
+        subtree_sum_squares += child.subtree_sum_squares;
+        widen_zone(subtree_min, subtree_max, child.subtree_min);
+        widen_zone(subtree_min, subtree_max, child.subtree_max);
     }
 }
 
 // CustomBPlusDB Implementation
 
-CustomBPlusDB::CustomBPlusDB() : total_records(0), tree_height(1), 
+CustomBPlusDB::CustomBPlusDB() : root(INVALID_NODE), total_records(0), tree_height(1),
+                                   checkpoint_id_(0), checkpoint_bytes_(DEFAULT_CHECKPOINT_BYTES),
+                                   prefetch_distance_(DEFAULT_PREFETCH_DISTANCE),
+                                   mapped_base_(nullptr), mapped_bytes_(0),
                                    record_size_(sizeof(Record)), tree_start_address_(nullptr),
-                                   memory_mapped_(false) {
-    root = std::make_shared<BPlusTreeNode>(true);  // Start with leaf root
+                                   memory_mapped_(false), writes_started_(0), writes_finished_(0) {
+    reset_tree();  // Start with leaf root
     leaf_addresses_.reserve(1000);  // Reserve space for leaf address cache
-    cached_records_.reserve(10000);  // Pre-allocate cache for optimized access
 }
 
 CustomBPlusDB::~CustomBPlusDB() {
     close_database();
 }
 
+void CustomBPlusDB::reset_tree() {
+    // Dropping the arena frees every node in O(slabs) - no per-node teardown
+    nodes_.clear();
+    tree_generation_++;
+    unmap_page_file();
+    {
+        std::lock_guard<std::mutex> codec_lock(codec_mutex_);
+        compressed_leaves_.reset();  // Ids are about to be reused
+    }
+    {
+        // Index definitions outlive the tree; their postings do not
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        for (auto& index : indexes_) index->assign({});
+    }
+    if (synopses_) synopses_->invalidate();  // Likewise the ladder's rates and its rows
+    retired_nodes_.clear();
+    free_nodes_.clear();
+    root = nodes_.allocate(true);
+    total_records = 0;
+    tree_height = 1;
+    leaf_addresses_.clear();
+    tree_start_address_ = nullptr;
+}
+
 bool CustomBPlusDB::create_database(const std::string& db_path) {
+    return create_database(db_path, SchemaCatalog::default_columns());
+}
+
+bool CustomBPlusDB::create_database(const std::string& db_path, const std::vector<ColumnDef>& schema) {
     std::unique_lock<std::shared_mutex> lock(db_mutex);
-    db_path_ = db_path;
+    if (!schema_.define(schema)) return false;
+    drop_indexes();  // They named columns of the previous schema
+    synopses_.reset();
+    wal_.reset();
+    db_path_.clear();
+    checkpoint_id_ = 0;
     
     // Initialize empty B+ tree
-    root = std::make_shared<BPlusTreeNode>(true);
-    total_records = 0;
-    tree_height = 1;
+    reset_tree();
     
-    // **INITIALIZE MEMORY MAPPING DURING DATABASE CREATION**
-    // This separates mmap initialization cost from sampling performance
-    memory_mapped_ = false;  // Will be set to true after first batch of records
-    cached_records_.clear();
-    cached_records_.reserve(100000);  // Pre-allocate for performance
+    // The row snapshot is built lazily by the first stride sampler that needs it
+    invalidate_snapshot();
     
+    if (db_path.empty()) return true;
+    
+    // The empty table is the first checkpoint; the log continues from it
+    db_path_ = db_path;
+    wal_ = std::make_unique<WriteAheadLog>(db_path + ".wal");
+    if (!checkpoint_unlocked()) {
+        wal_.reset();
+        db_path_.clear();
+        return false;
+    }
     return true;
 }
 
 bool CustomBPlusDB::open_database(const std::string& db_path) {
-    return load_from_file(db_path);
+    close_database();  // Checkpoints a table opened earlier
+    if (db_path.empty() || !load_from_file(db_path)) return false;
+    
+    // Replay runs through the public write paths before the log is attached,
+    // so replayed changes are not logged a second time
+    auto wal = std::make_unique<WriteAheadLog>(db_path + ".wal");
+    std::vector<WriteAheadLog::Frame> frames;
+    if (!wal->open(checkpoint_id_, frames)) return false;
+    replay_log(frames);
+    
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    wal_ = std::move(wal);
+    db_path_ = db_path;
+    return true;
 }
 
 void CustomBPlusDB::close_database() {
     std::unique_lock<std::shared_mutex> lock(db_mutex);
-    if (!db_path_.empty()) {
-        save_to_file(db_path_);
+    if (wal_) {
+        if (wal_->has_frames()) checkpoint_unlocked();
+        wal_.reset();
+        db_path_.clear();  // A second close must not overwrite the file with an empty tree
+    }
+    checkpoint_id_ = 0;
+    
+    schema_.reset();
+    drop_indexes();
+    synopses_.reset();
+    reset_tree();
+    invalidate_snapshot();
+}
+
+std::vector<ColumnDef> CustomBPlusDB::get_schema() const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return schema_.columns();
+}
+
+bool CustomBPlusDB::insert_row(const std::vector<ColumnValue>& values) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    Record record;
+    if (!schema_.make_record(values, record)) return false;
+    if (!wal_) {
+        insert_concurrent(record);
+        return true;
     }
+    // Logged as values: dictionary codes are only stable once checkpointed
+    std::string row = encode_row(values);
+    return commit_log(insert_concurrent(record, &row));
+}
+
+std::vector<ColumnValue> CustomBPlusDB::row_values(const Record& record) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return schema_.row_values(record);
 }
 
 bool CustomBPlusDB::insert_record(const Record& record) {
-    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return commit_log(insert_concurrent(record));
+}
+
+uint64_t CustomBPlusDB::insert_concurrent(const Record& record, const std::string* row) {
+    writes_started_.fetch_add(1);  // Announced before the row can reach a leaf; see record_snapshot()
     
+    auto log = [&] {
+        return row ? log_write(WriteAheadLog::FrameType::Row, row->data(), row->size())
+                   : log_write(WriteAheadLog::FrameType::Insert, &record, sizeof(record));
+    };
+    uint64_t lsn = 0;
+    bool inserted;
+    {
+        // Most inserts fit in their leaf and only latch that leaf
+        std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+        inserted = insert_optimistic(record);
+        if (inserted) {
+            // Inside the section, so a checkpoint saves the ladder with the row
+            if (synopses_) synopses_->add(record);
+            lsn = log();
+        }
+    }
+    if (!inserted) {
+        // The leaf is full: splits run one at a time and latch every node they change
+        std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+        insert_unlocked(record);
+        if (synopses_) synopses_->add(record);
+        lsn = log();
+    }
+    
+    writes_finished_.fetch_add(1);
+    note_insert(record);
+    index_insert(record);
+    return lsn;
+}
+
+bool CustomBPlusDB::insert_optimistic(const Record& record) {
+    // Internal nodes only change during splits, which hold smo_mutex_
+    // exclusively, so the descent itself needs no latches
+    NodeId path[64];  // Far deeper than any tree with fanout >= 2 can grow
+    int depth = 0;
+    NodeId node_id = root;
+    while (!nodes_[node_id].is_leaf) {
+        const BPlusTreeNode& node = nodes_[node_id];
+        path[depth++] = node_id;
+        int i = std::upper_bound(node.keys.begin(), node.keys.begin() + node.key_count, record.id)
+                - node.keys.begin();
+        node_id = node.children[i];
+    }
+    
+    BPlusTreeNode& leaf = nodes_[node_id];
+    {
+        NodeWriteGuard guard(leaf.version);
+        // Even an insert that backs off moves the version a snapshot recorded
+        leaf_versions_.before_write(node_id, leaf);
+        if (leaf.key_count >= BPlusTreeNode::MAX_KEYS - 1) return false;  // Would split
+        leaf.insert_record(record);
+    }
+    
+    // Writers on other leaves update the same ancestors. The amount range is
+    // widened before the sums grow; see subtree_aggregate().
+    double amount = record.amount;
+    for (int d = 0; d < depth; d++) {
+        BPlusTreeNode& node = nodes_[path[d]];
+        atomic_widen(node.subtree_min, node.subtree_max, amount);
+        atomic_add(node.subtree_sum, amount);
+        atomic_add(node.subtree_sum_squares, amount * amount);
+        atomic_add(node.subtree_record_count, 1);
+    }
+    total_records++;
+    return true;
+}
+
+void CustomBPlusDB::insert_unlocked(const Record& record) {
     // Insert into the tree first
     bool need_root_split = insert_into_node(root, record);
     
     // Handle root split if needed
     if (need_root_split) {
-        auto new_root = std::make_shared<BPlusTreeNode>(false);
-        auto new_node = root->split();
+        int64_t separator;
+        NodeId old_root = root;
+        NodeId new_node = split_node(old_root, separator);
+        NodeId new_root = allocate_node(false);
         
-        new_root->keys.push_back(new_node->keys[0]);
-        new_root->children.push_back(root);
-        new_root->children.push_back(new_node);
-        new_root->key_count = 1;
+        BPlusTreeNode& top = nodes_[new_root];
+        top.keys[0] = separator;
+        top.children[0] = old_root;
+        top.children[1] = new_node;
+        top.key_count = 1;
+        top.subtree_record_count = nodes_[old_root].subtree_record_count + nodes_[new_node].subtree_record_count;
+        top.recompute_aggregates(nodes_);
         
-        root = new_root;
+        root = new_root;  // Published only once the new root is complete
         tree_height++;
     }
     
     total_records++;
+}
+
+bool CustomBPlusDB::delete_record(int64_t id) {
+    return delete_batch({id}) == 1;
+}
+
+bool CustomBPlusDB::update_amount(int64_t id, double amount) {
+    return update_amount_batch({{id, amount}}) == 1;
+}
+
+size_t CustomBPlusDB::delete_batch(const std::vector<int64_t>& ids) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::vector<Record> removed;
+    uint64_t lsn = 0;
+    writes_started_.fetch_add(1);  // See record_snapshot()
+    {
+        // Rebalancing rewrites internal nodes, so deletes run one at a time like splits
+        std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+        for (int64_t id : ids) {
+            Record record;
+            if (remove_from_node(root, id, record)) {
+                removed.push_back(record);
+                total_records--;
+                collapse_root();
+            }
+        }
+        if (!removed.empty()) {
+            if (synopses_) synopses_->invalidate();
+            lsn = log_write(WriteAheadLog::FrameType::Delete, ids.data(), ids.size() * sizeof(int64_t));
+        }
+    }
+    writes_finished_.fetch_add(1);
+    
+    if (!removed.empty()) {
+        invalidate_snapshot();
+        index_remove(removed);
+    }
+    commit_log(lsn);
+    lock.unlock();
+    if (!removed.empty()) reclaim_nodes();
+    return removed.size();
+}
+
+size_t CustomBPlusDB::update_amount_batch(const std::vector<std::pair<int64_t, double>>& updates) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::vector<std::pair<Record, Record>> changes;
+    uint64_t lsn = 0;
+    writes_started_.fetch_add(1);
+    {
+        // Ancestors' min/max can shrink, which the lock-free insert path
+        // never expects, so updates exclude inserts like deletes do
+        std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+        for (const auto& update : updates) {
+            Record before;
+            if (update_in_node(root, update.first, update.second, before)) {
+                Record after = before;
+                after.amount = update.second;
+                changes.emplace_back(before, after);
+            }
+        }
+        if (!changes.empty()) {
+            if (synopses_) synopses_->invalidate();
+            lsn = log_write(WriteAheadLog::FrameType::Update, updates.data(),
+                            updates.size() * sizeof(updates[0]));
+        }
+    }
+    writes_finished_.fetch_add(1);
+    
+    if (!changes.empty()) {
+        invalidate_snapshot();
+        index_update(changes);
+    }
+    commit_log(lsn);
+    return changes.size();
+}
+
+bool CustomBPlusDB::remove_from_node(NodeId node_id, int64_t id, Record& removed) {
+    BPlusTreeNode& node = nodes_[node_id];
+    int i = std::lower_bound(node.keys.begin(), node.keys.begin() + node.key_count, id) - node.keys.begin();
+    
+    if (node.is_leaf) {
+        if (i == node.key_count || node.keys[i] != id) return false;
+        NodeWriteGuard guard(node.version);
+        leaf_versions_.before_write(node_id, node);
+        removed = Record(node.keys[i], node.amounts[i], node.regions[i], node.product_ids[i], node.timestamps[i]);
+        node.remove_at(i);
+        node.recompute_aggregates(nodes_);
+        return true;
+    }
     
-    // **UPDATE MEMORY MAPPING AFTER BULK INSERTIONS**
-    // Refresh mmap cache every 1000 records for optimal performance
-    if (total_records % 1000 == 0) {
-        cached_records_ = collect_leaf_records();
-        memory_mapped_ = true;
+    // Rows equal to a separator may sit on either side of it
+    for (;; i++) {
+        if (remove_from_node(node.children[i], id, removed)) {
+            NodeWriteGuard guard(node.version);
+            node.subtree_record_count--;
+            rebalance_child(node, i);
+            node.recompute_aggregates(nodes_);
+            return true;
+        }
+        if (i == node.key_count || node.keys[i] != id) return false;
+    }
+}
+
+bool CustomBPlusDB::update_in_node(NodeId node_id, int64_t id, double amount, Record& before) {
+    BPlusTreeNode& node = nodes_[node_id];
+    int i = std::lower_bound(node.keys.begin(), node.keys.begin() + node.key_count, id) - node.keys.begin();
+    
+    if (node.is_leaf) {
+        if (i == node.key_count || node.keys[i] != id) return false;
+        NodeWriteGuard guard(node.version);
+        leaf_versions_.before_write(node_id, node);
+        before = Record(node.keys[i], node.amounts[i], node.regions[i], node.product_ids[i], node.timestamps[i]);
+        node.amounts[i] = amount;
+        node.recompute_zone();
+        node.recompute_aggregates(nodes_);
+        return true;
     }
     
-    return true;
+    for (;; i++) {
+        if (update_in_node(node.children[i], id, amount, before)) {
+            NodeWriteGuard guard(node.version);
+            node.recompute_aggregates(nodes_);
+            return true;
+        }
+        if (i == node.key_count || node.keys[i] != id) return false;
+    }
+}
+
+void CustomBPlusDB::rebalance_child(BPlusTreeNode& parent, int child_index) {
+    if (nodes_[parent.children[child_index]].key_count >= BPlusTreeNode::MIN_KEYS || parent.key_count == 0) return;
+    
+    // Work on the pair (left, left + 1) that holds the under-full child
+    int left = child_index > 0 ? child_index - 1 : 0;
+    BPlusTreeNode& l = nodes_[parent.children[left]];
+    BPlusTreeNode& r = nodes_[parent.children[left + 1]];
+    const int capacity = BPlusTreeNode::MAX_KEYS - 1;  // Steady-state keys per node; see build_from_sorted()
+    
+    auto drop_right = [&] {
+        std::copy(parent.keys.begin() + left + 1, parent.keys.begin() + parent.key_count, parent.keys.begin() + left);
+        std::copy(parent.children.begin() + left + 2, parent.children.begin() + parent.key_count + 1,
+                  parent.children.begin() + left + 1);
+        parent.key_count--;
+    };
+    
+    if (l.is_leaf) {
+        int total = l.key_count + r.key_count;
+        if (total <= capacity) {
+            // Merge: l takes r's rows and its place in the chain. r itself is
+            // left untouched, so a reader that read l earlier and follows the
+            // old link still sees r's rows once.
+            NodeWriteGuard guard(l.version);
+            leaf_versions_.before_write(parent.children[left], l);
+            l.copy_rows(r, 0, r.key_count, l.key_count);
+            l.key_count = total;
+            l.subtree_record_count = total;
+            l.next_leaf = r.next_leaf;
+            l.recompute_zone();
+            l.recompute_aggregates(nodes_);
+            retire_node(parent.children[left + 1]);
+            drop_right();
+            return;
+        }
+        
+        // Borrow: split the rows evenly between l and a fresh leaf that
+        // replaces r, for the same reason r is not changed in place
+        int keep = total / 2;
+        NodeId fresh_id = allocate_node(true);
+        BPlusTreeNode& fresh = nodes_[fresh_id];
+        if (l.key_count > keep) {
+            int moved = l.key_count - keep;
+            fresh.copy_rows(l, keep, moved, 0);
+            fresh.copy_rows(r, 0, r.key_count, moved);
+        } else {
+            fresh.copy_rows(r, keep - l.key_count, total - keep, 0);
+        }
+        fresh.key_count = total - keep;
+        fresh.subtree_record_count = total - keep;
+        fresh.next_leaf = r.next_leaf;
+        fresh.write_epoch = leaf_versions_.epoch();  // No snapshot has seen it
+        fresh.recompute_zone();
+        fresh.recompute_aggregates(nodes_);
+        {
+            NodeWriteGuard guard(l.version);
+            leaf_versions_.before_write(parent.children[left], l);
+            if (l.key_count < keep) l.copy_rows(r, 0, keep - l.key_count, l.key_count);
+            l.key_count = keep;
+            l.subtree_record_count = keep;
+            l.next_leaf = fresh_id;
+            l.recompute_zone();
+            l.recompute_aggregates(nodes_);
+        }
+        retire_node(parent.children[left + 1]);
+        parent.children[left + 1] = fresh_id;
+        parent.keys[left] = fresh.keys[0];
+        return;
+    }
+    
+    // Internal nodes are only walked from the top, by readers that exclude
+    // structure changes, so both siblings change in place
+    NodeWriteGuard left_guard(l.version);
+    NodeWriteGuard right_guard(r.version);
+    int64_t separator = parent.keys[left];
+    if (l.key_count + 1 + r.key_count <= capacity) {
+        l.keys[l.key_count] = separator;
+        std::copy(r.keys.begin(), r.keys.begin() + r.key_count, l.keys.begin() + l.key_count + 1);
+        std::copy(r.children.begin(), r.children.begin() + r.key_count + 1, l.children.begin() + l.key_count + 1);
+        l.key_count += 1 + r.key_count;
+        l.subtree_record_count += r.subtree_record_count;
+        l.recompute_aggregates(nodes_);
+        retire_node(parent.children[left + 1]);
+        drop_right();
+        return;
+    }
+    
+    // Borrow: pool both key and child lists around the separator and cut
+    // them in half; the key at the cut moves up to the parent
+    std::vector<int64_t> keys(l.keys.begin(), l.keys.begin() + l.key_count);
+    keys.push_back(separator);
+    keys.insert(keys.end(), r.keys.begin(), r.keys.begin() + r.key_count);
+    std::vector<NodeId> children(l.children.begin(), l.children.begin() + l.key_count + 1);
+    children.insert(children.end(), r.children.begin(), r.children.begin() + r.key_count + 1);
+    
+    int left_children = static_cast<int>(children.size()) / 2;
+    int right_keys = static_cast<int>(keys.size()) - left_children;
+    std::copy(keys.begin(), keys.begin() + left_children - 1, l.keys.begin());
+    std::copy(children.begin(), children.begin() + left_children, l.children.begin());
+    l.key_count = left_children - 1;
+    parent.keys[left] = keys[left_children - 1];
+    std::copy(keys.begin() + left_children, keys.end(), r.keys.begin());
+    std::copy(children.begin() + left_children, children.end(), r.children.begin());
+    r.key_count = right_keys;
+    
+    for (BPlusTreeNode* node : {&l, &r}) {
+        node->subtree_record_count = 0;
+        for (int i = 0; i <= node->key_count; i++) {
+            node->subtree_record_count += nodes_[node->children[i]].subtree_record_count;
+        }
+        node->recompute_aggregates(nodes_);
+    }
+}
+
+void CustomBPlusDB::collapse_root() {
+    while (!nodes_[root].is_leaf && nodes_[root].key_count == 0) {
+        NodeId old_root = root;
+        root = nodes_[root].children[0];
+        tree_height--;
+        retire_node(old_root);
+    }
+}
+
+NodeId CustomBPlusDB::allocate_node(bool is_leaf) {
+    if (free_nodes_.empty()) return nodes_.allocate(is_leaf);
+    NodeId id = free_nodes_.back();
+    free_nodes_.pop_back();
+    // The version keeps rising, so leaf copies and encodings taken of the
+    // node's previous contents never match the new ones
+    BPlusTreeNode& node = nodes_[id];
+    uint64_t version = node.version + 2;
+    new (&node) BPlusTreeNode(is_leaf);
+    node.version = version;
+    return id;
+}
+
+void CustomBPlusDB::retire_node(NodeId id) {
+    retired_nodes_.push_back({id, leaf_versions_.epoch()});
+}
+
+void CustomBPlusDB::reclaim_nodes() {
+    // Leaf-chain readers hold db_mutex shared for as long as they may stand
+    // on an unlinked leaf, so none are left once it can be taken exclusively.
+    // Online scans hold only a snapshot; one opened before a node was
+    // unlinked may still read it.
+    std::unique_lock<std::shared_mutex> lock(db_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+    uint64_t oldest = leaf_versions_.oldest_snapshot();
+    size_t kept = 0;
+    for (const RetiredNode& node : retired_nodes_) {
+        if (oldest == 0 || oldest >= node.epoch) {
+            free_nodes_.push_back(node.id);
+        } else {
+            retired_nodes_[kept++] = node;
+        }
+    }
+    retired_nodes_.resize(kept);
+}
+
+void CustomBPlusDB::collect_free_nodes() {
+    std::vector<bool> reached(nodes_.size(), false);
+    std::vector<NodeId> pending{root};
+    while (!pending.empty()) {
+        NodeId id = pending.back();
+        pending.pop_back();
+        if (id >= reached.size() || reached[id]) continue;
+        reached[id] = true;
+        const BPlusTreeNode& node = nodes_[id];
+        if (node.is_leaf) continue;
+        for (int i = 0; i <= node.key_count; i++) pending.push_back(node.children[i]);
+    }
+    for (NodeId id = 0; id < reached.size(); id++) {
+        if (!reached[id]) free_nodes_.push_back(id);
+    }
+}
+
+void CustomBPlusDB::note_insert(const Record& record) {
+    if (!memory_mapped_.load()) return;
+    
+    // Keep the row snapshot current in O(1) for in-order ingestion (equal ids
+    // land after existing ones, matching upper_bound placement in the leaf).
+    // The vector is only extended while no reader holds it; otherwise, or for
+    // an out-of-order row, it is dropped instead of rebuilt.
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    if (!cached_records_) return;
+    if (cached_records_.use_count() == 1 &&
+        (cached_records_->empty() || record.id >= cached_records_->back().id)) {
+        cached_records_->push_back(record);
+    } else {
+        cached_records_.reset();
+        memory_mapped_.store(false);
+    }
+}
+
+std::shared_ptr<const std::vector<Record>> CustomBPlusDB::current_snapshot() const {
+    if (!memory_mapped_.load()) return nullptr;
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    return cached_records_;
+}
+
+std::shared_ptr<const std::vector<Record>> CustomBPlusDB::record_snapshot() const {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    if (cached_records_) return cached_records_;
+    
+    // Inserts run alongside this copy. It is cached only if no insert was in
+    // flight when it started and none started before it was published; an
+    // insert that starts later sees the published flag and appends itself.
+    uint64_t finished = writes_finished_.load();
+    uint64_t started = writes_started_.load();
+    auto built = std::make_shared<std::vector<Record>>(collect_leaf_records());
+    if (started != finished) return built;  // Good enough for this call only
+    
+    cached_records_ = built;
+    memory_mapped_.store(true);
+    if (writes_started_.load() != started) {
+        cached_records_.reset();
+        memory_mapped_.store(false);
+    }
+    return built;
+}
+
+void CustomBPlusDB::invalidate_snapshot() {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    cached_records_.reset();
+    memory_mapped_.store(false);
 }
 
 bool CustomBPlusDB::insert_batch(const std::vector<Record>& records) {
@@ -199,61 +1052,319 @@ bool CustomBPlusDB::insert_batch(const std::vector<Record>& records) {
     std::sort(sorted_records.begin(), sorted_records.end(), 
               [](const Record& a, const Record& b) { return a.id < b.id; });
     
+    {
+        // An empty tree is built bottom-up instead of row by row
+        std::unique_lock<std::shared_mutex> lock(db_mutex);
+        if (total_records == 0) {
+            build_from_sorted(sorted_records.data(), sorted_records.size(), 1.0, 1);
+            uint64_t lsn = 0;
+            for (size_t i = 0; i < sorted_records.size(); i += LOG_FRAME_RECORDS) {
+                size_t count = std::min(LOG_FRAME_RECORDS, sorted_records.size() - i);
+                lsn = log_write(WriteAheadLog::FrameType::Insert, &sorted_records[i], count * sizeof(Record));
+            }
+            return commit_log(lsn);
+        }
+    }
+    
+    // One sync covers the whole batch
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    uint64_t lsn = 0;
     for (const auto& record : sorted_records) {
-        if (!insert_record(record)) {
-            return false;
+        lsn = insert_concurrent(record);
+    }
+    return commit_log(lsn);
+}
+
+bool CustomBPlusDB::bulk_load(const std::vector<Record>& records, double fill_factor, int num_threads) {
+    if (fill_factor <= 0.0 || fill_factor > 1.0) return false;
+    
+    auto by_id = [](const Record& a, const Record& b) { return a.id < b.id; };
+    std::vector<Record> sorted_copy;
+    const std::vector<Record>* input = &records;
+    if (!std::is_sorted(records.begin(), records.end(), by_id)) {
+        sorted_copy = records;
+        std::sort(sorted_copy.begin(), sorted_copy.end(), by_id);
+        input = &sorted_copy;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    build_from_sorted(input->data(), input->size(), fill_factor, num_threads);
+    // The whole table changed, which the page file records more compactly than the log
+    return !wal_ || checkpoint_unlocked();
+}
+
+void CustomBPlusDB::build_from_sorted(const Record* records, size_t count, double fill_factor, int num_threads) {
+    reset_tree();
+    invalidate_snapshot();
+    if (count == 0) return;
+    
+    // A node splits when it reaches MAX_KEYS, so MAX_KEYS - 1 keys is "full"
+    const size_t leaf_capacity = BPlusTreeNode::MAX_KEYS - 1;
+    const size_t fanout_capacity = BPlusTreeNode::MAX_KEYS;  // children per internal node
+    size_t leaf_fill = std::max<size_t>(1, static_cast<size_t>(leaf_capacity * fill_factor));
+    size_t fanout_fill = std::max<size_t>(2, static_cast<size_t>(fanout_capacity * fill_factor));
+    
+    // Spread rows evenly so no trailing leaf is left nearly empty
+    size_t leaf_count = (count + leaf_fill - 1) / leaf_fill;
+    size_t base_rows = count / leaf_count;
+    size_t extra_rows = count % leaf_count;
+    
+    // Allocate every leaf up front: ids are consecutive, so the leaf chain is
+    // a sequential sweep through the arena. reset_tree() left an empty root
+    // leaf at id 0, which becomes the first leaf.
+    NodeId first_leaf_id = root;
+    for (size_t i = 1; i < leaf_count; i++) {
+        nodes_.allocate(true);
+    }
+    
+    auto fill_leaves = [&](size_t begin_leaf, size_t end_leaf) {
+        for (size_t l = begin_leaf; l < end_leaf; l++) {
+            size_t start = l * base_rows + std::min(l, extra_rows);
+            size_t rows = base_rows + (l < extra_rows ? 1 : 0);
+            
+            BPlusTreeNode& leaf = nodes_[first_leaf_id + l];
+            for (size_t i = 0; i < rows; i++) {
+                const Record& r = records[start + i];
+                leaf.keys[i] = r.id;
+                leaf.amounts[i] = r.amount;
+                leaf.regions[i] = r.region;
+                leaf.product_ids[i] = r.product_id;
+                leaf.timestamps[i] = r.timestamp;
+            }
+            leaf.key_count = static_cast<int>(rows);
+            leaf.subtree_record_count = rows;
+            leaf.recompute_zone();
+            leaf.recompute_aggregates(nodes_);
+            leaf.next_leaf = (l + 1 < leaf_count) ? static_cast<NodeId>(first_leaf_id + l + 1) : INVALID_NODE;
+        }
+    };
+    
+    // Leaves are independent, so each thread fills its own contiguous run
+    size_t workers = std::max<size_t>(1, std::min<size_t>(num_threads, leaf_count));
+    if (workers == 1) {
+        fill_leaves(0, leaf_count);
+    } else {
+        std::vector<std::future<void>> futures;
+        for (size_t t = 0; t < workers; t++) {
+            size_t begin_leaf = leaf_count * t / workers;
+            size_t end_leaf = leaf_count * (t + 1) / workers;
+            futures.push_back(std::async(std::launch::async, fill_leaves, begin_leaf, end_leaf));
+        }
+        for (auto& future : futures) {
+            future.get();
         }
     }
-    return true;
+    
+    // Build internal levels bottom-up; each entry is (node id, smallest key)
+    std::vector<std::pair<NodeId, int64_t>> level(leaf_count);
+    for (size_t l = 0; l < leaf_count; l++) {
+        level[l] = {static_cast<NodeId>(first_leaf_id + l), nodes_[first_leaf_id + l].keys[0]};
+    }
+    
+    size_t height = 1;
+    while (level.size() > 1) {
+        size_t parent_count = (level.size() + fanout_fill - 1) / fanout_fill;
+        size_t base_children = level.size() / parent_count;
+        size_t extra_children = level.size() % parent_count;
+        
+        std::vector<std::pair<NodeId, int64_t>> parents;
+        parents.reserve(parent_count);
+        size_t next_child = 0;
+        for (size_t p = 0; p < parent_count; p++) {
+            size_t child_count = base_children + (p < extra_children ? 1 : 0);
+            NodeId parent_id = nodes_.allocate(false);
+            BPlusTreeNode& parent = nodes_[parent_id];
+            
+            for (size_t c = 0; c < child_count; c++) {
+                const auto& child = level[next_child + c];
+                parent.children[c] = child.first;
+                if (c > 0) {
+                    parent.keys[c - 1] = child.second;
+                }
+                parent.subtree_record_count += nodes_[child.first].subtree_record_count;
+            }
+            parent.key_count = static_cast<int>(child_count - 1);
+            parent.recompute_aggregates(nodes_);
+            parents.emplace_back(parent_id, level[next_child].second);
+            next_child += child_count;
+        }
+        
+        level.swap(parents);
+        height++;
+    }
+    
+    root = level[0].first;
+    tree_height = height;
+    total_records = count;
+    rebuild_indexes(records, count);
 }
 
-bool CustomBPlusDB::insert_into_node(std::shared_ptr<BPlusTreeNode> node, const Record& record) {
-    if (node->is_leaf) {
-        node->insert_record(record);
+NodeId CustomBPlusDB::split_node(NodeId node_id, int64_t& separator) {
+    NodeId new_id = allocate_node(nodes_[node_id].is_leaf);
+    BPlusTreeNode& left = nodes_[node_id];
+    BPlusTreeNode& right = nodes_[new_id];
+    
+    // The new sibling becomes reachable through left.next_leaf or the parent,
+    // both written under a latch, so only the node being split needs one here
+    NodeWriteGuard guard(left.version);
+    if (left.is_leaf) {
+        leaf_versions_.before_write(node_id, left);
+        right.write_epoch = left.write_epoch;
+    }
+    separator = left.split_into(right, new_id);
+    
+    // Leaves count their own keys; an internal split moves whole subtrees
+    if (!right.is_leaf) {
+        size_t moved = 0;
+        for (int i = 0; i <= right.key_count; i++) {
+            moved += nodes_[right.children[i]].subtree_record_count;
+        }
+        right.subtree_record_count = moved;
+        left.subtree_record_count -= moved;
+    }
+    left.recompute_aggregates(nodes_);
+    right.recompute_aggregates(nodes_);
+    return new_id;
+}
+
+bool CustomBPlusDB::insert_into_node(NodeId node_id, const Record& record) {
+    // Arena nodes never move, so this reference survives allocations below
+    BPlusTreeNode& node = nodes_[node_id];
+    
+    // Latched top-down; optimistic readers of this node retry until the insert
+    // and any child split below it are complete
+    NodeWriteGuard guard(node.version);
+    
+    if (node.is_leaf) {
+        leaf_versions_.before_write(node_id, node);
+        node.insert_record(record);
         
         // Return true if this leaf node is now full and needs to split
-        return node->key_count >= BPlusTreeNode::MAX_KEYS;
+        return node.key_count >= BPlusTreeNode::MAX_KEYS;
     } else {
         // Find child to insert into
-        int i = 0;
-        while (i < node->key_count && record.id >= node->keys[i]) {
-            i++;
-        }
+        int i = std::upper_bound(node.keys.begin(), node.keys.begin() + node.key_count, record.id)
+                - node.keys.begin();
+        node.subtree_record_count++;  // Inserts always succeed, so count on the way down
+        node.add_to_aggregates(record.amount);
         
-        bool child_split = insert_into_node(node->children[i], record);
+        bool child_split = insert_into_node(node.children[i], record);
         
         // Handle child split
         if (child_split) {
-            auto new_child = node->children[i]->split();
+            int64_t separator;
+            NodeId new_child = split_node(node.children[i], separator);
             
-            // Insert new key and child pointer
-            node->keys.insert(node->keys.begin() + i, new_child->keys[0]);
-            node->children.insert(node->children.begin() + i + 1, new_child);
-            node->key_count++;
+            // Insert new key and child id
+            std::copy_backward(node.keys.begin() + i, node.keys.begin() + node.key_count,
+                               node.keys.begin() + node.key_count + 1);
+            std::copy_backward(node.children.begin() + i + 1, node.children.begin() + node.key_count + 1,
+                               node.children.begin() + node.key_count + 2);
+            node.keys[i] = separator;
+            node.children[i + 1] = new_child;
+            node.key_count++;
             
             // Return true if this internal node now needs to split
-            return node->key_count >= BPlusTreeNode::MAX_KEYS;
+            return node.key_count >= BPlusTreeNode::MAX_KEYS;
         }
         
         return false;
     }
 }
 
+ColumnAggregate CustomBPlusDB::aggregate_amount() const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return subtree_aggregate(nodes_[root]);
+}
+
+ColumnAggregate CustomBPlusDB::aggregate_amount_by_id(int64_t start_id, int64_t end_id) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    ColumnAggregate result;
+    if (start_id <= end_id) {
+        aggregate_id_range(root, start_id, end_id, std::numeric_limits<int64_t>::min(),
+                           std::numeric_limits<int64_t>::max(), result);
+    }
+    return result;
+}
+
+void CustomBPlusDB::aggregate_id_range(NodeId node_id, int64_t start_id, int64_t end_id,
+                                       int64_t low, int64_t high, ColumnAggregate& out) const {
+    const BPlusTreeNode& node = nodes_[node_id];
+    if (node.is_leaf) {
+        out.merge(NodeLatch::optimistic_read(node.version, [&] {
+            ColumnAggregate part;
+            int count = std::min(node.key_count, BPlusTreeNode::MAX_KEYS);
+            const int64_t* keys = node.keys.data();
+            int first = std::lower_bound(keys, keys + count, start_id) - keys;
+            int last = std::upper_bound(keys + first, keys + count, end_id) - keys;
+            for (int i = first; i < last; i++) {
+                part.add(node.amounts[i]);
+            }
+            return part;
+        }));
+        return;
+    }
+    
+    // Same validated copy as collect_ranks(); separators are copied too
+    std::array<NodeId, BPlusTreeNode::MAX_KEYS + 1> children;
+    std::array<int64_t, BPlusTreeNode::MAX_KEYS> separators;
+    int child_count = NodeLatch::optimistic_read(node.version, [&] {
+        int count = std::min(node.key_count, BPlusTreeNode::MAX_KEYS - 1);
+        std::copy(node.keys.begin(), node.keys.begin() + count, separators.begin());
+        std::copy(node.children.begin(), node.children.begin() + count + 1, children.begin());
+        return count + 1;
+    });
+    
+    // Rows equal to a separator may sit on either side of it, so child i
+    // holds ids in [separator i - 1, separator i], both ends inclusive
+    for (int i = 0; i < child_count; i++) {
+        int64_t child_low = i == 0 ? low : separators[i - 1];
+        int64_t child_high = i == child_count - 1 ? high : separators[i];
+        if (child_high < start_id || child_low > end_id) continue;
+        if (child_low >= start_id && child_high <= end_id) {
+            out.merge(subtree_aggregate(nodes_[children[i]]));
+        } else {
+            aggregate_id_range(children[i], start_id, end_id, child_low, child_high, out);
+        }
+    }
+}
+
 double CustomBPlusDB::sum_amount() {
+    return aggregate_amount().sum;
+}
+
+bool CustomBPlusDB::sum_column(const std::string& column, double& out) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
-    auto records = collect_all_records();
+    ColumnKernel kernel;
+    if (!schema_.resolve(column, kernel)) return false;
     
+    // Same leaf walk as sum_amount(), with the column's kernel summing each leaf
     double sum = 0.0;
-    for (const auto& record : records) {
-        sum += record.amount;
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (const BPlusTreeNode* leaf = first_leaf(); leaf;) {
+        NodeId next = INVALID_NODE;
+        sum += NodeLatch::optimistic_read(leaf->version, [&] {
+            next = leaf->next_leaf;
+            return kernel.leaf_sum(*leaf, leaf->key_count);
+        });
+        leaf = node_ptr(next);
+        prefetcher.advance();
     }
-    return sum;
+    out = sum;
+    return true;
+}
+
+bool CustomBPlusDB::avg_column(const std::string& column, double& out) {
+    double sum;
+    if (!sum_column(column, sum)) return false;
+    size_t count = get_total_records();
+    out = count > 0 ? sum / count : 0.0;
+    return true;
 }
 
 double CustomBPlusDB::avg_amount() {
-    auto sum = sum_amount();
-    auto count = get_total_records();
-    return count > 0 ? sum / count : 0.0;
+    return aggregate_amount().mean();
 }
 
 size_t CustomBPlusDB::count_records() {
@@ -262,20 +1373,83 @@ size_t CustomBPlusDB::count_records() {
 
 double CustomBPlusDB::sum_amount_where(double min_amount, double max_amount) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
-    auto records = collect_all_records();
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    return sum_where_subtree(root, min_amount, max_amount, compressed_leaf_set());
+}
+
+double CustomBPlusDB::sum_where_subtree(NodeId node_id, double min_amount, double max_amount,
+                                        const std::shared_ptr<const CompressedLeafSet>& compressed) const {
+    // Subtree aggregates prune and take whole subtrees the way zone maps do
+    // for leaves, so only the leaves straddling a bound test their rows
+    const BPlusTreeNode& node = nodes_[node_id];
+    if (node.is_leaf) return leaf_sum_where(node_id, min_amount, max_amount, compressed);
+    
+    std::array<NodeId, BPlusTreeNode::MAX_KEYS + 1> children;
+    int child_count = NodeLatch::optimistic_read(node.version, [&] {
+        int count = std::min(node.key_count, BPlusTreeNode::MAX_KEYS - 1) + 1;
+        std::copy(node.children.begin(), node.children.begin() + count, children.begin());
+        return count;
+    });
     
     double sum = 0.0;
-    for (const auto& record : records) {
-        if (record.amount >= min_amount && record.amount <= max_amount) {
-            sum += record.amount;
+    for (int i = 0; i < child_count; i++) {
+        const BPlusTreeNode& child = nodes_[children[i]];
+        if (child.is_leaf) {
+            sum += leaf_sum_where(children[i], min_amount, max_amount, compressed);
+            continue;
+        }
+        ColumnAggregate part = subtree_aggregate(child);
+        if (part.count == 0 || part.max < min_amount || part.min > max_amount) continue;
+        if (part.min >= min_amount && part.max <= max_amount) {
+            sum += part.sum;
+        } else {
+            sum += sum_where_subtree(children[i], min_amount, max_amount, compressed);
         }
     }
     return sum;
 }
 
-double CustomBPlusDB::parallel_sum_sample(double sample_percent, int num_threads) {
+double CustomBPlusDB::leaf_sum_where(NodeId id, double min_amount, double max_amount,
+                                     const std::shared_ptr<const CompressedLeafSet>& compressed) const {
+    // The zone map decides: skip the leaf, sum it whole, or test each row
+    const BPlusTreeNode* leaf = &nodes_[id];
+    return NodeLatch::optimistic_read(leaf->version, [&] {
+        int count = leaf->key_count;
+        if (count == 0 || leaf->zone_excludes(min_amount, max_amount)) return 0.0;
+        bool whole = leaf->zone_covers(min_amount, max_amount);
+        if (const EncodedLeaf* encoded = compressed ? compressed->find(id, *leaf) : nullptr) {
+            return whole ? encoded->sum_amounts() : encoded->sum_amounts_between(min_amount, max_amount);
+        }
+        const double* amounts = leaf->amounts.data();
+        double leaf_sum = 0.0;
+        if (whole) {
+            for (int i = 0; i < count; i++) {
+                leaf_sum += amounts[i];
+            }
+            return leaf_sum;
+        }
+        for (int i = 0; i < count; i++) {
+            // Branch-free predicate keeps the loop vectorizable
+            double amount = amounts[i];
+            leaf_sum += (amount >= min_amount && amount <= max_amount) ? amount : 0.0;
+        }
+        return leaf_sum;
+    });
+}
+
+double CustomBPlusDB::parallel_sum_sample(double sample_percent, int num_threads, uint64_t* snapshot_id) {
+    return parallel_sample_sum(sample_percent, num_threads, [](const Record& record) { return record.amount; },
+                               snapshot_id);
+}
+
+double CustomBPlusDB::parallel_sample_sum(double sample_percent, int num_threads, double (*value)(const Record&),
+                                          uint64_t* snapshot_id, size_t* population) {
     // Get sampled records
-    auto sampled_records = sample_records(sample_percent);
+    uint64_t snapshot = 0;
+    size_t rows = 0;
+    auto sampled_records = snapshot_sample(sample_percent, snapshot, rows);
+    if (snapshot_id) *snapshot_id = snapshot;
+    if (population) *population = rows;
     if (sampled_records.empty()) return 0.0;
     
     // Partition records among threads
@@ -284,10 +1458,10 @@ double CustomBPlusDB::parallel_sum_sample(double sample_percent, int num_threads
     // Launch parallel sum computation
     std::vector<std::future<double>> futures;
     for (const auto& partition : partitions) {
-        futures.push_back(std::async(std::launch::async, [partition]() {
+        futures.push_back(std::async(std::launch::async, [partition, value]() {
             double thread_sum = 0.0;
             for (const auto& record : partition) {
-                thread_sum += record.amount;
+                thread_sum += value(record);
             }
             return thread_sum;
         }));
@@ -299,36 +1473,96 @@ double CustomBPlusDB::parallel_sum_sample(double sample_percent, int num_threads
         total_sum += future.get();
     }
     
-    // Scale up based on sampling percentage
-    return total_sum * (100.0 / sample_percent);
+    // Scale up to the snapshot's row count
+    return total_sum * (static_cast<double>(rows) / sampled_records.size());
+}
+
+bool CustomBPlusDB::parallel_sum_column_sample(const std::string& column, double sample_percent,
+                                               int num_threads, double& out) {
+    ColumnKernel kernel;
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        if (!schema_.resolve(column, kernel)) return false;
+    }
+    out = parallel_sample_sum(sample_percent, num_threads, kernel.value);
+    return true;
 }
 
-double CustomBPlusDB::parallel_avg_sample(double sample_percent, int num_threads) {
-    double sum = parallel_sum_sample(sample_percent, num_threads);
-    size_t total = get_total_records();
+bool CustomBPlusDB::parallel_avg_column_sample(const std::string& column, double sample_percent,
+                                               int num_threads, double& out) {
+    ColumnKernel kernel;
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        if (!schema_.resolve(column, kernel)) return false;
+    }
+    size_t total = 0;
+    double sum = parallel_sample_sum(sample_percent, num_threads, kernel.value, nullptr, &total);
+    out = total > 0 ? sum / total : 0.0;
+    return true;
+}
+
+double CustomBPlusDB::parallel_avg_sample(double sample_percent, int num_threads, uint64_t* snapshot_id) {
+    // Divide by the row count of the snapshot the sum was estimated from
+    size_t total = 0;
+    double sum = parallel_sample_sum(sample_percent, num_threads, [](const Record& record) { return record.amount; },
+                                     snapshot_id, &total);
     return total > 0 ? sum / total : 0.0;
 }
 
-size_t CustomBPlusDB::parallel_count_sample(double sample_percent, int num_threads) {
-    auto sampled_records = sample_records(sample_percent);
-    return static_cast<size_t>(sampled_records.size() * (100.0 / sample_percent));
+size_t CustomBPlusDB::parallel_count_sample(double sample_percent, int num_threads, uint64_t* snapshot_id) {
+    // Every row counts, so the snapshot's row count is exact and nothing needs sampling
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    LeafView snapshot = leaf_view();
+    if (snapshot_id) *snapshot_id = snapshot.snapshot_id();
+    return snapshot.size();
 }
 
-double CustomBPlusDB::parallel_sum_where_sample(double min_amount, double max_amount, 
-                                               double sample_percent, int num_threads) {
-    auto sampled_records = sample_records(sample_percent);
-    if (sampled_records.empty()) return 0.0;
-    
-    auto partitions = partition_records_for_threads(sampled_records, num_threads);
+double CustomBPlusDB::parallel_sum_where_sample(double min_amount, double max_amount, 
+                                               double sample_percent, int num_threads,
+                                               uint64_t* snapshot_id) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    if (snapshot_id) *snapshot_id = 0;
+    if (sample_percent <= 0.0) return 0.0;
+    
+    // Leaves the zone maps exclude contribute nothing, so only the rest are
+    // sampled. Each thread takes every stride-th row of its leaves from a
+    // random offset, which includes each row with probability 1 / stride.
+    LeafView snapshot = leaf_view();
+    if (snapshot_id) *snapshot_id = snapshot.snapshot_id();
+    std::vector<size_t> leaves;
+    for (size_t l = 0; l < snapshot.leaf_count(); l++) {
+        if (snapshot.read_leaf(l, [&](const BPlusTreeNode& leaf) { return !leaf.zone_excludes(min_amount, max_amount); })) {
+            leaves.push_back(l);
+        }
+    }
+    if (leaves.empty()) return 0.0;
+    double stride = 100.0 / std::min(sample_percent, 100.0);
     
+    size_t workers = std::max<size_t>(1, std::min<size_t>(num_threads, leaves.size()));
+    std::random_device rd;
     std::vector<std::future<double>> futures;
-    for (const auto& partition : partitions) {
-        futures.push_back(std::async(std::launch::async, [partition, min_amount, max_amount]() {
+    for (size_t t = 0; t < workers; t++) {
+        size_t begin = leaves.size() * t / workers;
+        size_t end = leaves.size() * (t + 1) / workers;
+        unsigned seed = rd();
+        futures.push_back(std::async(std::launch::async, [&, begin, end, seed]() {
+            std::mt19937 gen(seed);
+            double offset = std::uniform_real_distribution<double>(0.0, stride)(gen);  // Into the current leaf
             double thread_sum = 0.0;
-            for (const auto& record : partition) {
-                if (record.amount >= min_amount && record.amount <= max_amount) {
-                    thread_sum += record.amount;
-                }
+            for (size_t l = begin; l < end; l++) {
+                auto taken = snapshot.read_leaf(leaves[l], [&](const BPlusTreeNode& leaf) {
+                    int count = leaf.key_count;
+                    bool whole = leaf.zone_covers(min_amount, max_amount);
+                    double leaf_sum = 0.0;
+                    double position = offset;
+                    for (; position < count; position += stride) {
+                        double amount = leaf.amounts[static_cast<int>(position)];
+                        if (whole || (amount >= min_amount && amount <= max_amount)) leaf_sum += amount;
+                    }
+                    return std::make_pair(leaf_sum, position - count);
+                });
+                thread_sum += taken.first;
+                offset = taken.second;
             }
             return thread_sum;
         }));
@@ -339,26 +1573,66 @@ double CustomBPlusDB::parallel_sum_where_sample(double min_amount, double max_am
         total_sum += future.get();
     }
     
-    return total_sum * (100.0 / sample_percent);
+    return total_sum * stride;
+}
+
+std::vector<NodeId> CustomBPlusDB::leaves_overlapping(double min_amount, double max_amount) const {
+    std::vector<NodeId> leaves;
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (NodeId id = first_leaf_id(); id != INVALID_NODE;) {
+        const BPlusTreeNode& leaf = nodes_[id];
+        NodeId next = INVALID_NODE;
+        bool overlaps = NodeLatch::optimistic_read(leaf.version, [&] {
+            next = leaf.next_leaf;
+            return leaf.key_count > 0 && !leaf.zone_excludes(min_amount, max_amount);
+        });
+        if (overlaps) leaves.push_back(id);
+        id = next;
+        prefetcher.advance();
+    }
+    return leaves;
 }
 
 std::vector<Record> CustomBPlusDB::sample_records(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
-    auto all_records = collect_all_records();
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
     
-    if (all_records.empty() || sample_percent >= 100.0) {
-        return all_records;
+    if (sample_percent >= 100.0) {
+        return collect_all_records();
     }
     
-    // Random sampling - NOTE: This reads ALL records first (inefficient for large datasets)
-    size_t sample_size = static_cast<size_t>(all_records.size() * sample_percent / 100.0);
+    size_t total = root == INVALID_NODE ? 0 : nodes_[root].subtree_record_count;
+    if (total == 0 || sample_percent <= 0.0) return {};
+    
+    // Each chosen rank is fetched by an O(log n) descent, so the cost is
+    // O(m log n); sorted, the descents share their upper levels
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::vector<size_t> ranks = sample_ranks(total, static_cast<size_t>(total * sample_percent / 100.0), gen);
+    
     std::vector<Record> sampled;
+    sampled.reserve(ranks.size());
+    collect_ranks(root, 0, ranks.data(), ranks.data() + ranks.size(), sampled);
+    std::shuffle(sampled.begin(), sampled.end(), gen);
+    return sampled;
+}
+
+std::vector<Record> CustomBPlusDB::snapshot_sample(double sample_percent, uint64_t& snapshot_id, size_t& population) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    LeafView snapshot = leaf_view();
+    snapshot_id = snapshot.snapshot_id();
+    population = snapshot.size();
+    if (population == 0 || sample_percent <= 0.0) return {};
     
     std::random_device rd;
     std::mt19937 gen(rd());
-    std::shuffle(all_records.begin(), all_records.end(), gen);
+    size_t sample_size = std::min(population, static_cast<size_t>(population * sample_percent / 100.0));
+    std::vector<size_t> ranks = sample_ranks(population, sample_size, gen);
     
-    sampled.assign(all_records.begin(), all_records.begin() + std::min(sample_size, all_records.size()));
+    std::vector<Record> sampled;
+    sampled.reserve(ranks.size());
+    for (size_t rank : ranks) sampled.push_back(snapshot[rank]);
+    std::shuffle(sampled.begin(), sampled.end(), gen);
     return sampled;
 }
 
@@ -366,7 +1640,7 @@ std::vector<Record> CustomBPlusDB::sample_records(double sample_percent) {
 std::vector<Record> CustomBPlusDB::optimized_sequential_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    if (!root || sample_percent >= 100.0) {
+    if (root == INVALID_NODE || sample_percent >= 100.0) {
         return collect_all_records();
     }
     
@@ -394,17 +1668,17 @@ std::vector<Record> CustomBPlusDB::optimized_sequential_sample(double sample_per
     size_t current_count = 0;
     double next_sample_point = start_offset;
     
-    std::function<void(std::shared_ptr<BPlusTreeNode>)> traverse_and_sample = 
-        [&](std::shared_ptr<BPlusTreeNode> node) {
+    std::function<void(const BPlusTreeNode*)> traverse_and_sample = 
+        [&](const BPlusTreeNode* node) {
         if (!node) return;
         
         if (node->is_leaf) {
             // Process leaf node records
-            for (const auto& record : node->records) {
+            for (int i = 0; i < node->key_count; i++) {
                 current_count++;
                 
                 if (current_count >= next_sample_point && sampled.size() < target_samples) {
-                    sampled.push_back(record);
+                    sampled.push_back(node->record_at(i));
                     next_sample_point += step;
                 }
                 
@@ -414,8 +1688,8 @@ std::vector<Record> CustomBPlusDB::optimized_sequential_sample(double sample_per
             }
         } else {
             // Recursively traverse internal nodes
-            for (auto child : node->children) {
-                traverse_and_sample(child);
+            for (int i = 0; i <= node->key_count; i++) {
+                traverse_and_sample(node_ptr(node->children[i]));
                 if (sampled.size() >= target_samples) {
                     return;
                 }
@@ -423,7 +1697,7 @@ std::vector<Record> CustomBPlusDB::optimized_sequential_sample(double sample_per
         }
     };
     
-    traverse_and_sample(root);
+    traverse_and_sample(node_ptr(root));
     return sampled;
 }
 
@@ -443,14 +1717,12 @@ std::vector<std::vector<Record>> CustomBPlusDB::partition_records_for_threads(
 
 std::vector<Record> CustomBPlusDB::index_based_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
     
-    if (!root || sample_percent <= 0.0) return {};
+    if (root == INVALID_NODE || sample_percent <= 0.0) return {};
     if (sample_percent >= 100.0) return collect_all_records();
     
-    // Update tree counts first
-    root->update_subtree_counts();
-    
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     size_t target_samples = static_cast<size_t>(total_records * sample_percent / 100.0);
     
     if (target_samples == 0) return {};
@@ -458,43 +1730,25 @@ std::vector<Record> CustomBPlusDB::index_based_sample(double sample_percent) {
     std::vector<Record> sampled;
     sampled.reserve(target_samples);
     
-    // Calculate step size based on record positions
+    // Evenly spaced ranks, each fetched by descending the subtree counts
     double step = static_cast<double>(total_records) / target_samples;
+    std::vector<size_t> ranks;
+    ranks.reserve(target_samples);
+    for (size_t i = 0; i < target_samples; i++) {
+        ranks.push_back(std::min(total_records - 1, static_cast<size_t>(std::ceil(i * step))));
+    }
     
-    std::function<void(std::shared_ptr<BPlusTreeNode>, size_t&)> sample_by_index = 
-        [&](std::shared_ptr<BPlusTreeNode> node, size_t& current_index) {
-        if (!node || sampled.size() >= target_samples) return;
-        
-        if (node->is_leaf) {
-            for (int i = 0; i < node->key_count && sampled.size() < target_samples; i++) {
-                if (current_index >= static_cast<size_t>(sampled.size() * step)) {
-                    sampled.push_back(node->records[i]);
-                }
-                current_index++;
-            }
-        } else {
-            for (int i = 0; i <= node->key_count && sampled.size() < target_samples; i++) {
-                if (node->children[i]) {
-                    sample_by_index(node->children[i], current_index);
-                }
-            }
-        }
-    };
-    
-    size_t index = 0;
-    sample_by_index(root, index);
+    collect_ranks(root, 0, ranks.data(), ranks.data() + ranks.size(), sampled);
     return sampled;
 }
 
 std::vector<Record> CustomBPlusDB::node_skip_sample(double sample_percent, int skip_factor) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    if (!root || sample_percent <= 0.0) return {};
+    if (root == INVALID_NODE || sample_percent <= 0.0) return {};
     if (sample_percent >= 100.0) return collect_all_records();
     
-    root->update_subtree_counts();
-    
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     size_t target_samples = static_cast<size_t>(total_records * sample_percent / 100.0);
     
     std::vector<Record> sampled;
@@ -502,8 +1756,8 @@ std::vector<Record> CustomBPlusDB::node_skip_sample(double sample_percent, int s
     
     int node_counter = 0;
     
-    std::function<void(std::shared_ptr<BPlusTreeNode>)> skip_sample = 
-        [&](std::shared_ptr<BPlusTreeNode> node) {
+    std::function<void(const BPlusTreeNode*)> skip_sample = 
+        [&](const BPlusTreeNode* node) {
         if (!node || sampled.size() >= target_samples) return;
         
         if (node->is_leaf) {
@@ -515,39 +1769,35 @@ std::vector<Record> CustomBPlusDB::node_skip_sample(double sample_percent, int s
                     node->key_count
                 );
                 for (int i = 0; i < records_to_take; i++) {
-                    sampled.push_back(node->records[i]);
+                    sampled.push_back(node->record_at(i));
                 }
             }
         } else {
             for (int i = 0; i <= node->key_count; i++) {
-                if (node->children[i]) {
-                    skip_sample(node->children[i]);
-                }
+                skip_sample(node_ptr(node->children[i]));
             }
         }
     };
     
-    skip_sample(root);
+    skip_sample(node_ptr(root));
     return sampled;
 }
 
 std::vector<Record> CustomBPlusDB::balanced_tree_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    if (!root || sample_percent <= 0.0) return {};
+    if (root == INVALID_NODE || sample_percent <= 0.0) return {};
     if (sample_percent >= 100.0) return collect_all_records();
     
-    root->update_subtree_counts();
-    
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     size_t target_samples = static_cast<size_t>(total_records * sample_percent / 100.0);
     
     std::vector<Record> sampled;
     sampled.reserve(target_samples);
     
     // Use tree balance to proportionally sample from each subtree
-    std::function<void(std::shared_ptr<BPlusTreeNode>, size_t)> balanced_sample = 
-        [&](std::shared_ptr<BPlusTreeNode> node, size_t samples_for_subtree) {
+    std::function<void(const BPlusTreeNode*, size_t)> balanced_sample = 
+        [&](const BPlusTreeNode* node, size_t samples_for_subtree) {
         if (!node || sampled.size() >= target_samples || samples_for_subtree == 0) return;
         
         if (node->is_leaf) {
@@ -562,58 +1812,55 @@ std::vector<Record> CustomBPlusDB::balanced_tree_sample(double sample_percent) {
             for (int i = 0; i < records_to_take && sampled.size() < target_samples; i++) {
                 int index = static_cast<int>(i * step);
                 if (index < node->key_count) {
-                    sampled.push_back(node->records[index]);
+                    sampled.push_back(node->record_at(index));
                 }
             }
         } else {
             // Distribute samples among children based on their record counts
             for (int i = 0; i <= node->key_count && sampled.size() < target_samples; i++) {
-                if (node->children[i] && node->children[i]->subtree_record_count > 0) {
-                    size_t child_samples = (samples_for_subtree * node->children[i]->subtree_record_count) 
+                const BPlusTreeNode* child = node_ptr(node->children[i]);
+                if (child->subtree_record_count > 0) {
+                    size_t child_samples = (samples_for_subtree * child->subtree_record_count) 
                                          / node->subtree_record_count;
-                    balanced_sample(node->children[i], child_samples);
+                    balanced_sample(child, child_samples);
                 }
             }
         }
     };
     
-    balanced_sample(root, target_samples);
+    balanced_sample(node_ptr(root), target_samples);
     return sampled;
 }
 
 std::vector<Record> CustomBPlusDB::direct_access_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    if (!root || sample_percent <= 0.0) return {};
+    if (root == INVALID_NODE || sample_percent <= 0.0) return {};
     if (sample_percent >= 100.0) return collect_all_records();
     
-    root->update_subtree_counts();
-    
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     size_t target_samples = static_cast<size_t>(total_records * sample_percent / 100.0);
     
     std::vector<Record> sampled;
     sampled.reserve(target_samples);
     
     // Collect all leaf nodes first for direct access
-    std::vector<std::shared_ptr<BPlusTreeNode>> leaf_nodes;
+    std::vector<const BPlusTreeNode*> leaf_nodes;
     
-    std::function<void(std::shared_ptr<BPlusTreeNode>)> collect_leaves = 
-        [&](std::shared_ptr<BPlusTreeNode> node) {
+    std::function<void(const BPlusTreeNode*)> collect_leaves = 
+        [&](const BPlusTreeNode* node) {
         if (!node) return;
         
         if (node->is_leaf) {
             leaf_nodes.push_back(node);
         } else {
             for (int i = 0; i <= node->key_count; i++) {
-                if (node->children[i]) {
-                    collect_leaves(node->children[i]);
-                }
+                collect_leaves(node_ptr(node->children[i]));
             }
         }
     };
     
-    collect_leaves(root);
+    collect_leaves(node_ptr(root));
     
     if (leaf_nodes.empty()) return {};
     
@@ -634,7 +1881,7 @@ std::vector<Record> CustomBPlusDB::direct_access_sample(double sample_percent) {
             for (int j = 0; j < records_per_node && sampled.size() < target_samples; j++) {
                 int record_index = static_cast<int>(j * record_step);
                 if (record_index < node->key_count) {
-                    sampled.push_back(node->records[record_index]);
+                    sampled.push_back(node->record_at(record_index));
                 }
             }
         }
@@ -658,36 +1905,376 @@ size_t CustomBPlusDB::get_node_count() const {
 }
 
 std::vector<Record> CustomBPlusDB::collect_all_records() const {
-    if (!root) return {};
-    return root->get_all_records();
+    if (root == INVALID_NODE) return {};
+    return nodes_[root].get_all_records(nodes_);
 }
 
 bool CustomBPlusDB::save_to_file(const std::string& file_path) {
-    std::ofstream file(file_path, std::ios::binary);
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);  // Nodes are copied as raw bytes
+    // Over the table's own file the log has to restart from the new image
+    if (wal_ && file_path == db_path_) return checkpoint_unlocked();
+    return save_unlocked(file_path);
+}
+
+bool CustomBPlusDB::checkpoint() {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+    return checkpoint_unlocked();
+}
+
+bool CustomBPlusDB::checkpoint_unlocked() {
+    if (!wal_) return false;
+    // The page file goes first. A crash before the log is reset leaves a log
+    // of the previous checkpoint, which open_database() recognises and skips.
+    if (!save_unlocked(db_path_, checkpoint_id_ + 1)) return false;
+    checkpoint_id_++;
+    return wal_->reset(checkpoint_id_);
+}
+
+size_t CustomBPlusDB::wal_bytes() const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return wal_ ? wal_->size() : 0;
+}
+
+uint64_t CustomBPlusDB::log_write(WriteAheadLog::FrameType type, const void* payload, size_t bytes) {
+    return wal_ ? wal_->append(type, payload, bytes) : 0;
+}
+
+bool CustomBPlusDB::commit_log(uint64_t lsn) {
+    if (!wal_ || lsn == 0) return true;
+    if (!wal_->commit(lsn)) return false;
+    
+    // Checkpoint once the log outgrows the table as well as the threshold, so
+    // a checkpoint rewrites no more bytes than were logged since the last one
+    auto due = [&] {
+        return wal_->size() >= std::max<size_t>(checkpoint_bytes_, total_records.load() * sizeof(Record));
+    };
+    if (!due()) return true;
+    std::unique_lock<std::mutex> guard(checkpoint_mutex_, std::try_to_lock);
+    if (!guard) return true;  // Another writer is already at it
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+    if (due()) checkpoint_unlocked();  // A failed checkpoint leaves the log intact
+    return true;
+}
+
+void CustomBPlusDB::replay_log(const std::vector<WriteAheadLog::Frame>& frames) {
+    using FrameType = WriteAheadLog::FrameType;
+    std::vector<Record> inserts;  // Consecutive insert frames go in as one batch
+    auto flush_inserts = [&] {
+        if (!inserts.empty()) insert_batch(inserts);
+        inserts.clear();
+    };
+    for (const WriteAheadLog::Frame& frame : frames) {
+        const std::string& payload = frame.payload;
+        if (frame.type == FrameType::Insert) {
+            size_t first = inserts.size();
+            inserts.resize(first + payload.size() / sizeof(Record));
+            std::memcpy(inserts.data() + first, payload.data(), (inserts.size() - first) * sizeof(Record));
+            continue;
+        }
+        flush_inserts();
+        switch (frame.type) {
+        case FrameType::Row: {
+            std::vector<ColumnValue> values;
+            if (decode_row(payload, values)) insert_row(values);
+            break;
+        }
+        case FrameType::Delete: {
+            std::vector<int64_t> ids(payload.size() / sizeof(int64_t));
+            std::memcpy(ids.data(), payload.data(), ids.size() * sizeof(int64_t));
+            delete_batch(ids);
+            break;
+        }
+        case FrameType::Update: {
+            // Logged as the caller's (id, amount) pairs, which have no padding
+            constexpr size_t pair_bytes = sizeof(int64_t) + sizeof(double);
+            static_assert(sizeof(std::pair<int64_t, double>) == pair_bytes, "update frames are packed pairs");
+            std::vector<std::pair<int64_t, double>> updates(payload.size() / pair_bytes);
+            for (size_t i = 0; i < updates.size(); i++) {
+                const char* at = payload.data() + i * pair_bytes;
+                std::memcpy(&updates[i].first, at, sizeof(int64_t));
+                std::memcpy(&updates[i].second, at + sizeof(int64_t), sizeof(double));
+            }
+            update_amount_batch(updates);
+            break;
+        }
+        case FrameType::CreateIndex:
+            create_index(payload);
+            break;
+        case FrameType::DropIndex:
+            drop_index(payload);
+            break;
+        case FrameType::Synopses: {
+            std::vector<double> percents(payload.size() / sizeof(double));
+            std::memcpy(percents.data(), payload.data(), percents.size() * sizeof(double));
+            if (percents.empty()) {
+                drop_synopses();
+            } else {
+                build_synopses(percents);
+            }
+            break;
+        }
+        default:
+            break;  // Insert frames are gathered above
+        }
+    }
+    flush_inserts();
+}
+
+bool CustomBPlusDB::save_unlocked(const std::string& file_path, uint64_t checkpoint_id) const {
+    static_assert(std::is_trivially_copyable<BPlusTreeNode>::value, "nodes are written as raw bytes");
+    
+    // Write beside the target and rename over it: the old file may be mapped
+    // by this or another process, and truncating it in place would fault them
+    std::string tmp_path = file_path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
     if (!file.is_open()) return false;
     
-    // Write header
-    file.write(reinterpret_cast<const char*>(&total_records), sizeof(size_t));
-    file.write(reinterpret_cast<const char*>(&tree_height), sizeof(size_t));
+    const size_t slab_stride = page_file_slab_stride();
+    const size_t node_count = nodes_.size();
+    
+    PageFileHeader header{};
+    header.magic = PAGE_FILE_MAGIC;
+    header.version = PAGE_FILE_VERSION;
+    header.page_size = FILE_PAGE_SIZE;
+    header.node_size = sizeof(BPlusTreeNode);
+    header.slab_nodes = BPlusTreeArena::SLAB_NODES;
+    header.slab_stride = slab_stride;
+    header.node_count = node_count;
+    header.total_records = total_records.load();
+    header.tree_height = tree_height.load();
+    header.root = root;
+    header.checkpoint_id = checkpoint_id;
+    header.write_epoch = leaf_versions_.epoch();
+    
+    // Columns and dictionaries follow the last slab
+    std::string schema_image = schema_.serialize();
+    header.schema_offset = FILE_PAGE_SIZE + nodes_.slab_count() * slab_stride;
+    header.schema_bytes = schema_image.size();
+    
+    // Index image: count, then per index its column name and sorted postings
+    std::string index_image;
+    {
+        std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+        if (!indexes_.empty()) {
+            uint32_t index_count = static_cast<uint32_t>(indexes_.size());
+            index_image.append(reinterpret_cast<const char*>(&index_count), sizeof(index_count));
+            for (const auto& index : indexes_) {
+                uint32_t name_size = static_cast<uint32_t>(index->column().size());
+                std::vector<SecondaryIndex::Posting> postings = index->postings();
+                uint64_t posting_count = postings.size();
+                index_image.append(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+                index_image += index->column();
+                index_image.append(reinterpret_cast<const char*>(&posting_count), sizeof(posting_count));
+                index_image.append(reinterpret_cast<const char*>(postings.data()),
+                                   postings.size() * sizeof(SecondaryIndex::Posting));
+            }
+            header.index_offset = header.schema_offset + schema_image.size();
+            header.index_bytes = index_image.size();
+        }
+    }
+    std::string synopsis_image;
+    if (synopses_) {
+        synopsis_image = synopses_->serialize();
+        header.synopsis_offset = header.schema_offset + schema_image.size() + index_image.size();
+        header.synopsis_bytes = synopsis_image.size();
+    }
+    
+    std::vector<char> zeros(FILE_PAGE_SIZE, 0);
+    auto write_zeros = [&](size_t bytes) {
+        for (; bytes > 0; bytes -= std::min(bytes, zeros.size())) {
+            file.write(zeros.data(), std::min(bytes, zeros.size()));
+        }
+    };
     
-    // Serialize tree (simplified - write all records)
-    auto records = collect_all_records();
-    size_t record_count = records.size();
-    file.write(reinterpret_cast<const char*>(&record_count), sizeof(size_t));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_zeros(FILE_PAGE_SIZE - sizeof(header));
     
-    for (const auto& record : records) {
-        file.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+    // Slab images, unused slots zeroed. The last slab is padded to full size
+    // so a mapped file has room for new nodes before a heap slab is needed.
+    for (size_t i = 0; i < nodes_.slab_count() && file; ++i) {
+        size_t used = std::min(BPlusTreeArena::SLAB_NODES, node_count - i * BPlusTreeArena::SLAB_NODES);
+        file.write(reinterpret_cast<const char*>(nodes_.slab(i)), used * sizeof(BPlusTreeNode));
+        write_zeros(slab_stride - used * sizeof(BPlusTreeNode));
     }
-    
-    return file.good();
+    file.write(schema_image.data(), schema_image.size());
+    file.write(index_image.data(), index_image.size());
+    file.write(synopsis_image.data(), synopsis_image.size());
+    
+    file.close();
+    // Synced before it replaces the old file, and the rename synced before a
+    // checkpoint lets the log go
+    if (!file || !sync_path(tmp_path, false) || std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return sync_path(file_path, true);
 }
 
 bool CustomBPlusDB::load_from_file(const std::string& file_path) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    uint64_t magic = 0;
+    bool page_format = ::fstat(fd, &st) == 0 &&
+                       ::pread(fd, &magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+                       magic == PAGE_FILE_MAGIC;
+    if (page_format) {
+        std::unique_lock<std::shared_mutex> lock(db_mutex);
+        bool mapped = map_page_file(fd, static_cast<size_t>(st.st_size));
+        ::close(fd);  // The mapping keeps its own reference to the file
+        // A durable table now holds other rows than its log describes
+        return mapped && (!wal_ || checkpoint_unlocked());
+    }
+    ::close(fd);
+    
     std::ifstream file(file_path, std::ios::binary);
     if (!file.is_open()) return false;
+    return load_record_dump(file);
+}
+
+bool CustomBPlusDB::map_page_file(int fd, size_t file_size) {
+    PageFileHeader header;
+    if (file_size < FILE_PAGE_SIZE ||
+        ::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        return false;
+    }
     
-    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    // The image is only usable by a build with the same node layout
+    const size_t slab_stride = page_file_slab_stride();
+    if (header.version != PAGE_FILE_VERSION || header.page_size != FILE_PAGE_SIZE ||
+        header.node_size != sizeof(BPlusTreeNode) ||
+        header.slab_nodes != BPlusTreeArena::SLAB_NODES || header.slab_stride != slab_stride ||
+        header.node_count == 0 || header.root >= header.node_count) {
+        return false;
+    }
+    size_t slab_count = (header.node_count + BPlusTreeArena::SLAB_NODES - 1) / BPlusTreeArena::SLAB_NODES;
+    if (file_size < FILE_PAGE_SIZE + slab_count * slab_stride) return false;
+    
+    // Files without a schema image use the built-in columns
+    std::string schema_image;
+    if (header.schema_bytes > 0) {
+        if (header.schema_offset < FILE_PAGE_SIZE + slab_count * slab_stride ||
+            header.schema_offset > file_size || header.schema_bytes > file_size - header.schema_offset) {
+            return false;
+        }
+        schema_image.resize(header.schema_bytes);
+        if (::pread(fd, &schema_image[0], schema_image.size(), static_cast<off_t>(header.schema_offset)) !=
+            static_cast<ssize_t>(schema_image.size())) {
+            return false;
+        }
+    }
+    SchemaCatalog parsed;
+    if (!schema_image.empty() && !parsed.deserialize(schema_image)) return false;
+    
+    // Index postings are copied out of the file; each must name a filterable column
+    std::vector<std::unique_ptr<SecondaryIndex>> indexes;
+    if (header.index_bytes > 0) {
+        if (header.index_offset > file_size || header.index_bytes > file_size - header.index_offset) return false;
+        std::string image(header.index_bytes, '\0');
+        if (::pread(fd, &image[0], image.size(), static_cast<off_t>(header.index_offset)) !=
+            static_cast<ssize_t>(image.size())) {
+            return false;
+        }
+        size_t pos = 0;
+        auto read = [&](void* dst, size_t bytes) {
+            if (image.size() - pos < bytes) return false;
+            std::memcpy(dst, image.data() + pos, bytes);
+            pos += bytes;
+            return true;
+        };
+        uint32_t index_count = 0;
+        if (!read(&index_count, sizeof(index_count))) return false;
+        for (uint32_t i = 0; i < index_count; i++) {
+            uint32_t name_size;
+            uint64_t posting_count;
+            if (!read(&name_size, sizeof(name_size)) || image.size() - pos < name_size) return false;
+            std::string column = image.substr(pos, name_size);
+            pos += name_size;
+            ColumnKernel kernel;
+            if (!read(&posting_count, sizeof(posting_count)) || !parsed.resolve_filter(column, kernel) ||
+                posting_count > (image.size() - pos) / sizeof(SecondaryIndex::Posting)) {
+                return false;
+            }
+            std::vector<SecondaryIndex::Posting> postings(posting_count);
+            read(postings.data(), posting_count * sizeof(SecondaryIndex::Posting));
+            indexes.push_back(std::make_unique<SecondaryIndex>(column, kernel));
+            indexes.back()->assign(std::move(postings));
+        }
+    }
+    
+    // A ladder drawn from another row count (it can't be, short of a damaged
+    // file) is kept but redrawn before use
+    std::unique_ptr<SynopsisLadder> synopses;
+    if (header.synopsis_bytes > 0) {
+        if (header.synopsis_offset > file_size || header.synopsis_bytes > file_size - header.synopsis_offset) {
+            return false;
+        }
+        std::string image(header.synopsis_bytes, '\0');
+        if (::pread(fd, &image[0], image.size(), static_cast<off_t>(header.synopsis_offset)) !=
+            static_cast<ssize_t>(image.size())) {
+            return false;
+        }
+        synopses = SynopsisLadder::deserialize(image);
+        if (!synopses) return false;
+        if (synopses->population() != header.total_records) synopses->invalidate();
+    }
     
+    // MAP_PRIVATE: clean pages come straight from the page cache and are
+    // shared with every other process mapping the file; a write copies only
+    // the page it touches and never reaches the file
+    void* base = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return false;
+    
+    nodes_.clear();
+    tree_generation_++;
+    unmap_page_file();
+    if (nodes_.memory_policy().placed()) {
+        // Serving from the page cache would leave placement to the kernel;
+        // copy the slabs into placed memory instead
+        nodes_.copy_from(static_cast<char*>(base) + FILE_PAGE_SIZE, slab_stride, header.node_count);
+        ::munmap(base, file_size);
+    } else {
+        mapped_base_ = base;
+        mapped_bytes_ = file_size;
+        nodes_.adopt(static_cast<char*>(base) + FILE_PAGE_SIZE, slab_stride, header.node_count);
+    }
+    if (schema_image.empty()) {
+        schema_.reset();
+    } else {
+        schema_.deserialize(schema_image);  // Already validated above
+    }
+    {
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        indexes_ = std::move(indexes);
+    }
+    synopses_ = std::move(synopses);
+    
+    root = header.root;
+    total_records = header.total_records;
+    tree_height = header.tree_height;
+    retired_nodes_.clear();
+    free_nodes_.clear();
+    collect_free_nodes();  // Nodes unlinked before the save
+    if (!wal_) checkpoint_id_ = header.checkpoint_id;
+    leaf_versions_.reset(header.write_epoch);
+    leaf_addresses_.clear();
+    tree_start_address_ = nullptr;
+    invalidate_snapshot();
+    return true;
+}
+
+void CustomBPlusDB::unmap_page_file() {
+    if (mapped_base_) {
+        ::munmap(mapped_base_, mapped_bytes_);
+        mapped_base_ = nullptr;
+        mapped_bytes_ = 0;
+    }
+}
+
+bool CustomBPlusDB::load_record_dump(std::ifstream& file) {
     // Read header
     size_t stored_total, stored_height;
     file.read(reinterpret_cast<char*>(&stored_total), sizeof(size_t));
@@ -696,39 +2283,148 @@ bool CustomBPlusDB::load_from_file(const std::string& file_path) {
     // Read records
     size_t record_count;
     file.read(reinterpret_cast<char*>(&record_count), sizeof(size_t));
+    if (!file) return false;
     
     std::vector<Record> records(record_count);
-    for (size_t i = 0; i < record_count; i++) {
-        file.read(reinterpret_cast<char*>(&records[i]), sizeof(Record));
-    }
+    file.read(reinterpret_cast<char*>(records.data()), record_count * sizeof(Record));
+    if (!file) return false;
     
-    // Rebuild tree
-    root = std::make_shared<BPlusTreeNode>(true);
-    total_records = 0;
-    tree_height = 1;
+    // Record dumps were written in id order
+    auto by_id = [](const Record& a, const Record& b) { return a.id < b.id; };
+    if (!std::is_sorted(records.begin(), records.end(), by_id)) {
+        std::sort(records.begin(), records.end(), by_id);
+    }
     
-    return insert_batch(records);
+    // Rebuild tree bottom-up
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    schema_.reset();  // Record dumps predate schemas, indexes and synopses
+    drop_indexes();
+    synopses_.reset();
+    int load_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    build_from_sorted(records.data(), records.size(), 1.0, load_threads);
+    if (wal_) return checkpoint_unlocked();
+    checkpoint_id_ = 0;
+    return true;
 }
 
 // Native pointer-based sampling methods
 
-std::vector<Record> CustomBPlusDB::collect_leaf_records() const {
-    std::vector<Record> records;
+const BPlusTreeNode* CustomBPlusDB::first_leaf() const {
+    return node_ptr(first_leaf_id());
+}
+
+NodeId CustomBPlusDB::first_leaf_id() const {
+    NodeId current = root;
+    while (current != INVALID_NODE && !nodes_[current].is_leaf) {
+        current = nodes_[current].children[0];
+    }
+    return current;
+}
+
+LeafView CustomBPlusDB::leaf_view() const {
+    // Writers wait only while the view records each leaf's version; after
+    // that, the first write to a leaf saves a copy for the snapshot
+    std::shared_ptr<const CompressedLeafSet> compressed = compressed_leaf_set();
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+    return LeafView(nodes_, first_leaf_id(), std::move(compressed), &leaf_versions_, prefetch_distance_);
+}
+
+std::shared_ptr<const CompressedLeafSet> CustomBPlusDB::compressed_leaf_set() const {
+    std::lock_guard<std::mutex> codec_lock(codec_mutex_);
+    return compressed_leaves_;
+}
+
+size_t CustomBPlusDB::compress_leaves(int num_threads) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_ptr<const CompressedLeafSet> previous = compressed_leaf_set();
     
-    if (!root) return records;
+    std::vector<NodeId> leaf_ids;
+    for (NodeId id = first_leaf_id(); id != INVALID_NODE; id = nodes_[id].next_leaf) {
+        leaf_ids.push_back(id);
+    }
     
-    // Find leftmost leaf
-    auto current = root;
-    while (!current->is_leaf && !current->children.empty()) {
-        current = current->children[0];
+    // Leaves whose version is unchanged keep their encoding; the rest are
+    // encoded from a validated copy, in parallel across contiguous ranges
+    std::vector<std::shared_ptr<const EncodedLeaf>> encoded(nodes_.size());
+    num_threads = std::max(1, std::min<int>(num_threads, static_cast<int>(leaf_ids.size())));
+    size_t per_thread = leaf_ids.empty() ? 0 : (leaf_ids.size() + num_threads - 1) / num_threads;
+    std::vector<std::future<void>> workers;
+    for (int t = 0; t < num_threads; ++t) {
+        workers.push_back(std::async(std::launch::async, [&, t]() {
+            size_t end = std::min(leaf_ids.size(), (t + 1) * per_thread);
+            for (size_t i = t * per_thread; i < end; ++i) {
+                NodeId id = leaf_ids[i];
+                const BPlusTreeNode& leaf = nodes_[id];
+                if (previous && previous->find(id, leaf)) {
+                    encoded[id] = previous->leaves()[id];
+                    continue;
+                }
+                for (;;) {
+                    uint64_t version = NodeLatch::read_begin(leaf.version);
+                    auto copy = EncodedLeaf::encode(leaf, version);
+                    if (NodeLatch::read_validate(leaf.version, version)) {
+                        encoded[id] = std::move(copy);
+                        break;
+                    }
+                }
+            }
+        }));
     }
+    for (auto& worker : workers) worker.get();
     
-    // Traverse all leaf nodes
-    while (current) {
-        for (int i = 0; i < current->key_count; ++i) {
-            records.push_back(current->records[i]);
-        }
-        current = current->next_leaf;
+    // id, amount, region, product_id, timestamp
+    const size_t row_bytes = sizeof(int64_t) + sizeof(double) + 2 * sizeof(int32_t) + sizeof(int64_t);
+    size_t raw_bytes = 0;
+    for (NodeId id : leaf_ids) raw_bytes += encoded[id]->size() * row_bytes;
+    auto set = std::make_shared<const CompressedLeafSet>(std::move(encoded), raw_bytes);
+    
+    std::lock_guard<std::mutex> codec_lock(codec_mutex_);
+    compressed_leaves_ = set;
+    return set->encoded_bytes();
+}
+
+void CustomBPlusDB::drop_compressed_leaves() {
+    std::lock_guard<std::mutex> codec_lock(codec_mutex_);
+    compressed_leaves_.reset();
+}
+
+size_t CustomBPlusDB::compressed_leaf_bytes() const {
+    std::shared_ptr<const CompressedLeafSet> compressed = compressed_leaf_set();
+    return compressed ? compressed->encoded_bytes() : 0;
+}
+
+size_t CustomBPlusDB::raw_leaf_bytes() const {
+    std::shared_ptr<const CompressedLeafSet> compressed = compressed_leaf_set();
+    return compressed ? compressed->raw_bytes() : 0;
+}
+
+void CustomBPlusDB::scan_leaves(const std::function<void(const LeafSpan&)>& visit) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);  // Spans point at live leaves
+    for (LeafCursor cursor(nodes_, first_leaf_id(), prefetch_distance_); cursor.valid(); cursor.next()) {
+        visit(cursor.span());
+    }
+}
+
+void CustomBPlusDB::scan_node_leaves(int node, const std::function<void(const LeafSpan&)>& visit) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);
+    for (LeafCursor cursor(nodes_, first_leaf_id(), prefetch_distance_); cursor.valid(); cursor.next()) {
+        if (std::max(-1, nodes_.slab_node(cursor.id() / BPlusTreeArena::SLAB_NODES)) == node) visit(cursor.span());
+    }
+}
+
+std::vector<Record> CustomBPlusDB::collect_leaf_records() const {
+    std::vector<Record> records;
+    
+    if (root == INVALID_NODE) return records;
+    records.reserve(total_records.load());
+    
+    // Traverse all leaf nodes, rebuilding rows from the columns
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (const BPlusTreeNode* current = first_leaf(); current; current = node_ptr(current->next_leaf)) {
+        current->append_records_to(records);
+        prefetcher.advance();
     }
     
     return records;
@@ -737,7 +2433,7 @@ std::vector<Record> CustomBPlusDB::collect_leaf_records() const {
 std::vector<Record> CustomBPlusDB::fast_pointer_sample(double sample_percent, int step_size) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -749,7 +2445,9 @@ std::vector<Record> CustomBPlusDB::fast_pointer_sample(double sample_percent, in
     int step = std::max(1, static_cast<int>(all_records.size() / target_count));
     step *= step_size; // Fast pointer multiplier
     
+    size_t lookahead = all_records.prefetch_distance() * step;
     for (size_t i = 0; i < all_records.size() && samples.size() < target_count; i += step) {
+        all_records.prefetch(i + lookahead);
         samples.push_back(all_records[i]);
     }
     
@@ -759,7 +2457,7 @@ std::vector<Record> CustomBPlusDB::fast_pointer_sample(double sample_percent, in
 std::vector<Record> CustomBPlusDB::slow_pointer_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -770,7 +2468,9 @@ std::vector<Record> CustomBPlusDB::slow_pointer_sample(double sample_percent) {
     // Slow pointer: smaller, more systematic steps
     int step = std::max(1, static_cast<int>(all_records.size() / target_count));
     
+    size_t lookahead = all_records.prefetch_distance() * step;
     for (size_t i = 0; i < all_records.size() && samples.size() < target_count; i += step) {
+        all_records.prefetch(i + lookahead);
         samples.push_back(all_records[i]);
     }
     
@@ -780,7 +2480,7 @@ std::vector<Record> CustomBPlusDB::slow_pointer_sample(double sample_percent) {
 std::vector<Record> CustomBPlusDB::dual_pointer_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -814,7 +2514,7 @@ std::vector<Record> CustomBPlusDB::dual_pointer_sample(double sample_percent) {
 std::vector<Record> CustomBPlusDB::parallel_pointer_sample(double sample_percent, int num_threads) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -855,30 +2555,134 @@ std::vector<Record> CustomBPlusDB::parallel_pointer_sample(double sample_percent
 
 std::vector<Record> CustomBPlusDB::random_pointer_sample(double sample_percent, unsigned int seed) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
     
-    auto all_records = collect_leaf_records();
     std::vector<Record> samples;
+    size_t total = root == INVALID_NODE ? 0 : nodes_[root].subtree_record_count;
+    if (total == 0) return samples;
     
-    if (all_records.empty()) return samples;
-    
-    int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
+    int target_count = static_cast<int>(total * sample_percent / 100.0);
     if (target_count == 0) return samples;
     
-    // Generate random positions
+    // Distinct random positions, fetched by rank instead of walking the leaf chain
     std::mt19937 rng(seed);
-    std::uniform_int_distribution<size_t> dist(0, all_records.size() - 1);
+    std::vector<size_t> ranks = sample_ranks(total, static_cast<size_t>(target_count), rng);
+    samples.reserve(ranks.size());
+    collect_ranks(root, 0, ranks.data(), ranks.data() + ranks.size(), samples);
+    return samples;
+}
+
+std::vector<Record> CustomBPlusDB::bernoulli_sample(double sample_percent, unsigned int seed) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    std::set<size_t> selected_positions;
-    while (selected_positions.size() < target_count && selected_positions.size() < all_records.size()) {
-        selected_positions.insert(dist(rng));
+    std::vector<Record> samples;
+    if (sample_percent <= 0.0) return samples;
+    double p = std::min(sample_percent / 100.0, 1.0);
+    samples.reserve(static_cast<size_t>(total_records.load() * p * 1.1) + 16);
+    
+    // Rows passed over before the next kept one
+    std::mt19937 gen(seed != 0 ? seed : std::random_device{}());
+    std::geometric_distribution<size_t> geometric(p < 1.0 ? p : 0.5);
+    auto gap = [&] { return p < 1.0 ? geometric(gen) : size_t(0); };
+    
+    // `skip` rows remain to pass over before the next kept row; it carries
+    // from leaf to leaf, so a leaf shorter than the gap is read for its
+    // key_count and next link only
+    size_t skip = gap();
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (const BPlusTreeNode* leaf = first_leaf(); leaf;) {
+        NodeId next = INVALID_NODE;
+        size_t kept = samples.size();
+        skip = NodeLatch::optimistic_read(leaf->version, [&] {
+            samples.resize(kept);
+            next = leaf->next_leaf;
+            size_t rows = static_cast<size_t>(leaf->key_count);
+            size_t position = skip;
+            for (; position < rows; position += 1 + gap()) {
+                samples.emplace_back(leaf->keys[position], leaf->amounts[position], leaf->regions[position],
+                                     leaf->product_ids[position], leaf->timestamps[position]);
+            }
+            return position - rows;
+        });
+        leaf = node_ptr(next);
+        prefetcher.advance();
     }
+    return samples;
+}
+
+std::vector<Record> CustomBPlusDB::reservoir_sample(size_t k, int num_threads, unsigned int seed,
+                                                   size_t* population, uint64_t* snapshot_id) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    LeafView view = leaf_view();
+    if (snapshot_id) *snapshot_id = view.snapshot_id();
+    if (population) *population = view.size();
+    if (view.empty() || k == 0) return {};
     
-    // Collect samples at random positions
-    for (size_t pos : selected_positions) {
-        samples.push_back(all_records[pos]);
+    std::mt19937 gen(seed != 0 ? seed : std::random_device{}());
+    num_threads = std::max(1, std::min<int>(num_threads, static_cast<int>(view.leaf_count())));
+    std::vector<unsigned int> seeds(num_threads);
+    for (unsigned int& thread_seed : seeds) thread_seed = gen();
+    
+    std::vector<std::future<std::vector<Record>>> futures;
+    std::vector<size_t> range_rows(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        size_t begin = view.leaf_offset(view.leaf_count() * t / num_threads);
+        size_t end = view.leaf_offset(view.leaf_count() * (t + 1) / num_threads);
+        range_rows[t] = end - begin;
+        futures.push_back(std::async(std::launch::async, [&, t, begin, end]() {
+            std::mt19937 thread_gen(seeds[t]);
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            auto unit = [&] {  // In (0, 1), so its log is finite
+                double u;
+                do u = uniform(thread_gen); while (u == 0.0);
+                return u;
+            };
+            
+            std::vector<Record> reservoir;
+            reservoir.reserve(std::min(k, end - begin));
+            RecordCursor cursor = view.cursor(begin);
+            for (; cursor.valid() && reservoir.size() < k && cursor.position() < end; cursor.next()) {
+                reservoir.push_back(cursor.record());
+            }
+            if (end - begin <= k) return reservoir;
+            
+            // Algorithm L: the gap to the next replacement is geometric in the
+            // current threshold w, so only O(k log(n/k)) rows are read
+            std::uniform_int_distribution<size_t> slot(0, k - 1);
+            double w = std::exp(std::log(unit()) / k);
+            for (size_t position = begin + k - 1;;) {
+                double jump = std::floor(std::log(unit()) / std::log1p(-w)) + 1.0;
+                if (jump >= static_cast<double>(end - position)) break;
+                position += static_cast<size_t>(jump);
+                reservoir[slot(thread_gen)] = view[position];
+                w *= std::exp(std::log(unit()) / k);
+            }
+            return reservoir;
+        }));
     }
     
-    return samples;
+    std::vector<Record> merged = futures[0].get();
+    size_t merged_rows = range_rows[0];
+    for (int t = 1; t < num_threads; ++t) {
+        merged = merge_reservoirs(std::move(merged), merged_rows, futures[t].get(), range_rows[t], k, gen);
+        merged_rows += range_rows[t];
+    }
+    std::shuffle(merged.begin(), merged.end(), gen);
+    return merged;
+}
+
+bool CustomBPlusDB::reservoir_aggregate(const std::string& column, size_t k, int num_threads,
+                                        ColumnAggregate& out, size_t& population, uint64_t* snapshot_id) {
+    ColumnKernel kernel;
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        if (!schema_.resolve(column, kernel)) return false;
+    }
+    out = ColumnAggregate();
+    for (const Record& record : reservoir_sample(k, num_threads, 0, &population, snapshot_id)) {
+        out.add(kernel.value(record));
+    }
+    return true;
 }
 
 // Advanced multithreaded fast/slow pointer with CLT validation
@@ -890,7 +2694,7 @@ std::vector<Record> CustomBPlusDB::clt_validated_dual_pointer_sample(double samp
     // Single lock for the entire operation to avoid deadlocks
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     if (all_records.empty()) return {};
     
     size_t total_records = all_records.size();
@@ -917,7 +2721,7 @@ std::vector<Record> CustomBPlusDB::clt_validated_dual_pointer_sample(double samp
     // Fast pointer threads (aggressive sampling)
     int fast_threads = num_threads / 2;
     for (int t = 0; t < fast_threads; ++t) {
-        futures.push_back(std::async(std::launch::async, [&, t, &all_records]() {
+        futures.push_back(std::async(std::launch::async, [&, t]() {
             std::vector<Record> local_samples;
             std::vector<double> local_values;
             
@@ -929,7 +2733,7 @@ std::vector<Record> CustomBPlusDB::clt_validated_dual_pointer_sample(double samp
             size_t local_check_count = 0;
             for (size_t i = thread_start; i < thread_end && !should_stop.load(); i += fast_step) {
                 local_samples.push_back(all_records[i]);
-                local_values.push_back(all_records[i].amount);
+                local_values.push_back(all_records.amount_at(i));
                 local_check_count++;
                 
                 // Check CLT convergence every check_interval samples
@@ -971,7 +2775,7 @@ std::vector<Record> CustomBPlusDB::clt_validated_dual_pointer_sample(double samp
     // Slow pointer threads (validation and precision)
     int slow_threads = num_threads - fast_threads;
     for (int t = 0; t < slow_threads; ++t) {
-        futures.push_back(std::async(std::launch::async, [&, t, &all_records]() {
+        futures.push_back(std::async(std::launch::async, [&, t]() {
             std::vector<Record> local_samples;
             std::vector<double> local_values;
             
@@ -986,7 +2790,7 @@ std::vector<Record> CustomBPlusDB::clt_validated_dual_pointer_sample(double samp
             size_t local_check_count = 0;
             for (size_t i = thread_start + offset; i < thread_end && !should_stop.load(); i += slow_step) {
                 local_samples.push_back(all_records[i]);
-                local_values.push_back(all_records[i].amount);
+                local_values.push_back(all_records.amount_at(i));
                 local_check_count++;
                 
                 // Slow pointer validation: more frequent checks
@@ -1050,7 +2854,7 @@ std::vector<Record> CustomBPlusDB::optimized_clt_sample(double sample_percent,
                                                         double max_error_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     if (all_records.empty()) return {};
     
     size_t total_records = all_records.size();
@@ -1151,7 +2955,7 @@ std::vector<Record> CustomBPlusDB::optimized_clt_sample(double sample_percent,
 std::vector<Record> CustomBPlusDB::block_sample(double sample_percent, size_t block_size) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -1167,23 +2971,60 @@ std::vector<Record> CustomBPlusDB::block_sample(double sample_percent, size_t bl
     size_t block_interval = total_blocks / blocks_to_sample;
     if (block_interval == 0) block_interval = 1;
     
+    size_t lookahead = all_records.prefetch_distance() * block_interval;  // In blocks
     for (size_t block_idx = 0; block_idx < total_blocks && samples.size() < target_count; block_idx += block_interval) {
         size_t start_idx = block_idx * block_size;
         size_t end_idx = std::min(start_idx + block_size, all_records.size());
+        all_records.prefetch((block_idx + lookahead) * block_size);
         
         // Sample all records in this block
-        for (size_t i = start_idx; i < end_idx && samples.size() < target_count; ++i) {
-            samples.push_back(all_records[i]);
+        for (RecordCursor cursor = all_records.cursor(start_idx);
+             cursor.valid() && cursor.position() < end_idx && samples.size() < target_count; cursor.next()) {
+            samples.push_back(cursor.record());
         }
     }
     
     return samples;
 }
 
+std::vector<Record> CustomBPlusDB::block_sample_where(double min_amount, double max_amount, double sample_percent) {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::vector<Record> samples;
+    if (sample_percent <= 0.0) return samples;
+    
+    // Blocks are leaves; only those the zone maps leave in play are candidates
+    std::vector<NodeId> leaves = leaves_overlapping(min_amount, max_amount);
+    if (leaves.empty()) return samples;
+    size_t blocks_to_sample = std::max<size_t>(1, std::llround(leaves.size() * std::min(sample_percent, 100.0) / 100.0));
+    double interval = static_cast<double>(leaves.size()) / blocks_to_sample;
+    
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    double position = std::uniform_real_distribution<double>(0.0, interval)(gen);
+    for (; position < leaves.size(); position += interval) {
+        const BPlusTreeNode& leaf = nodes_[leaves[static_cast<size_t>(position)]];
+        size_t start = samples.size();
+        for (;;) {
+            uint64_t seen = NodeLatch::read_begin(leaf.version);
+            int count = leaf.key_count;
+            bool whole = count > 0 && leaf.zone_covers(min_amount, max_amount);
+            for (int i = 0; i < count; i++) {
+                double amount = leaf.amounts[i];
+                if (whole || (amount >= min_amount && amount <= max_amount)) {
+                    samples.emplace_back(leaf.keys[i], amount, leaf.regions[i], leaf.product_ids[i], leaf.timestamps[i]);
+                }
+            }
+            if (NodeLatch::read_validate(leaf.version, seen)) break;
+            samples.resize(start);
+        }
+    }
+    return samples;
+}
+
 std::vector<Record> CustomBPlusDB::page_sample(double sample_percent, size_t page_size) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -1202,13 +3043,16 @@ std::vector<Record> CustomBPlusDB::page_sample(double sample_percent, size_t pag
     size_t page_interval = total_pages / pages_to_sample;
     if (page_interval == 0) page_interval = 1;
     
+    size_t lookahead = all_records.prefetch_distance() * page_interval;  // In pages
     for (size_t page_idx = 0; page_idx < total_pages && samples.size() < target_count; page_idx += page_interval) {
         size_t start_idx = page_idx * records_per_page;
         size_t end_idx = std::min(start_idx + records_per_page, all_records.size());
+        all_records.prefetch((page_idx + lookahead) * records_per_page);
         
         // Sample all records in this page
-        for (size_t i = start_idx; i < end_idx && samples.size() < target_count; ++i) {
-            samples.push_back(all_records[i]);
+        for (RecordCursor cursor = all_records.cursor(start_idx);
+             cursor.valid() && cursor.position() < end_idx && samples.size() < target_count; cursor.next()) {
+            samples.push_back(cursor.record());
         }
     }
     
@@ -1218,7 +3062,7 @@ std::vector<Record> CustomBPlusDB::page_sample(double sample_percent, size_t pag
 std::vector<Record> CustomBPlusDB::parallel_block_sample(double sample_percent, size_t block_size, int num_threads) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -1230,30 +3074,40 @@ std::vector<Record> CustomBPlusDB::parallel_block_sample(double sample_percent,
     size_t total_blocks = (all_records.size() + block_size - 1) / block_size;
     size_t blocks_to_sample = std::max(1UL, static_cast<size_t>(total_blocks * sample_percent / 100.0));
     
-    // Divide blocks among threads
+    // Divide blocks among threads, each reading blocks on its own NUMA node
+    // when leaves are partitioned across nodes
     size_t blocks_per_thread = blocks_to_sample / num_threads;
     if (blocks_per_thread == 0) blocks_per_thread = 1;
+    size_t block_interval = total_blocks / blocks_to_sample;
+    if (block_interval == 0) block_interval = 1;
+    
+    std::vector<size_t> block_starts;
+    for (size_t block_idx = 0; block_idx < std::min(blocks_per_thread * num_threads, blocks_to_sample); ++block_idx) {
+        block_starts.push_back(block_idx * block_interval * block_size);
+    }
+    std::vector<NodeShare> shares = split_by_node(block_starts, num_threads, [&](size_t start) {
+        return all_records.leaf_node(all_records.leaf_index_of(start));
+    });
     
     std::vector<std::future<std::vector<Record>>> futures;
     
-    for (int t = 0; t < num_threads; ++t) {
-        futures.push_back(std::async(std::launch::async, [&, t]() {
+    for (const NodeShare& share : shares) {
+        futures.push_back(std::async(std::launch::async, [&]() {
+            pin_to_share_node(share);
             std::vector<Record> thread_samples;
             size_t thread_samples_target = target_count / num_threads;
             
-            size_t start_block = t * blocks_per_thread;
-            size_t end_block = std::min(start_block + blocks_per_thread, blocks_to_sample);
-            
-            size_t block_interval = total_blocks / blocks_to_sample;
-            if (block_interval == 0) block_interval = 1;
-            
-            for (size_t block_idx = start_block; block_idx < end_block && thread_samples.size() < thread_samples_target; ++block_idx) {
-                size_t actual_block_idx = block_idx * block_interval;
-                size_t start_idx = actual_block_idx * block_size;
+            for (size_t i = 0; i < share.items.size() && thread_samples.size() < thread_samples_target; ++i) {
+                size_t start_idx = share.items[i];
                 size_t end_idx = std::min(start_idx + block_size, all_records.size());
+                if (i + all_records.prefetch_distance() < share.items.size()) {
+                    all_records.prefetch(share.items[i + all_records.prefetch_distance()]);
+                }
                 
-                for (size_t i = start_idx; i < end_idx && thread_samples.size() < thread_samples_target; ++i) {
-                    thread_samples.push_back(all_records[i]);
+                for (RecordCursor cursor = all_records.cursor(start_idx);
+                     cursor.valid() && cursor.position() < end_idx && thread_samples.size() < thread_samples_target;
+                     cursor.next()) {
+                    thread_samples.push_back(cursor.record());
                 }
             }
             
@@ -1273,7 +3127,7 @@ std::vector<Record> CustomBPlusDB::parallel_block_sample(double sample_percent,
 std::vector<Record> CustomBPlusDB::adaptive_block_sample(double sample_percent, size_t min_block_size, size_t max_block_size) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -1294,9 +3148,11 @@ std::vector<Record> CustomBPlusDB::adaptive_block_sample(double sample_percent,
         double sum = 0.0, sum_sq = 0.0;
         size_t count = end_idx - start_idx;
         
-        for (size_t i = start_idx; i < end_idx; ++i) {
-            sum += all_records[i].amount;
-            sum_sq += all_records[i].amount * all_records[i].amount;
+        for (RecordCursor cursor = all_records.cursor(start_idx);
+             cursor.valid() && cursor.position() < end_idx; cursor.next()) {
+            double amount = cursor.amount();
+            sum += amount;
+            sum_sq += amount * amount;
         }
         
         double mean = sum / count;
@@ -1316,6 +3172,7 @@ std::vector<Record> CustomBPlusDB::adaptive_block_sample(double sample_percent,
         // Sample this zone with adaptive block size
         for (size_t i = start_idx; i < end_idx && samples.size() < target_count; i += adaptive_block_size) {
             size_t block_end = std::min(i + adaptive_block_size, end_idx);
+            all_records.prefetch(i + all_records.prefetch_distance() * adaptive_block_size);
             
             // Sample from this adaptive block
             size_t block_sample_count = std::max(1UL, static_cast<size_t>((block_end - i) * sample_percent / 100.0));
@@ -1331,7 +3188,7 @@ std::vector<Record> CustomBPlusDB::adaptive_block_sample(double sample_percent,
 std::vector<Record> CustomBPlusDB::stratified_block_sample(double sample_percent, size_t block_size, int strata_count) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     std::vector<Record> samples;
     
     if (all_records.empty()) return samples;
@@ -1339,10 +3196,11 @@ std::vector<Record> CustomBPlusDB::stratified_block_sample(double sample_percent
     int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
     if (target_count == 0) return samples;
     
-    // Sort records by amount for stratification
-    std::vector<Record> sorted_records = all_records;
-    std::sort(sorted_records.begin(), sorted_records.end(), 
-              [](const Record& a, const Record& b) { return a.amount < b.amount; });
+    // Order row positions by amount for stratification; rows stay in the leaves
+    std::vector<size_t> sorted_records(all_records.size());
+    for (size_t i = 0; i < sorted_records.size(); ++i) sorted_records[i] = i;
+    std::sort(sorted_records.begin(), sorted_records.end(),
+              [&all_records](size_t a, size_t b) { return all_records.amount_at(a) < all_records.amount_at(b); });
     
     // Divide into strata
     size_t stratum_size = sorted_records.size() / strata_count;
@@ -1369,8 +3227,10 @@ std::vector<Record> CustomBPlusDB::stratified_block_sample(double sample_percent
             size_t remaining_samples = std::min(samples_per_stratum, target_count - samples.size());
             size_t block_samples = std::min(remaining_samples, block_end - block_start);
             
+            size_t lookahead = all_records.prefetch_distance();  // In rows, which are scattered
             for (size_t i = 0; i < block_samples; ++i) {
-                samples.push_back(sorted_records[block_start + i]);
+                if (i + lookahead < block_samples) all_records.prefetch(sorted_records[block_start + i + lookahead]);
+                samples.push_back(all_records[sorted_records[block_start + i]]);
             }
         }
     }
@@ -1385,23 +3245,9 @@ std::vector<Record> CustomBPlusDB::stratified_block_sample(double sample_percent
 void CustomBPlusDB::initialize_memory_layout() {
     record_size_ = sizeof(Record);  // Fixed size: 40 bytes (8+8+4+4+8+padding)
     
-    // Cache starting address of first leaf node
-    if (root && root->is_leaf) {
-        tree_start_address_ = static_cast<void*>(root->records.data());
-    } else {
-        // Find first leaf
-        auto current = root;
-        while (current && !current->is_leaf) {
-            if (!current->children.empty()) {
-                current = current->children[0];
-            } else {
-                break;
-            }
-        }
-        if (current && current->is_leaf && !current->records.empty()) {
-            tree_start_address_ = static_cast<void*>(current->records.data());
-        }
-    }
+    // Cache starting address of first leaf node's id column
+    const BPlusTreeNode* leaf = first_leaf();
+    tree_start_address_ = leaf ? const_cast<int64_t*>(leaf->keys.data()) : nullptr;
     
     // Update leaf addresses cache
     update_leaf_addresses();
@@ -1409,65 +3255,25 @@ void CustomBPlusDB::initialize_memory_layout() {
 
 void CustomBPlusDB::update_leaf_addresses() {
     leaf_addresses_.clear();
-    
-    std::function<void(std::shared_ptr<BPlusTreeNode>)> collect_leaves = 
-        [&](std::shared_ptr<BPlusTreeNode> node) {
-            if (!node) return;
-            
-            if (node->is_leaf) {
-                if (!node->records.empty()) {
-                    leaf_addresses_.push_back(static_cast<void*>(node->records.data()));
-                }
-            } else {
-                for (auto& child : node->children) {
-                    collect_leaves(child);
-                }
-            }
-        };
-    
-    collect_leaves(root);
-}
-
-Record* CustomBPlusDB::get_record_at_offset(size_t byte_offset) {
-    if (!tree_start_address_) return nullptr;
-    
-    void* target_address = static_cast<char*>(tree_start_address_) + byte_offset;
-    
-    // Validate address is within any leaf node
-    for (void* leaf_addr : leaf_addresses_) {
-        char* leaf_start = static_cast<char*>(leaf_addr);
-        char* leaf_end = leaf_start + (BPlusTreeNode::MAX_KEYS * record_size_);
-        
-        if (target_address >= leaf_start && target_address < leaf_end) {
-            return static_cast<Record*>(target_address);
-        }
-    }
-    
-    return nullptr;  // Address not valid
-}
-
-bool CustomBPlusDB::is_valid_record_address(void* address) {
-    for (void* leaf_addr : leaf_addresses_) {
-        char* leaf_start = static_cast<char*>(leaf_addr);
-        char* leaf_end = leaf_start + (BPlusTreeNode::MAX_KEYS * record_size_);
-        
-        if (address >= leaf_start && address < leaf_end) {
-            return true;
+    
+    // Leaves are reached through the chain instead of a recursive descent
+    for (const BPlusTreeNode* leaf = first_leaf(); leaf; leaf = node_ptr(leaf->next_leaf)) {
+        if (leaf->key_count > 0) {
+            leaf_addresses_.push_back(const_cast<int64_t*>(leaf->keys.data()));
         }
     }
-    return false;
 }
 
 std::vector<Record> CustomBPlusDB::byte_offset_sample(double sample_percent) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     if (total_records == 0) {
         // Fallback: use actual record count
-        auto all_records = collect_leaf_records();
+        LeafView all_records = leaf_view();
         total_records = all_records.size();
         if (total_records == 0) return samples;
     }
@@ -1484,9 +3290,9 @@ std::vector<Record> CustomBPlusDB::random_start_nth_sample(double sample_percent
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     if (total_records == 0) return samples;
     
     int target_count = static_cast<int>(total_records * sample_percent / 100.0);
@@ -1501,7 +3307,7 @@ std::vector<Record> CustomBPlusDB::random_start_nth_sample(double sample_percent
     std::mt19937 gen(rd());
     
     // Get all records for virtual addressing
-    auto all_records = collect_leaf_records();
+    LeafView all_records = leaf_view();
     if (all_records.empty()) return samples;
     
     // Random starting position (simulating random memory address)
@@ -1527,7 +3333,7 @@ std::vector<Record> CustomBPlusDB::memory_stride_sample(double sample_percent, s
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
     // **MEMORY STRIDE SAMPLING EXPLANATION:**
     // Memory stride is a cache-optimized access pattern that:
@@ -1537,9 +3343,11 @@ std::vector<Record> CustomBPlusDB::memory_stride_sample(double sample_percent, s
     // 4. Achieves O(1) access time per sample after initial setup
     
     // Use pre-cached records if available (mmap already initialized)
-    if (memory_mapped_ && !cached_records_.empty()) {
+    std::shared_ptr<const std::vector<Record>> snapshot = current_snapshot();
+    if (snapshot && !snapshot->empty()) {
+        const std::vector<Record>& cached_records = *snapshot;
         // **OPTIMIZED PATH**: Use pre-allocated memory mapping
-        int target_count = static_cast<int>(cached_records_.size() * sample_percent / 100.0);
+        int target_count = static_cast<int>(cached_records.size() * sample_percent / 100.0);
         if (target_count == 0) return samples;
         
         samples.reserve(target_count);
@@ -1550,7 +3358,7 @@ std::vector<Record> CustomBPlusDB::memory_stride_sample(double sample_percent, s
             // Auto-calculate stride for optimal cache line utilization
             // Typical cache line: 64 bytes, Record size: ~32 bytes
             // Optimal stride: 2-4 records to stay within cache lines
-            record_stride = std::max(1UL, cached_records_.size() / target_count);
+            record_stride = std::max(1UL, cached_records.size() / target_count);
         } else {
             // Convert byte stride to record stride
             record_stride = std::max(1UL, stride_bytes / sizeof(Record));
@@ -1558,15 +3366,15 @@ std::vector<Record> CustomBPlusDB::memory_stride_sample(double sample_percent, s
         
         // **MEMORY STRIDE ACCESS PATTERN**
         // Access memory at fixed intervals for maximum cache efficiency
-        for (size_t offset = 0; samples.size() < target_count && offset < cached_records_.size(); offset += record_stride) {
-            samples.push_back(cached_records_[offset]);
+        for (size_t offset = 0; samples.size() < target_count && offset < cached_records.size(); offset += record_stride) {
+            samples.push_back(cached_records[offset]);
         }
         
         return samples;
     }
     
     // **FALLBACK PATH**: Traditional tree traversal (slower)
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     if (total_records == 0) return samples;
     
     int target_count = static_cast<int>(total_records * sample_percent / 100.0);
@@ -1584,18 +3392,14 @@ std::vector<Record> CustomBPlusDB::memory_stride_sample(double sample_percent, s
         if (record_stride == 0) record_stride = 1;
     }
     
-    // Get all records for stride access (creates mmap for future use)
-    auto all_records = collect_leaf_records();
+    // Stride directly over the leaves - no table copy
+    LeafView all_records = leaf_view();
     if (all_records.empty()) return samples;
     
-    // Cache for future memory stride optimizations
-    if (!memory_mapped_) {
-        cached_records_ = all_records;
-        memory_mapped_ = true;
-    }
-    
     // Sample with fixed stride pattern
+    size_t lookahead = all_records.prefetch_distance() * record_stride;
     for (size_t offset = 0; samples.size() < target_count && offset < all_records.size(); offset += record_stride) {
+        all_records.prefetch(offset + lookahead);
         samples.push_back(all_records[offset]);
     }
     
@@ -1606,12 +3410,12 @@ std::vector<Record> CustomBPlusDB::address_arithmetic_sample(double sample_perce
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
-    size_t total_records = root->subtree_record_count;
+    size_t total_records = nodes_[root].subtree_record_count;
     if (total_records == 0) {
         // Fallback: use actual record count
-        auto all_records = collect_leaf_records();
+        LeafView all_records = leaf_view();
         total_records = all_records.size();
         if (total_records == 0) return samples;
     }
@@ -1620,9 +3424,10 @@ std::vector<Record> CustomBPlusDB::address_arithmetic_sample(double sample_perce
     if (target_count == 0) return samples;
     
     // **OPTIMIZATION**: Check if mmap is already created to avoid creation overhead
-    if (!memory_mapped_ || cached_records_.empty()) {
+    std::shared_ptr<const std::vector<Record>> snapshot = current_snapshot();
+    if (!snapshot || snapshot->empty()) {
         // This includes mmap creation time - significant overhead
-        auto all_records = collect_leaf_records();
+        LeafView all_records = leaf_view();
         if (all_records.empty()) return samples;
         
         // Pure virtual address arithmetic: use random access with systematic distribution
@@ -1647,17 +3452,18 @@ std::vector<Record> CustomBPlusDB::address_arithmetic_sample(double sample_perce
         }
     } else {
         // Use pre-cached records for true address arithmetic speed
+        const std::vector<Record>& cached_records = *snapshot;
         std::random_device rd;
         std::mt19937 gen(rd());
         
-        size_t stride = cached_records_.size() / target_count;
+        size_t stride = cached_records.size() / target_count;
         if (stride == 0) stride = 1;
         
         for (int i = 0; i < target_count; ++i) {
             size_t base_address = i * stride;
             std::uniform_int_distribution<size_t> offset_dist(0, stride / 2);
-            size_t virtual_addr = (base_address + offset_dist(gen)) % cached_records_.size();
-            samples.push_back(cached_records_[virtual_addr]);
+            size_t virtual_addr = (base_address + offset_dist(gen)) % cached_records.size();
+            samples.push_back(cached_records[virtual_addr]);
         }
     }
     
@@ -1668,34 +3474,31 @@ std::vector<Record> CustomBPlusDB::optimized_address_arithmetic_sample(double sa
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
     // **USE PRE-INITIALIZED MEMORY MAPPING** 
-    // Since mmap is created during database creation/insertion, no overhead here
-    if (!memory_mapped_ || cached_records_.empty()) {
-        // Final fallback: create mmap if somehow not initialized
-        cached_records_ = collect_leaf_records();
-        memory_mapped_ = true;
-    }
+    // Built on the first read after writes, then reused until the next write
+    std::shared_ptr<const std::vector<Record>> snapshot_ref = record_snapshot();
+    const std::vector<Record>& snapshot = *snapshot_ref;
     
-    if (cached_records_.empty()) return samples;
+    if (snapshot.empty()) return samples;
     
-    int target_count = static_cast<int>(cached_records_.size() * sample_percent / 100.0);
+    int target_count = static_cast<int>(snapshot.size() * sample_percent / 100.0);
     if (target_count == 0) return samples;
     
     // **PURE ADDRESS ARITHMETIC** - zero mmap creation overhead
     samples.reserve(target_count);
     
     // Direct memory access pattern using pointer arithmetic
-    size_t stride = cached_records_.size() / target_count;
+    size_t stride = snapshot.size() / target_count;
     if (stride == 0) stride = 1;
     
     // O(1) address calculations - base_ptr + offset * sizeof(Record)
     for (int i = 0; i < target_count; ++i) {
         size_t address_offset = i * stride;
-        if (address_offset < cached_records_.size()) {
+        if (address_offset < snapshot.size()) {
             // Direct pointer arithmetic: memory_base + calculated_offset
-            samples.push_back(cached_records_[address_offset]);
+            samples.push_back(snapshot[address_offset]);
         }
     }
     
@@ -1706,16 +3509,11 @@ std::vector<Record> CustomBPlusDB::signal_based_clt_sample(double sample_percent
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
-    // Use pre-cached records if available, otherwise collect them
-    std::vector<Record> all_records;
-    if (memory_mapped_ && !cached_records_.empty()) {
-        all_records = cached_records_;
-    } else {
-        all_records = collect_leaf_records();
-        if (all_records.empty()) return samples;
-    }
+    // Read the leaves in place instead of copying the table
+    LeafView all_records = leaf_view();
+    if (all_records.empty()) return samples;
     
     int target_count = static_cast<int>(all_records.size() * sample_percent / 100.0);
     if (target_count == 0) return samples;
@@ -1819,34 +3617,856 @@ std::vector<Record> CustomBPlusDB::signal_based_clt_sample(double sample_percent
 
 std::vector<Record> CustomBPlusDB::get_records_by_indices(const std::vector<size_t>& indices) {
     std::vector<Record> result;
-    result.reserve(indices.size());
+    size_t total = root == INVALID_NODE ? 0 : nodes_[root].subtree_record_count;
+    if (total == 0) return result;
+    
+    // Resolve in rank order, then hand rows back in the caller's order;
+    // out-of-range indices are dropped
+    std::vector<size_t> order;
+    order.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] < total) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return indices[a] < indices[b]; });
     
-    // Get all records efficiently once
-    auto all_records = collect_leaf_records();
-    if (all_records.empty()) return result;
+    std::vector<size_t> ranks;
+    ranks.reserve(order.size());
+    for (size_t i : order) ranks.push_back(indices[i]);
     
-    // Convert indices to records
-    for (size_t index : indices) {
-        if (index < all_records.size()) {
-            result.push_back(all_records[index]);
-        }
+    std::vector<Record> by_rank;
+    by_rank.reserve(ranks.size());
+    collect_ranks(root, 0, ranks.data(), ranks.data() + ranks.size(), by_rank);
+    
+    std::vector<size_t> slot(indices.size(), SIZE_MAX);
+    for (size_t k = 0; k < order.size(); ++k) slot[order[k]] = k;
+    result.reserve(by_rank.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (slot[i] != SIZE_MAX) result.push_back(by_rank[slot[i]]);
+    }
+    return result;
+}
+
+bool CustomBPlusDB::get_record_at_rank(size_t rank, Record& out) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    if (root == INVALID_NODE || rank >= nodes_[root].subtree_record_count) return false;
+    
+    const BPlusTreeNode* node = &nodes_[root];
+    while (!node->is_leaf) {
+        // Each step is validated against splits; counts from concurrent
+        // non-splitting inserts may lead by a few rows, which record_at() absorbs
+        std::pair<NodeId, size_t> step = NodeLatch::optimistic_read(node->version, [&] {
+            size_t remaining = rank;
+            int i = 0;
+            while (i < node->key_count && remaining >= nodes_[node->children[i]].subtree_record_count) {
+                remaining -= nodes_[node->children[i]].subtree_record_count;
+                i++;
+            }
+            return std::make_pair(node->children[i], remaining);
+        });
+        node = &nodes_[step.first];
+        rank = step.second;
     }
+    out = node->record_at(static_cast<int>(std::min<size_t>(rank, BPlusTreeNode::MAX_KEYS - 1)));
+    return true;
+}
+
+std::vector<Record> CustomBPlusDB::get_records_at_ranks(const std::vector<size_t>& sorted_ranks) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    std::vector<Record> result;
+    if (root == INVALID_NODE) return result;
     
+    // Ranks past the end are dropped
+    const size_t* first = sorted_ranks.data();
+    const size_t* last = std::lower_bound(first, first + sorted_ranks.size(), nodes_[root].subtree_record_count);
+    result.reserve(last - first);
+    collect_ranks(root, 0, first, last, result);
     return result;
 }
 
+void CustomBPlusDB::collect_ranks(NodeId node_id, size_t base, const size_t* first, const size_t* last,
+                                  std::vector<Record>& out) const {
+    const BPlusTreeNode& node = nodes_[node_id];
+    if (node.is_leaf) {
+        for (; first != last; ++first) {
+            size_t slot = std::min<size_t>(*first - base, BPlusTreeNode::MAX_KEYS - 1);
+            out.push_back(node.record_at(static_cast<int>(slot)));
+        }
+        return;
+    }
+    
+    // Copy the child list under validation so a concurrent split can't mix
+    // old and new children; the copy stays usable after the split finishes
+    std::array<NodeId, BPlusTreeNode::MAX_KEYS + 1> children;
+    int child_count = NodeLatch::optimistic_read(node.version, [&] {
+        int count = node.key_count + 1;
+        std::copy(node.children.begin(), node.children.begin() + count, children.begin());
+        return count;
+    });
+    
+    // Hand each child the run of ranks that falls inside its subtree
+    for (int i = 0; i < child_count && first != last; i++) {
+        size_t end = base + nodes_[children[i]].subtree_record_count;
+        if (i == child_count - 1) end = SIZE_MAX;  // Rows added since the parent's count was read
+        const size_t* split = std::lower_bound(first, last, end);
+        if (split != first) {
+            collect_ranks(children[i], base, first, split, out);
+        }
+        first = split;
+        base = end;
+    }
+}
+
+std::vector<Record> CustomBPlusDB::search_range(int64_t start_id, int64_t end_id) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    std::vector<Record> rows;
+    if (start_id > end_id) return rows;
+    
+    size_t leaf_start = 0;
+    stream_range(leaf_for_key(start_id), INVALID_NODE, start_id, end_id,
+                 [&](const BPlusTreeNode& leaf, int first, int last) {
+                     rows.resize(leaf_start);
+                     for (int i = first; i < last; i++) {
+                         rows.emplace_back(leaf.keys[i], leaf.amounts[i], leaf.regions[i],
+                                           leaf.product_ids[i], leaf.timestamps[i]);
+                     }
+                 },
+                 [&] { leaf_start = rows.size(); });
+    rows.resize(leaf_start);
+    return rows;
+}
+
+bool CustomBPlusDB::aggregate_range(const std::string& column, int64_t start_id, int64_t end_id,
+                                    int num_threads, ColumnAggregate& out) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    ColumnKernel kernel;
+    if (!schema_.resolve(column, kernel)) return false;
+    out = ColumnAggregate();
+    if (start_id > end_id) return true;
+    
+    if (kernel.slot == ColumnSlot::Amount && kernel.type == ColumnType::Double) {
+        aggregate_id_range(root, start_id, end_id, std::numeric_limits<int64_t>::min(),
+                           std::numeric_limits<int64_t>::max(), out);
+        return true;
+    }
+    
+    auto partitions = range_partitions(start_id, end_id, num_threads);
+    std::vector<ColumnAggregate> results(partitions.size());
+    auto run = [&](size_t p) {
+        ColumnAggregate leaf_part;
+        stream_range(partitions[p].first, partitions[p].second, start_id, end_id,
+                     [&](const BPlusTreeNode& leaf, int first, int last) {
+                         leaf_part = ColumnAggregate();
+                         kernel.leaf_aggregate(leaf, first, last, leaf_part);
+                     },
+                     [&] { results[p].merge(leaf_part); });
+    };
+    if (partitions.size() == 1) {
+        run(0);
+    } else {
+        std::vector<std::future<void>> futures;
+        for (size_t p = 0; p < partitions.size(); p++) {
+            futures.push_back(std::async(std::launch::async, run, p));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    }
+    for (const ColumnAggregate& result : results) out.merge(result);
+    return true;
+}
+
+void CustomBPlusDB::scan_range(int64_t start_id, int64_t end_id, const std::function<void(const LeafSpan&)>& visit,
+                               int num_threads) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::unique_lock<std::shared_mutex> smo(smo_mutex_);  // Spans point at live leaves
+    if (start_id > end_id) return;
+    
+    // With writers paused the leaves are stable, so each run's first position
+    // is the in-range row count of the runs before it
+    auto partitions = range_partitions(start_id, end_id, num_threads);
+    std::vector<size_t> offsets(partitions.size(), 0);
+    for (size_t p = 0; p + 1 < partitions.size(); p++) {
+        size_t rows = 0;
+        stream_range(partitions[p].first, partitions[p].second, start_id, end_id,
+                     [&](const BPlusTreeNode&, int first, int last) { rows += last - first; }, [] {});
+        offsets[p + 1] = offsets[p] + rows;
+    }
+    
+    auto run = [&](size_t p) {
+        LeafSpan span{};
+        size_t position = offsets[p];
+        stream_range(partitions[p].first, partitions[p].second, start_id, end_id,
+                     [&](const BPlusTreeNode& leaf, int first, int last) {
+                         span = {leaf.keys.data() + first, leaf.amounts.data() + first, leaf.regions.data() + first,
+                                 leaf.product_ids.data() + first, leaf.timestamps.data() + first,
+                                 static_cast<size_t>(last - first), position};
+                     },
+                     [&] {
+                         visit(span);
+                         position += span.size;
+                     });
+    };
+    if (partitions.size() == 1) {
+        run(0);
+    } else {
+        std::vector<std::future<void>> futures;
+        for (size_t p = 0; p < partitions.size(); p++) {
+            futures.push_back(std::async(std::launch::async, run, p));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    }
+}
+
+void CustomBPlusDB::stream_range(NodeId leaf_id, NodeId stop_leaf, int64_t start_id, int64_t end_id,
+                                 const std::function<void(const BPlusTreeNode&, int, int)>& read,
+                                 const std::function<void()>& accept) const {
+    while (leaf_id != INVALID_NODE && leaf_id != stop_leaf) {
+        const BPlusTreeNode& leaf = nodes_[leaf_id];
+        NodeId next;
+        bool past_end;
+        for (;;) {
+            uint64_t seen = NodeLatch::read_begin(leaf.version);
+            int count = std::min(leaf.key_count, BPlusTreeNode::MAX_KEYS);
+            const int64_t* keys = leaf.keys.data();
+            int first = std::lower_bound(keys, keys + count, start_id) - keys;
+            int last = std::upper_bound(keys + first, keys + count, end_id) - keys;
+            if (first < last) read(leaf, first, last);
+            next = leaf.next_leaf;
+            past_end = last < count;  // Every later leaf starts even further right
+            if (NodeLatch::read_validate(leaf.version, seen)) {
+                if (first < last) accept();
+                break;
+            }
+        }
+        if (past_end) return;
+        leaf_id = next;
+    }
+}
+
+std::vector<std::pair<NodeId, NodeId>> CustomBPlusDB::range_partitions(int64_t start_id, int64_t end_id,
+                                                                       int num_threads) const {
+    if (num_threads <= 1) return {{leaf_for_key(start_id), INVALID_NODE}};
+    
+    // The internal levels name the range's leaves without reading them. Each
+    // run streams the chain up to the next run's first leaf, so rows that a
+    // concurrent split moves into a new leaf are still visited exactly once.
+    std::vector<NodeId> leaves;
+    collect_range_leaves(root, start_id, end_id, std::numeric_limits<int64_t>::min(),
+                         std::numeric_limits<int64_t>::max(), leaves);
+    if (leaves.size() <= 1) return {{leaf_for_key(start_id), INVALID_NODE}};
+    size_t runs = std::min<size_t>(num_threads, leaves.size());
+    std::vector<std::pair<NodeId, NodeId>> partitions;
+    for (size_t r = 0; r < runs; r++) {
+        size_t begin = leaves.size() * r / runs;
+        size_t end = leaves.size() * (r + 1) / runs;
+        partitions.emplace_back(leaves[begin], r + 1 < runs ? leaves[end] : INVALID_NODE);
+    }
+    return partitions;
+}
+
+void CustomBPlusDB::collect_range_leaves(NodeId node_id, int64_t start_id, int64_t end_id,
+                                         int64_t low, int64_t high, std::vector<NodeId>& out) const {
+    const BPlusTreeNode& node = nodes_[node_id];
+    if (node.is_leaf) {
+        out.push_back(node_id);
+        return;
+    }
+    
+    // Same bounds as aggregate_id_range(): child i holds ids in [separator i - 1, separator i]
+    std::array<NodeId, BPlusTreeNode::MAX_KEYS + 1> children;
+    std::array<int64_t, BPlusTreeNode::MAX_KEYS> separators;
+    int child_count = NodeLatch::optimistic_read(node.version, [&] {
+        int count = std::min(node.key_count, BPlusTreeNode::MAX_KEYS - 1);
+        std::copy(node.keys.begin(), node.keys.begin() + count, separators.begin());
+        std::copy(node.children.begin(), node.children.begin() + count + 1, children.begin());
+        return count + 1;
+    });
+    for (int i = 0; i < child_count; i++) {
+        int64_t child_low = i == 0 ? low : separators[i - 1];
+        int64_t child_high = i == child_count - 1 ? high : separators[i];
+        if (child_high < start_id || child_low > end_id) continue;
+        collect_range_leaves(children[i], start_id, end_id, child_low, child_high, out);
+    }
+}
+
+bool CustomBPlusDB::find_record(int64_t id, Record& out) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    std::vector<Record> found;
+    fetch_by_ids({id}, nullptr, 0, 0, found);
+    if (found.empty()) return false;
+    out = found[0];
+    return true;
+}
+
+NodeId CustomBPlusDB::leaf_for_key(int64_t id) const {
+    // lower_bound descent: rows equal to a separator may sit at the end of the
+    // left child, and callers walk right from there
+    NodeId node_id = root;
+    while (!nodes_[node_id].is_leaf) {
+        const BPlusTreeNode& node = nodes_[node_id];
+        node_id = NodeLatch::optimistic_read(node.version, [&] {
+            int count = std::min(node.key_count, BPlusTreeNode::MAX_KEYS - 1);
+            int i = std::lower_bound(node.keys.begin(), node.keys.begin() + count, id) - node.keys.begin();
+            return node.children[i];
+        });
+    }
+    return node_id;
+}
+
+void CustomBPlusDB::fetch_by_ids(const std::vector<int64_t>& sorted_ids, const SecondaryIndex* filter,
+                                 int64_t lo, int64_t hi, std::vector<Record>& out) const {
+    size_t next = 0;
+    while (next < sorted_ids.size()) {
+        NodeId leaf_id = leaf_for_key(sorted_ids[next]);
+        
+        // Walk right while the wanted ids are in the next leaf; a long gap descends again
+        for (;;) {
+            const BPlusTreeNode& leaf = nodes_[leaf_id];
+            size_t start = out.size();
+            size_t consumed;
+            NodeId following;
+            for (;;) {
+                uint64_t seen = NodeLatch::read_begin(leaf.version);
+                int count = std::min(leaf.key_count, BPlusTreeNode::MAX_KEYS);
+                const int64_t* keys = leaf.keys.data();
+                size_t i = next;
+                int slot = 0;
+                while (i < sorted_ids.size() && slot < count) {
+                    if (keys[slot] < sorted_ids[i]) {
+                        slot = std::lower_bound(keys + slot, keys + count, sorted_ids[i]) - keys;
+                    } else if (keys[slot] == sorted_ids[i]) {
+                        Record record(keys[slot], leaf.amounts[slot], leaf.regions[slot],
+                                      leaf.product_ids[slot], leaf.timestamps[slot]);
+                        int64_t value = filter ? filter->value_of(record) : 0;
+                        if (!filter || (value >= lo && value <= hi)) out.push_back(record);
+                        slot++;  // Duplicate ids may follow
+                    } else {
+                        i++;  // No more rows with this id
+                    }
+                }
+                following = leaf.next_leaf;
+                consumed = i;
+                if (NodeLatch::read_validate(leaf.version, seen)) break;
+                out.resize(start);
+            }
+            bool progressed = consumed > next;
+            next = consumed;
+            if (next == sorted_ids.size()) break;
+            if (following == INVALID_NODE) return;  // The remaining ids are past the last row
+            
+            // Step right if the next id is within the following leaf (or this
+            // leaf consumed no ids, which guarantees progress); otherwise descend
+            const BPlusTreeNode& right = nodes_[following];
+            int64_t right_last = NodeLatch::optimistic_read(right.version, [&] {
+                int count = std::min(right.key_count, BPlusTreeNode::MAX_KEYS);
+                return count > 0 ? right.keys[count - 1] : sorted_ids[next];
+            });
+            if (progressed && sorted_ids[next] > right_last) break;
+            leaf_id = following;
+        }
+    }
+}
+
+bool CustomBPlusDB::create_index(const std::string& column) {
+    // Exclusive: no insert may slip between the scan and the index going live
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    ColumnKernel kernel;
+    if (!schema_.resolve_filter(column, kernel)) return false;
+    
+    {
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        if (find_index(column)) return true;
+        
+        std::vector<SecondaryIndex::Posting> postings;
+        postings.reserve(total_records.load());
+        LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+        for (const BPlusTreeNode* leaf = first_leaf(); leaf; leaf = node_ptr(leaf->next_leaf)) {
+            for (int i = 0; i < leaf->key_count; i++) {
+                postings.push_back({kernel.integer(leaf->record_at(i)), leaf->keys[i]});
+            }
+            prefetcher.advance();
+        }
+        indexes_.push_back(std::make_unique<SecondaryIndex>(column, kernel));
+        indexes_.back()->assign(std::move(postings));
+    }
+    return commit_log(log_write(WriteAheadLog::FrameType::CreateIndex, column.data(), column.size()));
+}
+
+bool CustomBPlusDB::drop_index(const std::string& column) {
+    // Exclusive like create_index(), so a checkpoint sees the drop with its frame
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    {
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                               [&](const std::unique_ptr<SecondaryIndex>& index) { return index->column() == column; });
+        if (it == indexes_.end()) return false;
+        indexes_.erase(it);
+    }
+    return commit_log(log_write(WriteAheadLog::FrameType::DropIndex, column.data(), column.size()));
+}
+
+std::vector<std::string> CustomBPlusDB::get_indexed_columns() const {
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    std::vector<std::string> columns;
+    for (const auto& index : indexes_) columns.push_back(index->column());
+    return columns;
+}
+
+bool CustomBPlusDB::dictionary_code(const std::string& column, const std::string& value, int32_t& code) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return schema_.dictionary_code(column, value, code);
+}
+
+const SecondaryIndex* CustomBPlusDB::find_index(const std::string& column) const {
+    for (const auto& index : indexes_) {
+        if (index->column() == column) return index.get();
+    }
+    return nullptr;
+}
+
+void CustomBPlusDB::index_insert(const Record& record) {
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    for (auto& index : indexes_) index->add(record);
+}
+
+void CustomBPlusDB::index_remove(const std::vector<Record>& records) {
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    for (auto& index : indexes_) {
+        for (const Record& record : records) index->remove(record);
+    }
+}
+
+void CustomBPlusDB::index_update(const std::vector<std::pair<Record, Record>>& changes) {
+    // Only schemas that put an integer column in the amount slot see a change
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    for (auto& index : indexes_) {
+        for (const auto& change : changes) {
+            if (index->value_of(change.first) == index->value_of(change.second)) continue;
+            index->remove(change.first);
+            index->add(change.second);
+        }
+    }
+}
+
+void CustomBPlusDB::rebuild_indexes(const Record* records, size_t count) {
+    std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+    for (auto& index : indexes_) {
+        std::vector<SecondaryIndex::Posting> postings(count);
+        for (size_t i = 0; i < count; i++) postings[i] = {index->value_of(records[i]), records[i].id};
+        index->assign(std::move(postings));
+    }
+}
+
+void CustomBPlusDB::drop_indexes() {
+    std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+    indexes_.clear();
+}
+
+bool CustomBPlusDB::matching_ids(const std::string& filter_column, int64_t lo, int64_t hi,
+                                 std::vector<int64_t>& ids, const SecondaryIndex*& index) const {
+    index = find_index(filter_column);
+    if (!index) return false;
+    ids = index->ids(lo, hi);
+    return true;
+}
+
+size_t CustomBPlusDB::scan_where(const ColumnKernel& filter, int64_t lo, int64_t hi, std::vector<Record>* out) const {
+    if (lo > hi) return 0;
+    size_t matches = 0;
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (NodeId id = first_leaf_id(); id != INVALID_NODE;) {
+        const BPlusTreeNode& leaf = nodes_[id];
+        size_t start = out ? out->size() : 0;
+        NodeId next;
+        for (;;) {
+            uint64_t seen = NodeLatch::read_begin(leaf.version);
+            int count = std::min(leaf.key_count, BPlusTreeNode::MAX_KEYS);
+            int64_t zone_min = lo, zone_max = hi;
+            if (count > 0 && filter.zone) filter.zone(leaf, zone_min, zone_max);
+            bool skip = count == 0 || zone_max < lo || zone_min > hi;
+            bool whole = !skip && filter.zone && zone_min >= lo && zone_max <= hi;
+            
+            size_t leaf_matches = 0;
+            if (whole && !out) {
+                leaf_matches = count;  // Counting a covered leaf reads only its zone map
+            } else if (!skip) {
+                for (int i = 0; i < count; i++) {
+                    Record record(leaf.keys[i], leaf.amounts[i], leaf.regions[i], leaf.product_ids[i], leaf.timestamps[i]);
+                    int64_t value = whole ? 0 : filter.integer(record);
+                    if (whole || (value >= lo && value <= hi)) {
+                        leaf_matches++;
+                        if (out) out->push_back(record);
+                    }
+                }
+            }
+            next = leaf.next_leaf;
+            if (NodeLatch::read_validate(leaf.version, seen)) {
+                matches += leaf_matches;
+                break;
+            }
+            if (out) out->resize(start);
+        }
+        id = next;
+        prefetcher.advance();
+    }
+    return matches;
+}
+
+bool CustomBPlusDB::count_where(const std::string& filter_column, int64_t lo, int64_t hi, size_t& out) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    if (const SecondaryIndex* index = find_index(filter_column)) {
+        out = index->count(lo, hi);
+        return true;
+    }
+    ColumnKernel filter;
+    if (!schema_.resolve_filter(filter_column, filter)) return false;
+    out = scan_where(filter, lo, hi, nullptr);
+    return true;
+}
+
+bool CustomBPlusDB::records_where(const std::string& filter_column, int64_t lo, int64_t hi,
+                                  std::vector<Record>& out) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    std::vector<int64_t> ids;
+    const SecondaryIndex* index;
+    out.clear();
+    if (!matching_ids(filter_column, lo, hi, ids, index)) {
+        ColumnKernel filter;
+        if (!schema_.resolve_filter(filter_column, filter)) return false;
+        scan_where(filter, lo, hi, &out);
+        return true;
+    }
+    fetch_by_ids(ids, index, lo, hi, out);
+    return true;
+}
+
+bool CustomBPlusDB::sum_column_where(const std::string& column, const std::string& filter_column,
+                                     int64_t lo, int64_t hi, double& out) const {
+    std::vector<Record> rows;
+    ColumnKernel kernel;
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        if (!schema_.resolve(column, kernel)) return false;
+    }
+    if (!records_where(filter_column, lo, hi, rows)) return false;
+    
+    double sum = 0.0;
+    for (const Record& record : rows) sum += kernel.value(record);
+    out = sum;
+    return true;
+}
+
+bool CustomBPlusDB::sample_where(const std::string& filter_column, int64_t lo, int64_t hi,
+                                 double sample_percent, std::vector<Record>& out,
+                                 size_t* population, size_t* drawn) const {
+    if (sample_percent <= 0.0 || sample_percent > 100.0) return false;
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    std::vector<int64_t> ids;
+    const SecondaryIndex* index;
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    out.clear();
+    if (!matching_ids(filter_column, lo, hi, ids, index)) {
+        ColumnKernel filter;
+        if (!schema_.resolve_filter(filter_column, filter)) return false;
+        std::vector<Record> rows;
+        scan_where(filter, lo, hi, &rows);
+        size_t target = static_cast<size_t>(std::llround(rows.size() * sample_percent / 100.0));
+        std::sample(rows.begin(), rows.end(), std::back_inserter(out), target, gen);
+        if (population) *population = rows.size();
+        if (drawn) *drawn = target;
+        return true;
+    }
+    
+    // Selection sampling keeps the chosen ids in order for fetch_by_ids()
+    size_t target = static_cast<size_t>(std::llround(ids.size() * sample_percent / 100.0));
+    std::vector<int64_t> chosen;
+    chosen.reserve(target);
+    std::sample(ids.begin(), ids.end(), std::back_inserter(chosen), target, gen);
+    
+    fetch_by_ids(chosen, index, lo, hi, out);
+    if (population) *population = ids.size();
+    if (drawn) *drawn = target;
+    return true;
+}
+
+bool CustomBPlusDB::sum_column_where_sample(const std::string& column, const std::string& filter_column,
+                                            int64_t lo, int64_t hi, double sample_percent, double& out) const {
+    ColumnKernel kernel;
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        if (!schema_.resolve(column, kernel)) return false;
+    }
+    std::vector<Record> sample;
+    size_t matches = 0, drawn = 0;
+    if (!sample_where(filter_column, lo, hi, sample_percent, sample, &matches, &drawn)) return false;
+    
+    // Scale by the fraction actually drawn rather than the requested percentage;
+    // a chosen id whose row no longer matches counts as a zero
+    double sum = 0.0;
+    for (const Record& record : sample) sum += kernel.value(record);
+    out = drawn > 0 ? sum * matches / drawn : 0.0;
+    return true;
+}
+
+bool CustomBPlusDB::analyze_strata(const std::string& strata_column, const std::string& column) {
+    {
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        ColumnKernel filter, kernel;
+        if (!schema_.resolve_filter(strata_column, filter) || !schema_.resolve(column, kernel)) return false;
+    }
+    // Strata are sampled through the index
+    if (!create_index(strata_column)) return false;
+    
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    ColumnKernel filter, kernel;
+    if (!schema_.resolve_filter(strata_column, filter) || !schema_.resolve(column, kernel)) return false;
+    
+    std::map<int64_t, ColumnAggregate> strata;
+    std::vector<int64_t> keys(BPlusTreeNode::MAX_KEYS);  // Stratum and value of each row of one leaf
+    std::vector<double> values(BPlusTreeNode::MAX_KEYS);
+    LeafPrefetcher prefetcher(nodes_, first_leaf_id(), prefetch_distance_);
+    for (const BPlusTreeNode* leaf = first_leaf(); leaf;) {
+        int count = 0;
+        NodeId next = NodeLatch::optimistic_read(leaf->version, [&] {
+            count = std::max(0, std::min(leaf->key_count, BPlusTreeNode::MAX_KEYS));
+            filter.leaf_integers(*leaf, 0, count, keys.data());
+            kernel.leaf_values(*leaf, 0, count, values.data());
+            return leaf->next_leaf;
+        });
+        for (int i = 0; i < count; i++) strata[keys[i]].add(values[i]);
+        leaf = node_ptr(next);
+        prefetcher.advance();
+    }
+    
+    std::vector<StratumStats> stats;
+    for (const auto& stratum : strata) stats.push_back(StratumStats{stratum.first, stratum.second});
+    std::lock_guard<std::mutex> strata_lock(strata_mutex_);
+    strata_stats_[{strata_column, column}] = std::move(stats);
+    return true;
+}
+
+std::unique_ptr<OnlineAggregation> CustomBPlusDB::start_online_aggregation(
+    const std::string& column, double min_value, double max_value, double confidence_level, unsigned int seed) const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    ColumnKernel kernel;
+    if (!schema_.resolve(column, kernel)) return nullptr;
+    return std::make_unique<OnlineAggregation>(*this, tree_generation_, leaf_view(), kernel,
+                                               min_value, max_value, confidence_level, seed);
+}
+
+std::vector<StratumStats> CustomBPlusDB::strata_statistics(const std::string& strata_column,
+                                                           const std::string& column) const {
+    std::lock_guard<std::mutex> strata_lock(strata_mutex_);
+    auto it = strata_stats_.find({strata_column, column});
+    return it != strata_stats_.end() ? it->second : std::vector<StratumStats>();
+}
+
+bool CustomBPlusDB::stratified_estimate(const std::string& column, const std::string& strata_column,
+                                        size_t sample_size, StratifiedEstimate& out,
+                                        double confidence_level) const {
+    std::map<int64_t, ColumnAggregate> stats;
+    {
+        std::lock_guard<std::mutex> strata_lock(strata_mutex_);
+        auto it = strata_stats_.find({strata_column, column});
+        if (it == strata_stats_.end()) return false;
+        for (const StratumStats& stratum : it->second) stats[stratum.value] = stratum.aggregate;
+    }
+    
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    std::shared_lock<std::shared_mutex> smo(smo_mutex_);
+    ColumnKernel kernel;
+    const SecondaryIndex* index = find_index(strata_column);
+    if (!index || !schema_.resolve(column, kernel)) return false;
+    
+    struct Stratum {
+        int64_t value;
+        size_t rows;
+        double sigma;
+        size_t take = 0;
+        bool fixed = false;
+    };
+    std::vector<Stratum> strata;
+    size_t population = 0;
+    double known_rows = 0.0, known_sigma = 0.0;
+    for (const auto& entry : index->value_counts()) {
+        auto known = stats.find(entry.first);
+        double sigma = known != stats.end() ? std::sqrt(known->second.variance()) : -1.0;
+        if (sigma >= 0.0) {
+            known_rows += entry.second;
+            known_sigma += entry.second * sigma;
+        }
+        strata.push_back(Stratum{entry.first, entry.second, sigma});
+        population += entry.second;
+    }
+    // Strata that appeared since the analyze get the row-weighted mean spread
+    for (Stratum& stratum : strata) {
+        if (stratum.sigma < 0.0) stratum.sigma = known_rows > 0.0 ? known_sigma / known_rows : 1.0;
+    }
+    
+    // Neyman allocation. A stratum whose share reaches its size is read in
+    // full and the rest of the budget is shared out again; every stratum gets
+    // at least two rows (or all it has) so its mean and variance exist.
+    size_t budget = std::min(sample_size, population);
+    for (bool changed = true; changed;) {
+        changed = false;
+        double weight = 0.0, rows = 0.0;
+        size_t remaining = budget;
+        for (const Stratum& stratum : strata) {
+            if (stratum.fixed) {
+                remaining -= std::min(remaining, stratum.take);
+            } else {
+                weight += stratum.rows * stratum.sigma;
+                rows += stratum.rows;
+            }
+        }
+        for (Stratum& stratum : strata) {
+            if (stratum.fixed) continue;
+            // Proportional allocation when every open stratum is constant
+            double share = weight > 0.0 ? remaining * stratum.rows * stratum.sigma / weight
+                                        : remaining * stratum.rows / rows;
+            stratum.take = std::max<size_t>(std::min<size_t>(stratum.rows, 2), static_cast<size_t>(std::llround(share)));
+            if (stratum.take >= stratum.rows) {
+                stratum.take = stratum.rows;
+                stratum.fixed = true;
+                changed = true;
+            }
+        }
+    }
+    
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    double sum = 0.0, variance = 0.0;
+    size_t sampled = 0;
+    std::vector<Record> rows;
+    for (const Stratum& stratum : strata) {
+        std::vector<int64_t> ids = index->ids_at(stratum.value, sample_ranks(stratum.rows, stratum.take, gen));
+        rows.clear();
+        fetch_by_ids(ids, index, stratum.value, stratum.value, rows);
+        
+        ColumnAggregate drawn;
+        for (const Record& record : rows) drawn.add(kernel.value(record));
+        sampled += drawn.count;
+        if (drawn.count == 0) {
+            // Every chosen row went away meanwhile; fall back to the statistics
+            auto known = stats.find(stratum.value);
+            if (known != stats.end()) sum += stratum.rows * known->second.mean();
+            continue;
+        }
+        double n = static_cast<double>(drawn.count);
+        double s2 = drawn.count > 1 ? drawn.variance() * n / (n - 1.0) : stratum.sigma * stratum.sigma;
+        double fpc = std::max(0.0, 1.0 - n / stratum.rows);
+        sum += stratum.rows * drawn.mean();
+        variance += static_cast<double>(stratum.rows) * stratum.rows * fpc * s2 / n;
+    }
+    
+    double z_score = (confidence_level >= 0.99) ? 2.576 :
+                     (confidence_level >= 0.95) ? 1.96 : 1.645;
+    out = StratifiedEstimate();
+    out.sum = sum;
+    out.sum_margin = z_score * std::sqrt(variance);
+    out.mean = population > 0 ? sum / population : 0.0;
+    out.mean_margin = population > 0 ? out.sum_margin / population : 0.0;
+    out.population = population;
+    out.sampled = sampled;
+    out.strata = strata.size();
+    return true;
+}
+
+bool CustomBPlusDB::build_synopses(const std::vector<double>& sample_percents) {
+    if (sample_percents.empty()) return false;
+    for (double percent : sample_percents) {
+        if (!(percent > 0.0 && percent <= 100.0)) return false;
+    }
+    
+    // Exclusive: every rung is drawn from the same rows, with no insert between
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    synopses_ = std::make_unique<SynopsisLadder>(sample_percents);
+    for (size_t rung = 0; rung < synopses_->rung_count(); rung++) draw_synopsis(rung);
+    return commit_log(log_write(WriteAheadLog::FrameType::Synopses, sample_percents.data(),
+                                sample_percents.size() * sizeof(double)));
+}
+
+void CustomBPlusDB::drop_synopses() {
+    std::unique_lock<std::shared_mutex> lock(db_mutex);
+    if (!synopses_) return;
+    synopses_.reset();
+    commit_log(log_write(WriteAheadLog::FrameType::Synopses, "", 0));
+}
+
+std::vector<double> CustomBPlusDB::synopsis_percents() const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return synopses_ ? synopses_->sample_percents() : std::vector<double>();
+}
+
+size_t CustomBPlusDB::synopsis_bytes() const {
+    std::shared_lock<std::shared_mutex> lock(db_mutex);
+    return synopses_ ? synopses_->memory_bytes() : 0;
+}
+
+void CustomBPlusDB::draw_synopsis(size_t rung) {
+    // Writers are excluded, so the root's counts are exact and the rows are
+    // those of the snapshot opened here; it only names the draw, so it is
+    // closed again at once
+    uint64_t snapshot_id = leaf_versions_.open_snapshot();
+    size_t population = total_records.load();
+    std::mt19937 gen(std::random_device{}());
+    std::vector<size_t> ranks = sample_ranks(population, synopses_->draw_size(rung, population), gen);
+    std::vector<Record> rows;
+    rows.reserve(ranks.size());
+    if (!ranks.empty()) collect_ranks(root, 0, ranks.data(), ranks.data() + ranks.size(), rows);
+    leaf_versions_.close_snapshot(snapshot_id);
+    synopses_->assign(rung, rows, population, snapshot_id);
+}
+
+bool CustomBPlusDB::synopsis_estimate(size_t rung, const std::string& column, double min_value, double max_value,
+                                      SynopsisEstimate& out, double confidence_level) {
+    double z_score = (confidence_level >= 0.99) ? 2.576 :
+                     (confidence_level >= 0.95) ? 1.96 : 1.645;
+    
+    // A stale rung is redrawn under the exclusive lock and read again. Writes
+    // that make it stale once more in between get one more redraw, then false.
+    for (int attempt = 0; attempt < 3; attempt++) {
+        if (attempt > 0) {
+            std::unique_lock<std::shared_mutex> lock(db_mutex);
+            if (synopses_ && rung < synopses_->rung_count() && synopses_->stale(rung)) draw_synopsis(rung);
+        }
+        std::shared_lock<std::shared_mutex> lock(db_mutex);
+        ColumnKernel kernel;
+        if (!synopses_ || rung >= synopses_->rung_count() || !schema_.resolve(column, kernel)) return false;
+        if (synopses_->estimate(rung, kernel, min_value, max_value, z_score, out)) return true;
+    }
+    return false;
+}
+
+
 std::vector<Record> CustomBPlusDB::random_start_memory_stride_sample(double sample_percent, size_t stride_bytes) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
     
     // **YOUR OPTIMIZATION 1: RANDOM STARTING POINT**
     // Instead of always starting at index 0, randomize the starting position
     
     // Use pre-cached records for O(1) access (mmap optimization)
-    if (memory_mapped_ && !cached_records_.empty()) {
-        int target_count = static_cast<int>(cached_records_.size() * sample_percent / 100.0);
+    std::shared_ptr<const std::vector<Record>> snapshot = current_snapshot();
+    if (snapshot && !snapshot->empty()) {
+        const std::vector<Record>& cached_records = *snapshot;
+        int target_count = static_cast<int>(cached_records.size() * sample_percent / 100.0);
         if (target_count == 0) return samples;
         
         samples.reserve(target_count);
@@ -1854,7 +4474,7 @@ std::vector<Record> CustomBPlusDB::random_start_memory_stride_sample(double samp
         // Calculate stride
         size_t record_stride;
         if (stride_bytes == 0) {
-            record_stride = std::max(1UL, cached_records_.size() / target_count);
+            record_stride = std::max(1UL, cached_records.size() / target_count);
         } else {
             record_stride = std::max(1UL, stride_bytes / sizeof(Record));
         }
@@ -1866,8 +4486,8 @@ std::vector<Record> CustomBPlusDB::random_start_memory_stride_sample(double samp
         size_t random_start = start_dist(gen);
         
         // **MEMORY STRIDE FROM RANDOM START**
-        for (size_t offset = random_start; samples.size() < target_count && offset < cached_records_.size(); offset += record_stride) {
-            samples.push_back(cached_records_[offset]);
+        for (size_t offset = random_start; samples.size() < target_count && offset < cached_records.size(); offset += record_stride) {
+            samples.push_back(cached_records[offset]);
         }
         
         return samples;
@@ -1881,21 +4501,25 @@ std::vector<Record> CustomBPlusDB::multithreaded_memory_stride_sample(double sam
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     std::vector<Record> samples;
     
-    if (!root) return samples;
+    if (root == INVALID_NODE) return samples;
+    
+    // The flat copy sits on whichever node built it; with leaves partitioned
+    // across nodes, read them in place from workers on their own node
+    if (nodes_.memory_policy().placement == NumaPlacement::Partition) {
+        return node_local_stride_sample(sample_percent, num_threads);
+    }
     
     // **IMPROVED APPROACH: DIVIDE MMAP INTO N REGIONS FOR N THREADS**
     // Each thread works on its own region and samples sample_percent/n within that region
     
     // Use pre-cached records for O(1) direct access
-    if (!memory_mapped_ || cached_records_.empty()) {
-        cached_records_ = collect_leaf_records();
-        memory_mapped_ = true;
-    }
+    std::shared_ptr<const std::vector<Record>> snapshot_ref = record_snapshot();
+    const std::vector<Record>& snapshot = *snapshot_ref;
     
-    if (cached_records_.empty()) return samples;
+    if (snapshot.empty()) return samples;
     
     // **DIRECT ROW COUNT ACCESS FROM MMAP**
-    size_t total_rows = cached_records_.size();
+    size_t total_rows = snapshot.size();
     
     // **EACH THREAD SAMPLES sample_percent/n IN ITS REGION**
     double per_thread_sample_percent = sample_percent / num_threads;
@@ -1940,7 +4564,7 @@ std::vector<Record> CustomBPlusDB::multithreaded_memory_stride_sample(double sam
             for (size_t offset = thread_start; 
                  offset < region_end && thread_samples.size() < target_samples; 
                  offset += stride) {
-                thread_samples.push_back(cached_records_[offset]);
+                thread_samples.push_back(snapshot[offset]);
             }
             
             return thread_samples;
@@ -1959,24 +4583,72 @@ std::vector<Record> CustomBPlusDB::multithreaded_memory_stride_sample(double sam
     return samples;
 }
 
+std::vector<Record> CustomBPlusDB::node_local_stride_sample(double sample_percent, int num_threads) const {
+    LeafView view = leaf_view();
+    std::vector<Record> samples;
+    if (view.empty()) return samples;
+    
+    // Regions are runs of leaves on one node rather than equal slices of
+    // the rows; each is strided exactly like a multithreaded_memory_stride_sample() region
+    std::vector<size_t> leaves(view.leaf_count());
+    std::iota(leaves.begin(), leaves.end(), size_t(0));
+    std::vector<NodeShare> shares = split_by_node(leaves, num_threads, [&](size_t l) { return view.leaf_node(l); });
+    double per_thread_sample_percent = sample_percent / num_threads;
+    
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::vector<std::future<std::vector<Record>>> futures;
+    for (const NodeShare& share : shares) {
+        size_t region_total = 0;
+        for (size_t l : share.items) region_total += view.leaf_size(l);
+        size_t start = std::uniform_int_distribution<size_t>(0, std::min(region_total / 10, size_t(100)))(gen);
+        
+        futures.push_back(std::async(std::launch::async, [&, region_total, start]() {
+            pin_to_share_node(share);
+            std::vector<Record> thread_samples;
+            size_t target_samples = static_cast<size_t>(region_total * per_thread_sample_percent / 100.0);
+            if (target_samples == 0) return thread_samples;
+            thread_samples.reserve(target_samples);
+            size_t stride = std::max<size_t>(1, region_total / target_samples);
+            
+            size_t slot = start;
+            for (size_t i = 0; i < share.items.size() && thread_samples.size() < target_samples; ++i) {
+                size_t l = share.items[i];
+                if (view.prefetch_distance() > 0 && i + view.prefetch_distance() < share.items.size()) {
+                    view.prefetch_leaf(share.items[i + view.prefetch_distance()]);
+                }
+                for (; slot < view.leaf_size(l) && thread_samples.size() < target_samples; slot += stride) {
+                    thread_samples.push_back(view.record(l, slot));
+                }
+                slot -= view.leaf_size(l);
+            }
+            return thread_samples;
+        }));
+    }
+    
+    for (auto& future : futures) {
+        auto thread_samples = future.get();
+        samples.insert(samples.end(), thread_samples.begin(), thread_samples.end());
+    }
+    return samples;
+}
+
 double CustomBPlusDB::fast_aggregated_memory_stride_sum(double sample_percent, int num_threads) {
     std::shared_lock<std::shared_mutex> lock(db_mutex);
     
-    if (!root) return 0.0;
+    if (root == INVALID_NODE) return 0.0;
     
     // **IMPROVED APPROACH: DIVIDE MMAP INTO N REGIONS, AGGREGATE DIRECTLY**
     // Each thread samples sample_percent/n in its region and aggregates on-the-fly
     
     // Use pre-cached records for O(1) direct access
-    if (!memory_mapped_ || cached_records_.empty()) {
-        cached_records_ = collect_leaf_records();
-        memory_mapped_ = true;
-    }
+    std::shared_ptr<const std::vector<Record>> snapshot_ref = record_snapshot();
+    const std::vector<Record>& snapshot = *snapshot_ref;
     
-    if (cached_records_.empty()) return 0.0;
+    if (snapshot.empty()) return 0.0;
     
     // **DIRECT ROW COUNT ACCESS FROM MMAP**
-    size_t total_rows = cached_records_.size();
+    size_t total_rows = snapshot.size();
     
     // **EACH THREAD SAMPLES sample_percent/n IN ITS REGION**
     double per_thread_sample_percent = sample_percent / num_threads;
@@ -2024,7 +4696,7 @@ double CustomBPlusDB::fast_aggregated_memory_stride_sum(double sample_percent, i
             for (size_t offset = thread_start; 
                  offset < region_end && thread_sample_count < target_samples; 
                  offset += stride) {
-                thread_sum += cached_records_[offset].amount;
+                thread_sum += snapshot[offset].amount;
                 thread_sample_count++;
             }
             
@@ -8,6 +8,24 @@
 #include <atomic>
 #include <cstdint>
 #include <string>
+#include <array>
+#include <map>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include "node_arena.hpp"
+#include "node_latch.hpp"
+#include "schema_catalog.hpp"
+#include "write_ahead_log.hpp"
+#include "leaf_versions.hpp"
+
+// Children per internal node of CustomBPlusDB; nodes hold AQE_BPLUS_FANOUT - 1
+// keys. Set per deployment through the AQE_BPLUS_FANOUT CMake cache variable
+// (benchmarks/bench_fanout.cpp measures the candidates). Page files only open
+// in builds with the same fanout.
+#ifndef AQE_BPLUS_FANOUT
+#define AQE_BPLUS_FANOUT 256
+#endif
 
 /**
  * Custom B+ Tree Database optimized for parallel approximate queries.
@@ -28,58 +46,342 @@ struct Record {
 
 class BPlusTreeNode {
 public:
-    static const int MAX_KEYS = 255;  // Optimized for cache lines
+    static constexpr int MAX_KEYS = AQE_BPLUS_FANOUT - 1;
+    static_assert(MAX_KEYS >= 3, "AQE_BPLUS_FANOUT must be at least 4");
+    // Below this many keys a non-root node borrows from or merges with a
+    // sibling after a delete. A quarter rather than half of capacity keeps a
+    // mix of inserts and deletes from splitting and merging the same nodes.
+    static constexpr int MIN_KEYS = MAX_KEYS / 4 > 0 ? MAX_KEYS / 4 : 1;
     
     bool is_leaf;
     int key_count;
     size_t subtree_record_count;  // Total records in this subtree
-    std::vector<int64_t> keys;
-    std::vector<Record> records;  // Only for leaf nodes
-    std::vector<std::shared_ptr<BPlusTreeNode>> children;  // Only for internal nodes
-    std::shared_ptr<BPlusTreeNode> next_leaf;  // For leaf node chaining
     
+    // Amount aggregates over the same rows, kept current alongside the count:
+    // inserts fold the new amount into every node on their path and splits
+    // recompute both halves. Min/max are +inf/-inf while the subtree is empty.
+    double subtree_sum;
+    double subtree_sum_squares;
+    double subtree_min;
+    double subtree_max;
+    NodeId next_leaf;  // For leaf node chaining
+    mutable uint64_t version;  // Optimistic latch word (see node_latch.hpp)
+    uint64_t write_epoch;      // Leaves: epoch of the last write (see leaf_versions.hpp)
+    
+    // Zone map of a leaf: min/max of each payload column over its key_count
+    // rows, so scans can skip leaves a predicate cannot match and take whole
+    // leaves it matches completely. Ids need none (keys are sorted) and rows
+    // have no nulls, so key_count is the row count. Widened by insert_record(),
+    // recomputed on split and bulk load; meaningless while key_count is 0.
+    struct Zone {
+        double amount_min, amount_max;
+        int64_t timestamp_min, timestamp_max;
+        int32_t region_min, region_max;
+        int32_t product_id_min, product_id_max;
+    };
+    Zone zone;
+    
+    std::array<int64_t, MAX_KEYS> keys;  // Record ids in leaf nodes, separators in internal nodes
+    
+    // Columnar (struct-of-arrays) leaf storage - only for leaf nodes.
+    // Ids are shared with `keys`; rows are rebuilt with record_at().
+    std::array<double, MAX_KEYS> amounts;
+    std::array<int32_t, MAX_KEYS> regions;
+    std::array<int32_t, MAX_KEYS> product_ids;
+    std::array<int64_t, MAX_KEYS> timestamps;
+    
+    std::array<NodeId, MAX_KEYS + 1> children;  // Only for internal nodes
+    
+    // Arrays are left uninitialized; only the first key_count slots are valid
     BPlusTreeNode(bool leaf = false);
     
     // Core B+ tree operations
     void insert_record(const Record& record);
-    std::vector<Record> search_range(int64_t start_id, int64_t end_id);
-    std::shared_ptr<BPlusTreeNode> split();
+    std::vector<Record> search_range(int64_t start_id, int64_t end_id) const;  // This leaf's rows in the id range
+    int64_t split_into(BPlusTreeNode& new_node, NodeId new_id);  // Returns separator key
+    void recompute_zone();  // Leaves only
+    void remove_at(int index);  // Leaves only; the caller refreshes aggregates
+    void copy_rows(const BPlusTreeNode& from, int first, int count, int at);  // Leaf columns
+    
+    // Zone-map tests for lo <= amount <= hi, valid for a non-empty leaf
+    bool zone_excludes(double lo, double hi) const { return zone.amount_max < lo || zone.amount_min > hi; }
+    bool zone_covers(double lo, double hi) const { return zone.amount_min >= lo && zone.amount_max <= hi; }
+    
+    // Prefetch hint for the header and the cache lines that hold row `slot`
+    // of each column, issued ahead of a scan reaching this leaf
+    void prefetch(int slot = 0) const {
+        __builtin_prefetch(this);
+        __builtin_prefetch(&zone);
+        __builtin_prefetch(&keys[slot]);
+        __builtin_prefetch(&amounts[slot]);
+        __builtin_prefetch(&regions[slot]);
+        __builtin_prefetch(&product_ids[slot]);
+        __builtin_prefetch(&timestamps[slot]);
+    }
+    
+    // Row reconstruction from the leaf columns. Both are version-validated
+    // reads, so they are safe while writers insert into the same leaf.
+    Record record_at(int index) const;
+    void append_records_to(std::vector<Record>& out) const;
     
     // Parallel-friendly operations
-    std::vector<Record> get_all_records() const;
-    size_t get_record_count() const;
-    void update_subtree_counts();  // Update record counts up the tree
+    std::vector<Record> get_all_records(const NodeArena<BPlusTreeNode>& nodes) const;
+    size_t get_record_count(const NodeArena<BPlusTreeNode>& nodes) const;
+    void update_subtree_counts(NodeArena<BPlusTreeNode>& nodes);  // Full recount; inserts keep counts current
+    void add_to_aggregates(double amount);  // Not subtree_record_count; caller holds the node exclusively
+    void recompute_aggregates(const NodeArena<BPlusTreeNode>& nodes);  // From the rows, or the children's aggregates
+};
+
+using BPlusTreeArena = NodeArena<BPlusTreeNode>;
+
+// COUNT, SUM, SUM of squares, MIN and MAX of one column over a set of rows.
+// A NaN value makes MIN and MAX NaN.
+struct ColumnAggregate {
+    size_t count = 0;
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    double min = std::numeric_limits<double>::infinity();   // +inf when count is 0
+    double max = -std::numeric_limits<double>::infinity();  // -inf when count is 0
     
-private:
-    std::mutex node_mutex;  // Fine-grained locking
+    void add(double value) {
+        count++;
+        sum += value;
+        sum_squares += value * value;
+        if (value < min || value != value) min = value;
+        if (value > max || value != value) max = value;
+    }
+    void merge(const ColumnAggregate& other) {
+        if (other.count == 0) return;
+        count += other.count;
+        sum += other.sum;
+        sum_squares += other.sum_squares;
+        if (other.min < min || other.min != other.min) min = other.min;
+        if (other.max > max || other.max != other.max) max = other.max;
+    }
+    
+    double mean() const { return count > 0 ? sum / count : 0.0; }
+    double variance() const {  // Population variance
+        if (count == 0) return 0.0;
+        double m = mean();
+        return std::max(0.0, sum_squares / count - m * m);
+    }
+};
+
+// Moments of a value column within one stratum - the rows sharing one value
+// of an integer or dictionary column - as gathered by analyze_strata()
+struct StratumStats {
+    int64_t value = 0;
+    ColumnAggregate aggregate;
+};
+
+// Result of stratified_estimate(): SUM and AVG of the column with the
+// half-widths of their confidence intervals
+struct StratifiedEstimate {
+    double sum = 0.0;
+    double sum_margin = 0.0;
+    double mean = 0.0;
+    double mean_margin = 0.0;
+    size_t population = 0;  // Rows in all strata
+    size_t sampled = 0;     // Rows read
+    size_t strata = 0;
 };
 
+// Result of synopsis_estimate(): SUM, COUNT and AVG over the matching rows
+// with the half-widths of their confidence intervals
+struct SynopsisEstimate {
+    double sum = 0.0;
+    double sum_margin = 0.0;
+    double count = 0.0;
+    double count_margin = 0.0;
+    double mean = 0.0;
+    double mean_margin = 0.0;
+    double sample_percent = 0.0;  // The rung's nominal rate
+    size_t sampled = 0;           // Rows in the rung
+    size_t matched = 0;           // Rung rows inside the filter
+    size_t population = 0;        // Rows in the table
+    uint64_t snapshot_id = 0;     // Snapshot the rung was drawn at; later inserts are folded in
+};
+
+// Zero-copy leaf access types, defined in leaf_cursor.hpp
+struct LeafSpan;
+class LeafView;
+
+// Compressed leaf copies, defined in leaf_codec.hpp
+class CompressedLeafSet;
+
+// Secondary index, defined in secondary_index.hpp
+class SecondaryIndex;
+
+// Progressive scan, defined in online_aggregation.hpp
+class OnlineAggregation;
+
+// Precomputed sample ladder, defined in sample_synopsis.hpp
+class SynopsisLadder;
+
 class CustomBPlusDB {
 public:
     CustomBPlusDB();
     ~CustomBPlusDB();
     
-    // Database operations
+    // Database operations. Without a schema the table has the five Record
+    // columns; a declared schema maps its columns onto the same leaf slots
+    // (see schema_catalog.hpp) and fails if they don't fit.
+    //
+    // With a path the table is durable: create_database() writes an empty
+    // page file, and every write is logged to `<db_path>.wal` and synced
+    // (group commit) before it returns. open_database() maps the page file
+    // and replays the log. Checkpoints rewrite the page file and empty the
+    // log once it outgrows both set_checkpoint_bytes() and the table, so a
+    // row is rewritten O(1) times on average; close_database() checkpoints
+    // if anything was logged. An empty path keeps the table in memory only.
     bool create_database(const std::string& db_path);
+    bool create_database(const std::string& db_path, const std::vector<ColumnDef>& schema);
     bool open_database(const std::string& db_path);
     void close_database();
+    bool checkpoint();  // False without a log or if the page file can't be written
+    void set_checkpoint_bytes(size_t bytes) { checkpoint_bytes_ = bytes; }
+    size_t wal_bytes() const;
     
-    // Record operations
+    // Record operations. Inserts return false if the log can't be synced.
     bool insert_record(const Record& record);
     bool insert_batch(const std::vector<Record>& records);
     
-    // Query operations - exact
+    // Delete, or change the amount of, the first record with the given id;
+    // false if there is none. Each costs O(log n): an under-full node borrows
+    // from or merges with a sibling, and counts, aggregates, zone maps,
+    // indexes and the row snapshot stay current. Nodes unlinked by
+    // rebalancing are left as they were for readers already headed there and
+    // reused by later splits once no reader or open snapshot can reach them.
+    bool delete_record(int64_t id);
+    bool update_amount(int64_t id, double amount);
+    size_t delete_batch(const std::vector<int64_t>& ids);  // Returns the number deleted
+    size_t update_amount_batch(const std::vector<std::pair<int64_t, double>>& updates);  // Returns the number updated
+    
+    // Schema-level row access: values in schema order, strings for dictionary columns
+    std::vector<ColumnDef> get_schema() const;
+    bool insert_row(const std::vector<ColumnValue>& values);
+    std::vector<ColumnValue> row_values(const Record& record) const;
+    
+    // Bottom-up bulk load: replaces the tree with records sorted by id.
+    // fill_factor is the target leaf/internal occupancy in (0, 1].
+    bool bulk_load(const std::vector<Record>& records, double fill_factor = 1.0, int num_threads = 1);
+    
+    // Query operations - exact. Totals come from the root's subtree
+    // aggregates in O(1); id ranges combine the aggregates of the subtrees
+    // inside the range and scan only the two boundary leaves, O(log n).
+    ColumnAggregate aggregate_amount() const;
+    ColumnAggregate aggregate_amount_by_id(int64_t start_id, int64_t end_id) const;  // start_id <= id <= end_id
     double sum_amount();
     double avg_amount();
     size_t count_records();
     double sum_amount_where(double min_amount, double max_amount);
     
-    // Query operations - parallel approximate
-    double parallel_sum_sample(double sample_percent, int num_threads = 4);
-    double parallel_avg_sample(double sample_percent, int num_threads = 4);
-    size_t parallel_count_sample(double sample_percent, int num_threads = 4);
+    // Query operations - parallel approximate. Each reads one point-in-time
+    // snapshot of the tree, so inserts that run meanwhile neither wait nor
+    // show up; snapshot_id, if given, receives the snapshot's id.
+    double parallel_sum_sample(double sample_percent, int num_threads = 4, uint64_t* snapshot_id = nullptr);
+    double parallel_avg_sample(double sample_percent, int num_threads = 4, uint64_t* snapshot_id = nullptr);
+    size_t parallel_count_sample(double sample_percent, int num_threads = 4, uint64_t* snapshot_id = nullptr);
     double parallel_sum_where_sample(double min_amount, double max_amount, 
-                                    double sample_percent, int num_threads = 4);
+                                    double sample_percent, int num_threads = 4,
+                                    uint64_t* snapshot_id = nullptr);
+    
+    // Aggregates over any numeric schema column. The name is resolved to a
+    // kernel once per call; false for unknown or dictionary columns.
+    bool sum_column(const std::string& column, double& out);
+    bool avg_column(const std::string& column, double& out);
+    bool parallel_sum_column_sample(const std::string& column, double sample_percent, int num_threads, double& out);
+    bool parallel_avg_column_sample(const std::string& column, double sample_percent, int num_threads, double& out);
+    
+    // Order-statistic access: rank r is the r-th record in id order (0-based).
+    // Each lookup descends by subtree_record_count in O(log n); a batch of
+    // ascending ranks shares the upper levels of its descents.
+    bool get_record_at_rank(size_t rank, Record& out) const;
+    std::vector<Record> get_records_at_ranks(const std::vector<size_t>& sorted_ranks) const;
+    
+    // Point lookup by id (the first record with that id)
+    bool find_record(int64_t id, Record& out) const;
+    
+    // Id-range access, start_id <= id <= end_id. One descent finds the first
+    // leaf, then the leaf chain is streamed. With num_threads > 1 the range's
+    // leaves are split into contiguous runs by leaf boundary, one per thread.
+    std::vector<Record> search_range(int64_t start_id, int64_t end_id) const;
+    // Aggregate of a numeric column; false for unknown or dictionary columns.
+    // The amount column is answered from subtree aggregates in O(log n).
+    bool aggregate_range(const std::string& column, int64_t start_id, int64_t end_id,
+                         int num_threads, ColumnAggregate& out) const;
+    // Zero-copy spans of the rows in range, first_position counting from the
+    // range's first row. Writers are paused as in scan_leaves(); with
+    // num_threads > 1, visit runs on several threads at once.
+    void scan_range(int64_t start_id, int64_t end_id, const std::function<void(const LeafSpan&)>& visit,
+                    int num_threads = 1) const;
+    
+    // Secondary indexes (see secondary_index.hpp) on integer or dictionary
+    // columns, e.g. region, product_id and timestamp. Every insert maintains
+    // them, bulk loads rebuild them and they are saved with the page file.
+    bool create_index(const std::string& column);
+    bool drop_index(const std::string& column);
+    std::vector<std::string> get_indexed_columns() const;
+    bool dictionary_code(const std::string& column, const std::string& value, int32_t& code) const;
+    
+    // Predicates lo <= filter_column <= hi on an integer or dictionary column
+    // (dictionary columns compare codes). With an index only matching rows
+    // are read from the tree; otherwise the leaves are scanned, skipping
+    // those whose zone map rules the range out. False if filter_column is
+    // unknown or a double, or `column` is not numeric.
+    bool count_where(const std::string& filter_column, int64_t lo, int64_t hi, size_t& out) const;
+    bool records_where(const std::string& filter_column, int64_t lo, int64_t hi, std::vector<Record>& out) const;
+    bool sum_column_where(const std::string& column, const std::string& filter_column,
+                          int64_t lo, int64_t hi, double& out) const;
+    // Uniform sample of sample_percent of the matching rows, and the SUM estimate from it.
+    // population and drawn, if given, receive the matches the sample was
+    // drawn from and the number drawn.
+    bool sample_where(const std::string& filter_column, int64_t lo, int64_t hi,
+                      double sample_percent, std::vector<Record>& out,
+                      size_t* population = nullptr, size_t* drawn = nullptr) const;
+    bool sum_column_where_sample(const std::string& column, const std::string& filter_column,
+                                 int64_t lo, int64_t hi, double sample_percent, double& out) const;
+    
+    // Stratified sampling of a numeric column by the values of an integer or
+    // dictionary column, e.g. amount by region. analyze_strata() scans the
+    // table once for each stratum's row count and moments of `column`, kept
+    // as statistics until the next analyze, and indexes strata_column if it
+    // is not indexed yet. stratified_estimate() then splits sample_size rows
+    // over the strata by Neyman allocation (n_h proportional to N_h * sigma_h),
+    // draws each stratum's share uniformly through the index and combines
+    // the per-stratum means. Stratum sizes are read from the index, so they
+    // are current; stale variances only make the allocation less efficient.
+    // False for unknown columns or without statistics for the pair.
+    bool analyze_strata(const std::string& strata_column, const std::string& column);
+    std::vector<StratumStats> strata_statistics(const std::string& strata_column, const std::string& column) const;
+    bool stratified_estimate(const std::string& column, const std::string& strata_column, size_t sample_size,
+                             StratifiedEstimate& out, double confidence_level = 0.95) const;
+    
+    // Online aggregation of a numeric column over the rows with
+    // min_value <= column <= max_value: leaves of one snapshot are read in
+    // random order, and each advance() refines the SUM, COUNT and AVG
+    // estimates and their intervals (see online_aggregation.hpp). The scan
+    // holds no lock between steps. Null for unknown columns.
+    std::unique_ptr<OnlineAggregation> start_online_aggregation(
+        const std::string& column,
+        double min_value = -std::numeric_limits<double>::infinity(),
+        double max_value = std::numeric_limits<double>::infinity(),
+        double confidence_level = 0.95, unsigned int seed = 0) const;
+    
+    // Precomputed sample synopses (see sample_synopsis.hpp): a ladder of
+    // uniform samples at the given rates, saved in the page file and kept
+    // uniform by inserts. build_synopses() replaces the ladder and draws
+    // every rung; false if a rate is outside (0, 100]. synopsis_estimate()
+    // answers SUM, COUNT and AVG of a numeric column over the rows with
+    // min_value <= column <= max_value from one rung (0 is the smallest),
+    // redrawing it first if writes left it stale; false for unknown columns
+    // or rungs.
+    bool build_synopses(const std::vector<double>& sample_percents = {0.01, 0.1, 1.0, 10.0});
+    void drop_synopses();
+    std::vector<double> synopsis_percents() const;  // Ascending; empty without a ladder
+    bool synopsis_estimate(size_t rung, const std::string& column, double min_value, double max_value,
+                           SynopsisEstimate& out, double confidence_level = 0.95);
+    size_t synopsis_bytes() const;
     
     // Database statistics
     size_t get_total_records() const;
@@ -98,6 +400,25 @@ public:
     std::vector<Record> dual_pointer_sample(double sample_percent);
     std::vector<Record> parallel_pointer_sample(double sample_percent, int num_threads = 4);
     std::vector<Record> random_pointer_sample(double sample_percent, unsigned int seed = 42);
+    // Keeps each row independently with probability sample_percent / 100,
+    // jumping geometric gaps along the leaf chain: leaves the next gap
+    // clears are passed over on their key_count alone, so the cost is
+    // O(sample + leaves) with no copy of the table. The sample is in id
+    // order and its size is binomial rather than fixed. A seed of 0 draws
+    // one from std::random_device.
+    std::vector<Record> bernoulli_sample(double sample_percent, unsigned int seed = 0);
+    // Exactly min(k, rows) rows drawn uniformly without replacement from one
+    // snapshot, so the cost follows k rather than the table's size. Each
+    // thread keeps a reservoir over a contiguous run of leaves (Algorithm L,
+    // jumping straight to the next row it keeps); reservoirs are merged by
+    // drawing from each in proportion to the rows it covered. population,
+    // if given, receives the snapshot's row count. Rows come in random order.
+    std::vector<Record> reservoir_sample(size_t k, int num_threads = 4, unsigned int seed = 0,
+                                         size_t* population = nullptr, uint64_t* snapshot_id = nullptr);
+    // Aggregate of a numeric column over reservoir_sample(k); scale by
+    // population / out.count for totals. False for unknown columns.
+    bool reservoir_aggregate(const std::string& column, size_t k, int num_threads,
+                             ColumnAggregate& out, size_t& population, uint64_t* snapshot_id = nullptr);
     
     // Advanced multithreaded fast/slow pointer with CLT validation
     std::vector<Record> clt_validated_dual_pointer_sample(double sample_percent, 
@@ -140,41 +461,217 @@ public:
     std::vector<Record> parallel_block_sample(double sample_percent, size_t block_size = 1000, int num_threads = 4);
     std::vector<Record> adaptive_block_sample(double sample_percent, size_t min_block_size = 500, size_t max_block_size = 2000);
     std::vector<Record> stratified_block_sample(double sample_percent, size_t block_size = 1000, int strata_count = 4);
+    // Leaf blocks drawn only from leaves whose zone map overlaps
+    // [min_amount, max_amount]; returns the matching rows of each block
+    std::vector<Record> block_sample_where(double min_amount, double max_amount, double sample_percent);
+    
+    // Zero-copy scan: visits every leaf's columns in id order under the shared lock.
+    // Writers are paused for the duration of the scan; spans must not be
+    // retained and the callback must not write to this database.
+    void scan_leaves(const std::function<void(const LeafSpan&)>& visit) const;
+    
+    // Leaf-chain walks prefetch this many leaves ahead, and block and stride
+    // samplers this many blocks or strides ahead of the one they read; 0
+    // turns prefetching off. benchmarks/bench_scan.cpp measures the effect.
+    void set_prefetch_distance(size_t distance) { prefetch_distance_ = distance; }
+    size_t prefetch_distance() const { return prefetch_distance_; }
     
-    // File I/O operations
+    // Where tree nodes are allocated (see numa_memory.hpp): 2 MiB huge pages,
+    // and pages interleaved or whole chunks partitioned across NUMA nodes.
+    // Applies to nodes allocated afterwards, so set it before loading. With
+    // Partition, parallel_block_sample() and multithreaded_memory_stride_sample()
+    // run each worker on the node holding the leaves it reads.
+    void set_memory_policy(const MemoryPolicy& policy) { nodes_.set_memory_policy(policy); }
+    MemoryPolicy memory_policy() const { return nodes_.memory_policy(); }
+    // scan_leaves() restricted to the leaves placed on one node (a
+    // NumaTopology index), or with -1 to those on no particular node
+    void scan_node_leaves(int node, const std::function<void(const LeafSpan&)>& visit) const;
+    
+    // Optional compressed leaf copies (see leaf_codec.hpp). compress_leaves()
+    // encodes every leaf that changed since the previous call and returns the
+    // encoded size in bytes. Scans and leaf-view samplers then decode the copy
+    // of any leaf whose version still matches and read raw columns otherwise.
+    size_t compress_leaves(int num_threads = 1);
+    void drop_compressed_leaves();
+    size_t compressed_leaf_bytes() const;
+    size_t raw_leaf_bytes() const;  // Column bytes covered by the current copies
+    
+    // File I/O operations.
+    // Files are written in the page format: a header page followed by the
+    // node slabs exactly as they sit in memory, then the schema. Loading maps the file and
+    // serves queries from the mapped pages without rebuilding the tree;
+    // writes after loading go to private copy-on-write pages until the next save.
+    // Under a memory policy the slabs are copied into placed memory instead.
+    // The older flat record dump is still accepted by load_from_file().
     bool save_to_file(const std::string& file_path);
     bool load_from_file(const std::string& file_path);
     
 private:
-    std::shared_ptr<BPlusTreeNode> root;
+    BPlusTreeArena nodes_;  // Slab storage for every tree node
+    std::atomic<NodeId> root;
     std::atomic<size_t> total_records;
     std::atomic<size_t> tree_height;
-    std::string db_path_;
+    std::string db_path_;  // Non-empty exactly when wal_ is set
+    std::unique_ptr<WriteAheadLog> wal_;  // Replaced only under the exclusive db_mutex
+    uint64_t checkpoint_id_;  // Of the page file wal_ continues; 0 for files written before logging
+    std::atomic<size_t> checkpoint_bytes_;
+    std::atomic<size_t> prefetch_distance_;
+    std::mutex checkpoint_mutex_;  // One automatic checkpoint at a time
+    SchemaCatalog schema_;  // Redefined only under the exclusive db_mutex
+    void* mapped_base_;  // Page file backing the leading arena slabs, or nullptr
+    size_t mapped_bytes_;
     
     // Memory layout information for direct addressing
     size_t record_size_;  // Fixed size of each record in bytes
-    void* tree_start_address_;  // Starting memory address of tree data
-    std::vector<void*> leaf_addresses_;  // Cache of leaf node addresses
-    bool memory_mapped_;  // Track if memory mapping is initialized
-    std::vector<Record> cached_records_;  // Pre-allocated record cache for mmap
+    void* tree_start_address_;  // Starting memory address of the first leaf's id column
+    std::vector<void*> leaf_addresses_;  // Cache of leaf id column addresses
+    
+    // Flat row snapshot for the stride samplers. In-order appends keep it
+    // current; any other write drops it and the next reader rebuilds it.
+    // Readers hold their own reference, so dropping never frees memory in use.
+    mutable std::shared_ptr<std::vector<Record>> cached_records_;  // Guarded by cache_mutex_
+    mutable std::atomic<bool> memory_mapped_;  // cached_records_ is set
+    mutable std::mutex cache_mutex_;
+    std::atomic<uint64_t> writes_started_;  // Writes that may have reached a leaf
+    std::atomic<uint64_t> writes_finished_;  // Writes that are complete in their leaf
+    
+    // Concurrency: db_mutex guards the tree's lifetime. Inserts and readers take
+    // it shared; whole-tree rebuilds (load, bulk load, close) take it exclusive.
+    // Writers also take smo_mutex_: shared for inserts that fit in their leaf,
+    // exclusive for inserts that split nodes and for deletes and updates.
+    // Readers that descend from the root take it shared, so a split or merge
+    // never lands between a parent and its child; leaf-chain walks skip it
+    // and validate leaf reads against node versions instead. scan_leaves(),
+    // which hands out live spans, pauses writers. Samplers read through
+    // leaf_view(), a snapshot that pauses writers only while it is built;
+    // leaf writers save a copy into leaf_versions_ for snapshots still open.
     
     // Thread-safe operations
     mutable std::shared_mutex db_mutex;
+    uint64_t tree_generation_ = 0;  // Bumped whenever the arena is replaced; guarded by db_mutex
+    friend class OnlineAggregation;  // Locks db_mutex per step and checks tree_generation_
+    mutable std::shared_mutex smo_mutex_;  // Structure modifications (splits, merges)
+    mutable LeafVersionStore leaf_versions_;  // Leaf copies for open snapshots
+    
+    mutable std::mutex codec_mutex_;
+    std::shared_ptr<const CompressedLeafSet> compressed_leaves_;  // Guarded by codec_mutex_; null when off
+    mutable std::mutex strata_mutex_;
+    // (strata column, value column) -> analyze_strata() result; guarded by strata_mutex_
+    std::map<std::pair<std::string, std::string>, std::vector<StratumStats>> strata_stats_;
+    
+    std::unique_ptr<SynopsisLadder> synopses_;  // Replaced only under the exclusive db_mutex; null when off
+    
+    // Nodes unlinked by merges and root collapses. A leaf-chain reader (under
+    // the shared db_mutex) or an open snapshot may still stand on one, so it
+    // waits in retired_nodes_ until reclaim_nodes() finds neither can, then
+    // allocate_node() hands it out again. Guarded by smo_mutex_.
+    struct RetiredNode {
+        NodeId id;
+        uint64_t epoch;  // leaf_versions_ epoch when unlinked; older snapshots may read it
+    };
+    std::vector<RetiredNode> retired_nodes_;
+    std::vector<NodeId> free_nodes_;
+    
+    mutable std::shared_mutex index_mutex_;  // Inserts take it shared, index creation exclusive
+    std::vector<std::unique_ptr<SecondaryIndex>> indexes_;  // Guarded by index_mutex_
     
     // Helper methods
-    bool insert_into_node(std::shared_ptr<BPlusTreeNode> node, const Record& record);
+    void reset_tree();  // Release all nodes and start over with an empty leaf root
+    NodeId allocate_node(bool is_leaf);  // Reuses a free node if any; caller holds smo_mutex_ exclusively
+    void retire_node(NodeId id);  // Caller holds smo_mutex_ exclusively
+    void reclaim_nodes();  // Call holding no lock; skipped unless db_mutex is free
+    void collect_free_nodes();  // After a load: every node the tree no longer reaches
+    // Sample sum scaled to the table; population receives the snapshot's row count
+    double parallel_sample_sum(double sample_percent, int num_threads, double (*value)(const Record&),
+                               uint64_t* snapshot_id = nullptr, size_t* population = nullptr);
+    // Uniform sample without replacement from one snapshot; population is its row count
+    std::vector<Record> snapshot_sample(double sample_percent, uint64_t& snapshot_id, size_t& population);
+    // Caller holds db_mutex; returns the LSN of the logged insert (0 without a log).
+    // row is the insert_row() image to log instead of the record.
+    uint64_t insert_concurrent(const Record& record, const std::string* row = nullptr);
+    bool insert_optimistic(const Record& record);  // Leaf-latched insert; false if the leaf must split
+    void insert_unlocked(const Record& record);  // Caller holds smo_mutex_ or db_mutex exclusively
+    bool insert_into_node(NodeId node_id, const Record& record);
+    void build_from_sorted(const Record* records, size_t count, double fill_factor, int num_threads);
+    // Caller holds db_mutex. checkpoint_id goes into the header; 0 for plain saves.
+    bool save_unlocked(const std::string& file_path, uint64_t checkpoint_id = 0) const;
+    // Write-ahead logging; caller holds db_mutex. log_write() runs in the same
+    // smo_mutex_ section that applies the change, so a checkpoint (which
+    // excludes both) never separates a change from its frame.
+    uint64_t log_write(WriteAheadLog::FrameType type, const void* payload, size_t bytes);
+    bool commit_log(uint64_t lsn);  // Waits for the frame, then checkpoints if due
+    bool checkpoint_unlocked();  // Caller excludes writers: db_mutex exclusive, or shared with smo_mutex_
+    void replay_log(const std::vector<WriteAheadLog::Frame>& frames);  // No log attached yet
+    bool map_page_file(int fd, size_t file_size);  // Caller holds db_mutex exclusively
+    bool load_record_dump(std::ifstream& file);  // Legacy flat format
+    void unmap_page_file();
+    NodeId split_node(NodeId node_id, int64_t& separator);  // Returns the new right sibling
+    // Deletes and updates; caller holds smo_mutex_ exclusively
+    bool remove_from_node(NodeId node_id, int64_t id, Record& removed);
+    bool update_in_node(NodeId node_id, int64_t id, double amount, Record& before);
+    void rebalance_child(BPlusTreeNode& parent, int child_index);  // Caller latched parent
+    void collapse_root();  // Drop roots left with a single child
     std::vector<Record> collect_all_records() const;
-    std::vector<Record> collect_records_from_subtree(std::shared_ptr<BPlusTreeNode> node) const;
     std::vector<Record> collect_leaf_records() const;
+    // Point-in-time positional view over the leaf chain; hold db_mutex, but
+    // not smo_mutex_, while building and using it
+    LeafView leaf_view() const;
+    std::vector<Record> node_local_stride_sample(double sample_percent, int num_threads) const;  // Hold db_mutex
+    const BPlusTreeNode* first_leaf() const;  // Leftmost leaf of the chain
+    NodeId first_leaf_id() const;
+    std::vector<NodeId> leaves_overlapping(double min_amount, double max_amount) const;  // By zone map; hold db_mutex
+    // Helpers of aggregate_amount_by_id() and sum_amount_where(); hold db_mutex.
+    // low/high bound the ids under node_id.
+    void aggregate_id_range(NodeId node_id, int64_t start_id, int64_t end_id,
+                            int64_t low, int64_t high, ColumnAggregate& out) const;
+    double sum_where_subtree(NodeId node_id, double min_amount, double max_amount,
+                             const std::shared_ptr<const CompressedLeafSet>& compressed) const;
+    double leaf_sum_where(NodeId id, double min_amount, double max_amount,
+                          const std::shared_ptr<const CompressedLeafSet>& compressed) const;
+    
+    // Id-range streaming; hold db_mutex. stream_range() walks the chain from
+    // leaf_id up to (not including) stop_leaf, or until a row passes end_id.
+    // read(leaf, first, last) sees the leaf's rows in range under a version
+    // check and is repeated if a writer interferes; accept() follows once the
+    // read is validated.
+    void stream_range(NodeId leaf_id, NodeId stop_leaf, int64_t start_id, int64_t end_id,
+                      const std::function<void(const BPlusTreeNode&, int, int)>& read,
+                      const std::function<void()>& accept) const;
+    // (first leaf, stop leaf) runs covering the range, at most num_threads
+    std::vector<std::pair<NodeId, NodeId>> range_partitions(int64_t start_id, int64_t end_id, int num_threads) const;
+    void collect_range_leaves(NodeId node_id, int64_t start_id, int64_t end_id,
+                              int64_t low, int64_t high, std::vector<NodeId>& out) const;
+    std::shared_ptr<const CompressedLeafSet> compressed_leaf_set() const;
+    const BPlusTreeNode* node_ptr(NodeId id) const {
+        return id == INVALID_NODE ? nullptr : &nodes_[id];
+    }
     
     // Memory address arithmetic helpers
     void initialize_memory_layout();  // Cache addresses and calculate record size
     void update_leaf_addresses();  // Update cached leaf node addresses
-    Record* get_record_at_offset(size_t byte_offset);  // Direct memory access
-    bool is_valid_record_address(void* address);  // Validate memory bounds
     std::vector<Record> get_records_by_indices(const std::vector<size_t>& indices);  // Efficient index-based access
+    void collect_ranks(NodeId node_id, size_t base, const size_t* first, const size_t* last,
+                       std::vector<Record>& out) const;  // Ascending ranks under node_id; hold db_mutex
+    std::shared_ptr<const std::vector<Record>> record_snapshot() const;  // Builds it if missing; hold db_mutex
+    std::shared_ptr<const std::vector<Record>> current_snapshot() const;  // nullptr if missing
+    void note_insert(const Record& record);  // Append to or drop the snapshot after an insert
     
-    // Serialization helpers
-    void serialize_node(std::ofstream& file, std::shared_ptr<BPlusTreeNode> node);
-    std::shared_ptr<BPlusTreeNode> deserialize_node(std::ifstream& file);
+    // Secondary index helpers
+    const SecondaryIndex* find_index(const std::string& column) const;  // Caller holds index_mutex_
+    void index_insert(const Record& record);
+    void index_remove(const std::vector<Record>& records);
+    void index_update(const std::vector<std::pair<Record, Record>>& changes);  // (before, after)
+    void rebuild_indexes(const Record* records, size_t count);  // Postings from id-sorted rows
+    void drop_indexes();
+    void draw_synopsis(size_t rung);  // Caller holds db_mutex exclusively and synopses_ is set
+    NodeId leaf_for_key(int64_t id) const;  // Leftmost leaf that can hold id
+    // Records whose id is in sorted_ids and, with a filter, whose filter value is in [lo, hi]
+    void fetch_by_ids(const std::vector<int64_t>& sorted_ids, const SecondaryIndex* filter,
+                      int64_t lo, int64_t hi, std::vector<Record>& out) const;
+    bool matching_ids(const std::string& filter_column, int64_t lo, int64_t hi,
+                      std::vector<int64_t>& ids, const SecondaryIndex*& index) const;  // Caller holds index_mutex_
+    // Zone-pruned leaf scan for lo <= filter <= hi; returns the match count
+    // and appends the matching rows to out unless it is null. Hold db_mutex.
+    size_t scan_where(const ColumnKernel& filter, int64_t lo, int64_t hi, std::vector<Record>* out) const;
+    void invalidate_snapshot();
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "custom_scheduler.hpp"
+#include "online_aggregation.hpp"
 #include <algorithm>
+#include <cmath>
 #include <regex>
 #include <iostream>
 #include <sstream>
@@ -39,6 +41,10 @@ bool CustomApproximateScheduler::insert_batch(const std::vector<Record>& records
     return db_->insert_batch(records);
 }
 
+bool CustomApproximateScheduler::build_synopses(const std::vector<double>& sample_percents) {
+    return db_->build_synopses(sample_percents);
+}
+
 CustomValidationResult CustomApproximateScheduler::execute_sum_query(const std::string& query,
                                                                     double sample_percent,
                                                                     int num_threads) {
@@ -59,10 +65,11 @@ CustomValidationResult CustomApproximateScheduler::execute_sum_query(const std::
             // SUM with WHERE clause
             sum_result = db_->parallel_sum_where_sample(where_conditions.first, 
                                                        where_conditions.second,
-                                                       sample_percent, num_threads);
+                                                       sample_percent, num_threads,
+                                                       &result.snapshot_id);
         } else {
             // Simple SUM
-            sum_result = db_->parallel_sum_sample(sample_percent, num_threads);
+            sum_result = db_->parallel_sum_sample(sample_percent, num_threads, &result.snapshot_id);
         }
         
         result.value = sum_result;
@@ -91,7 +98,7 @@ CustomValidationResult CustomApproximateScheduler::execute_avg_query(const std::
     result.status = CustomApproximationStatus::ERROR;
     
     try {
-        double avg_result = db_->parallel_avg_sample(sample_percent, num_threads);
+        double avg_result = db_->parallel_avg_sample(sample_percent, num_threads, &result.snapshot_id);
         
         result.value = avg_result;
         result.status = CustomApproximationStatus::STABLE;
@@ -119,12 +126,12 @@ CustomValidationResult CustomApproximateScheduler::execute_count_query(const std
     result.status = CustomApproximationStatus::ERROR;
     
     try {
-        size_t count_result = db_->parallel_count_sample(sample_percent, num_threads);
+        size_t count_result = db_->parallel_count_sample(sample_percent, num_threads, &result.snapshot_id);
         
         result.value = static_cast<double>(count_result);
         result.status = CustomApproximationStatus::STABLE;
         result.confidence_level = calculate_confidence_level(sample_percent, db_->get_total_records());
-        result.error_margin = sample_percent / 100.0;
+        result.error_margin = 0.0;  // The snapshot's row count, exact
         result.samples_used = static_cast<int>(db_->get_total_records() * sample_percent / 100.0);
         
     } catch (const std::exception& e) {
@@ -252,6 +259,208 @@ size_t CustomApproximateScheduler::get_tree_height() const {
     return db_->get_tree_height();
 }
 
+CustomValidationResult CustomApproximateScheduler::execute_reservoir_query(const std::string& query,
+                                                                          size_t sample_size,
+                                                                          int num_threads) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    CustomValidationResult result;
+    result.value = 0.0;
+    result.status = CustomApproximationStatus::ERROR;
+    result.confidence_level = 0.0;
+    result.error_margin = 100.0;
+    result.samples_used = 0;
+    
+    try {
+        QueryType type = parse_query_type(query);
+        auto where_conditions = extract_where_conditions(query);
+        bool filtered = where_conditions.first != -1 && where_conditions.second != -1;
+        
+        size_t population = 0;
+        std::vector<Record> sample = db_->reservoir_sample(sample_size, num_threads, 0, &population,
+                                                           &result.snapshot_id);
+        result.samples_used = static_cast<int>(sample.size());
+        
+        // Per-row contributions whose mean estimates the answer (scaled by
+        // the row count for SUM and COUNT); AVG averages matching rows only.
+        // Non-matching rows contribute 0 to SUM and COUNT, so the spread
+        // only means something once at least two rows match.
+        ColumnAggregate contributions;
+        size_t matches = 0;
+        for (const Record& record : sample) {
+            bool match = !filtered || (record.amount >= where_conditions.first &&
+                                       record.amount <= where_conditions.second);
+            matches += match;
+            if (type == QueryType::AVG) {
+                if (match) contributions.add(record.amount);
+            } else if (type == QueryType::COUNT) {
+                contributions.add(match ? 1.0 : 0.0);
+            } else {
+                contributions.add(match ? record.amount : 0.0);
+            }
+        }
+        
+        if (type == QueryType::UNKNOWN) {
+            result.status = CustomApproximationStatus::ERROR;
+        } else if (matches < 2) {
+            result.status = CustomApproximationStatus::INSUFFICIENT_DATA;
+        } else {
+            double mean = contributions.mean();
+            result.value = type == QueryType::AVG ? mean : mean * population;
+            
+            // Sample variance, with the finite-population correction since
+            // rows are drawn without replacement
+            double n = static_cast<double>(contributions.count);
+            double variance = contributions.variance() * n / (n - 1.0);
+            double fpc = population > 1 ? (population - sample.size()) / (population - 1.0) : 0.0;
+            double half_width = 1.96 * std::sqrt(variance / n * fpc);
+            result.error_margin = mean != 0.0 ? half_width / std::abs(mean) : (half_width == 0.0 ? 0.0 : 100.0);
+            result.confidence_level = 0.95;
+            result.status = result.error_margin <= error_threshold_ ? CustomApproximationStatus::STABLE
+                                                                    : CustomApproximationStatus::DRIFTING;
+        }
+        
+    } catch (const std::exception& e) {
+        result.value = 0.0;
+        result.status = CustomApproximationStatus::ERROR;
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    result.computation_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    
+    return result;
+}
+
+CustomValidationResult CustomApproximateScheduler::execute_synopsis_query(const std::string& query) {
+    // Fewer matching rows give intervals that lean too hard on the CLT to accept
+    constexpr size_t MIN_SYNOPSIS_ROWS = 30;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    CustomValidationResult result;
+    result.value = 0.0;
+    result.status = CustomApproximationStatus::ERROR;
+    result.confidence_level = 0.0;
+    result.error_margin = 100.0;
+    result.samples_used = 0;
+    
+    try {
+        QueryType type = parse_query_type(query);
+        auto where_conditions = extract_where_conditions(query);
+        bool filtered = where_conditions.first != -1 && where_conditions.second != -1;
+        double min_amount = filtered ? where_conditions.first : -std::numeric_limits<double>::infinity();
+        double max_amount = filtered ? where_conditions.second : std::numeric_limits<double>::infinity();
+        
+        size_t rungs = type != QueryType::UNKNOWN ? db_->synopsis_percents().size() : 0;
+        for (size_t rung = 0; rung < rungs; rung++) {
+            SynopsisEstimate estimate;
+            if (!db_->synopsis_estimate(rung, "amount", min_amount, max_amount, estimate)) continue;
+            double value = estimate.sum, margin = estimate.sum_margin;
+            if (type == QueryType::AVG) {
+                value = estimate.mean;
+                margin = estimate.mean_margin;
+            } else if (type == QueryType::COUNT) {
+                value = estimate.count;
+                margin = estimate.count_margin;
+            }
+            
+            result.value = value;
+            result.error_margin = value != 0.0 ? margin / std::abs(value) : (margin == 0.0 ? 0.0 : 100.0);
+            result.confidence_level = 0.95;
+            result.samples_used = static_cast<int>(estimate.sampled);
+            result.snapshot_id = estimate.snapshot_id;
+            bool exact = estimate.sampled == estimate.population;
+            if (estimate.matched < 2 && !exact) {
+                result.status = CustomApproximationStatus::INSUFFICIENT_DATA;
+                continue;
+            }
+            bool accepted = exact || (estimate.matched >= MIN_SYNOPSIS_ROWS && result.error_margin <= error_threshold_);
+            result.status = accepted ? CustomApproximationStatus::STABLE : CustomApproximationStatus::DRIFTING;
+            if (accepted) break;
+        }
+        
+    } catch (const std::exception& e) {
+        result.value = 0.0;
+        result.status = CustomApproximationStatus::ERROR;
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    result.computation_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    
+    return result;
+}
+
+CustomValidationResult CustomApproximateScheduler::execute_online_query(
+    const std::string& query, double target_error, size_t report_rows,
+    const std::function<bool(const CustomValidationResult&)>& progress) {
+    // Intervals from fewer leaves than this lean too hard on the CLT to stop on
+    constexpr size_t MIN_STOPPING_LEAVES = 30;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    CustomValidationResult result;
+    result.value = 0.0;
+    result.status = CustomApproximationStatus::ERROR;
+    result.confidence_level = 0.0;
+    result.error_margin = 100.0;
+    result.samples_used = 0;
+    
+    try {
+        QueryType type = parse_query_type(query);
+        auto where_conditions = extract_where_conditions(query);
+        bool filtered = where_conditions.first != -1 && where_conditions.second != -1;
+        std::unique_ptr<OnlineAggregation> scan;
+        if (type != QueryType::UNKNOWN) {
+            scan = db_->start_online_aggregation(
+                "amount",
+                filtered ? where_conditions.first : -std::numeric_limits<double>::infinity(),
+                filtered ? where_conditions.second : std::numeric_limits<double>::infinity());
+        }
+        
+        while (scan) {
+            const OnlineEstimate& estimate = scan->advance(report_rows);
+            double value = estimate.sum, margin = estimate.sum_margin;
+            if (type == QueryType::AVG) {
+                value = estimate.mean;
+                margin = estimate.mean_margin;
+            } else if (type == QueryType::COUNT) {
+                value = estimate.count;
+                margin = estimate.count_margin;
+            }
+            
+            result.value = value;
+            // A zero estimate, or one without a finite interval, has not converged on anything yet
+            if (estimate.complete) {
+                result.error_margin = 0.0;
+            } else {
+                result.error_margin = value != 0.0 && std::isfinite(margin) ? margin / std::abs(value) : 100.0;
+            }
+            result.confidence_level = 0.95;
+            result.samples_used = static_cast<int>(estimate.rows_seen);
+            result.snapshot_id = estimate.snapshot_id;
+            if (estimate.interrupted) {
+                result.status = CustomApproximationStatus::ERROR;
+                break;
+            }
+            bool converged = estimate.complete ||
+                             (estimate.leaves_seen >= MIN_STOPPING_LEAVES && result.error_margin <= target_error);
+            result.status = converged ? CustomApproximationStatus::STABLE : CustomApproximationStatus::DRIFTING;
+            
+            auto now = std::chrono::high_resolution_clock::now();
+            result.computation_time = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
+            if (converged || (progress && !progress(result))) break;
+        }
+        if (!scan) result.status = CustomApproximationStatus::ERROR;
+        
+    } catch (const std::exception& e) {
+        result.value = 0.0;
+        result.status = CustomApproximationStatus::ERROR;
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    result.computation_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    
+    return result;
+}
+
 double CustomApproximateScheduler::get_database_size_mb() const {
     return get_total_records() * sizeof(Record) / (1024.0 * 1024.0);
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <chrono>
+#include <functional>
 
 enum class CustomApproximationStatus {
     STABLE,
@@ -19,6 +20,7 @@ struct CustomValidationResult {
     double error_margin;
     int samples_used;
     std::chrono::milliseconds computation_time;
+    uint64_t snapshot_id = 0;  // Point-in-time snapshot the sample was read from; 0 for exact queries
 };
 
 /**
@@ -40,6 +42,9 @@ public:
                       int32_t product_id, int64_t timestamp);
     bool insert_batch(const std::vector<Record>& records);
     
+    // Sample synopses for execute_synopsis_query(); see CustomBPlusDB::build_synopses()
+    bool build_synopses(const std::vector<double>& sample_percents = {0.01, 0.1, 1.0, 10.0});
+    
     // Query execution methods
     CustomValidationResult execute_sum_query(const std::string& query, 
                                             double sample_percent = 10.0,
@@ -58,6 +63,30 @@ public:
                                                   double sample_percent = 10.0,
                                                   int num_threads = 4);
     
+    // Fixed-latency mode: SUM, AVG or COUNT (with an optional amount range,
+    // as above) from a uniform sample of exactly sample_size rows, however
+    // large the table. error_margin is the relative half-width of a 95%
+    // CLT interval; status is STABLE when it is within the error threshold.
+    CustomValidationResult execute_reservoir_query(const std::string& query,
+                                                  size_t sample_size = 10000,
+                                                  int num_threads = 4);
+    
+    // Synopsis mode: SUM, AVG or COUNT (with an optional amount range) from
+    // the smallest precomputed sample synopsis (CustomBPlusDB::build_synopses())
+    // whose 95% interval is within the error threshold, relative; the largest
+    // rung's answer, DRIFTING, if none is. ERROR without synopses.
+    CustomValidationResult execute_synopsis_query(const std::string& query);
+    
+    // Online aggregation mode: SUM, AVG or COUNT (with an optional amount
+    // range) from leaves read in random order. Every report_rows rows,
+    // progress() gets the running result - error_margin is the relative
+    // half-width of its 95% interval and samples_used the rows read so far -
+    // and may return false to cancel. The scan stops once error_margin is
+    // within target_error or every leaf was read; returns the last result.
+    CustomValidationResult execute_online_query(
+        const std::string& query, double target_error, size_t report_rows = 10000,
+        const std::function<bool(const CustomValidationResult&)>& progress = nullptr);
+    
     // Exact queries for benchmarking
     CustomValidationResult execute_exact_sum();
     CustomValidationResult execute_exact_avg();
@@ -293,6 +293,22 @@ double DirectDBReader::parallel_sum_sampling(const std::string& column, double s
     
     if (records.empty()) return 0.0;
     
+    // Resolve the column once; the loops below only call the accessor
+    double (*value)(const Record&) = nullptr;
+    if (column == "amount") {
+        value = [](const Record& r) { return r.amount; };
+    } else if (column == "id") {
+        value = [](const Record& r) { return static_cast<double>(r.id); };
+    } else if (column == "region") {
+        value = [](const Record& r) { return static_cast<double>(r.region); };
+    } else if (column == "product_id") {
+        value = [](const Record& r) { return static_cast<double>(r.product_id); };
+    } else if (column == "timestamp") {
+        value = [](const Record& r) { return static_cast<double>(r.timestamp); };
+    } else {
+        return 0.0;
+    }
+    
     // Divide records among threads
     size_t records_per_thread = records.size() / num_threads;
     std::vector<std::future<double>> futures;
@@ -301,15 +317,10 @@ double DirectDBReader::parallel_sum_sampling(const std::string& column, double s
         size_t start_idx = t * records_per_thread;
         size_t end_idx = (t == num_threads - 1) ? records.size() : (t + 1) * records_per_thread;
         
-        futures.push_back(std::async(std::launch::async, [&records, start_idx, end_idx, column]() {
+        futures.push_back(std::async(std::launch::async, [&records, start_idx, end_idx, value]() {
             double thread_sum = 0.0;
             for (size_t i = start_idx; i < end_idx; i++) {
-                if (column == "amount") {
-                    thread_sum += records[i].amount;
-                } else if (column == "id") {
-                    thread_sum += records[i].id;
-                }
-                // Add other columns as needed
+                thread_sum += value(records[i]);
             }
             return thread_sum;
         }));
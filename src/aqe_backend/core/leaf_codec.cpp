@@ -0,0 +1,196 @@
+#include "leaf_codec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr int MAX_AMOUNT_EXPONENT = 10;
+
+const double POWERS_OF_TEN[MAX_AMOUNT_EXPONENT + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10};
+
+uint8_t bit_width(uint64_t max_value) {
+    uint8_t width = 0;
+    while (width < 64 && (max_value >> width) != 0) width++;
+    return width;
+}
+
+// Smallest exponent e such that every amount is exactly digits / 10^e
+int find_amount_exponent(const double* amounts, int count, std::vector<int64_t>& digits) {
+    digits.resize(count);
+    for (int e = 0; e <= MAX_AMOUNT_EXPONENT; e++) {
+        double scale = POWERS_OF_TEN[e];
+        bool exact = true;
+        for (int i = 0; i < count && exact; i++) {
+            double scaled = amounts[i] * scale;
+            if (!(std::fabs(scaled) < 4503599627370496.0)) {  // 2^52, also rejects NaN/inf
+                exact = false;
+                break;
+            }
+            int64_t d = std::llround(scaled);
+            exact = static_cast<double>(d) / scale == amounts[i] && !(d == 0 && std::signbit(amounts[i]));
+            digits[i] = d;
+        }
+        if (exact) return e;
+    }
+    return -1;
+}
+
+// Smallest digit count d with d / scale >= bound (d / scale is monotonic in d)
+bool digits_at_least(double bound, double scale, int64_t& out) {
+    double scaled = std::ceil(bound * scale);
+    if (!(std::fabs(scaled) < 4611686018427387904.0)) return false;  // 2^62
+    int64_t d = static_cast<int64_t>(scaled);
+    while (static_cast<double>(d - 1) / scale >= bound) d--;
+    while (static_cast<double>(d) / scale < bound) d++;
+    out = d;
+    return true;
+}
+
+}  // namespace
+
+// Builds one EncodedLeaf; appends each packed column to the shared word buffer
+class LeafEncoder {
+public:
+    explicit LeafEncoder(EncodedLeaf& out) : out_(out) {}
+
+    PackedColumn pack(const int64_t* values, size_t count) {
+        PackedColumn column;
+        if (count == 0) return column;
+        int64_t min_value = *std::min_element(values, values + count);
+        int64_t max_value = *std::max_element(values, values + count);
+        column.base = min_value;
+        column.width = bit_width(static_cast<uint64_t>(max_value) - static_cast<uint64_t>(min_value));
+        column.offset = static_cast<uint32_t>(out_.words_.size());
+        if (column.width == 0) return column;
+
+        size_t word_count = (count * column.width + 63) / 64;
+        out_.words_.resize(out_.words_.size() + word_count, 0);
+        uint64_t* words = out_.words_.data() + column.offset;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t delta = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(min_value);
+            size_t bit = i * column.width;
+            unsigned shift = bit & 63;
+            words[bit >> 6] |= delta << shift;
+            if (shift + column.width > 64) words[(bit >> 6) + 1] |= delta >> (64 - shift);
+        }
+        return column;
+    }
+
+    // Distinct sorted values go to `dict`, per-row indexes into it to `codes`
+    template <typename T>
+    void pack_dictionary(const T* values, size_t count, PackedColumn& dict, PackedColumn& codes) {
+        std::vector<int64_t> distinct(values, values + count);
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+        std::vector<int64_t> indexes(count);
+        for (size_t i = 0; i < count; i++) {
+            indexes[i] = std::lower_bound(distinct.begin(), distinct.end(), static_cast<int64_t>(values[i]))
+                         - distinct.begin();
+        }
+        dict = pack(distinct.data(), distinct.size());
+        codes = pack(indexes.data(), indexes.size());
+    }
+
+private:
+    EncodedLeaf& out_;
+};
+
+std::shared_ptr<const EncodedLeaf> EncodedLeaf::encode(const BPlusTreeNode& leaf, uint64_t version) {
+    auto encoded = std::make_shared<EncodedLeaf>();
+    EncodedLeaf& out = *encoded;
+    // Clamped: a concurrent writer can tear the count, and the caller discards
+    // the result when the version check fails
+    int count = std::max(0, std::min(leaf.key_count, BPlusTreeNode::MAX_KEYS));
+    out.leaf_version_ = version;
+    out.next_leaf_ = leaf.next_leaf;
+    out.count_ = static_cast<uint32_t>(count);
+
+    LeafEncoder encoder(out);
+    out.ids_ = encoder.pack(leaf.keys.data(), count);
+    out.timestamps_ = encoder.pack(leaf.timestamps.data(), count);
+    encoder.pack_dictionary(leaf.regions.data(), count, out.region_dict_, out.region_codes_);
+    encoder.pack_dictionary(leaf.product_ids.data(), count, out.product_dict_, out.product_codes_);
+
+    std::vector<int64_t> digits;
+    out.amount_exponent_ = find_amount_exponent(leaf.amounts.data(), count, digits);
+    if (out.amount_exponent_ >= 0) {
+        out.amount_scale_ = POWERS_OF_TEN[out.amount_exponent_];
+    } else {
+        // No exact decimal form: keep the raw bit patterns
+        for (int i = 0; i < count; i++) {
+            std::memcpy(&digits[i], &leaf.amounts[i], sizeof(double));
+        }
+    }
+    out.amounts_ = encoder.pack(digits.data(), count);
+    out.words_.shrink_to_fit();
+    return encoded;
+}
+
+double EncodedLeaf::amount(size_t i) const {
+    int64_t digits = value(amounts_, i);
+    if (amount_exponent_ < 0) {
+        double raw;
+        std::memcpy(&raw, &digits, sizeof(double));
+        return raw;
+    }
+    return static_cast<double>(digits) / amount_scale_;
+}
+
+Record EncodedLeaf::record(size_t i) const {
+    return Record(value(ids_, i), amount(i),
+                  static_cast<int32_t>(value(region_dict_, unpack(region_codes_, i))),
+                  static_cast<int32_t>(value(product_dict_, unpack(product_codes_, i))),
+                  value(timestamps_, i));
+}
+
+double EncodedLeaf::sum_amounts() const {
+    if (amount_exponent_ < 0) {
+        double sum = 0.0;
+        for (size_t i = 0; i < count_; i++) sum += amount(i);
+        return sum;
+    }
+    // Sum the packed deltas as integers; the base and scale are applied once
+    uint64_t delta_sum = 0;
+    for (size_t i = 0; i < count_; i++) delta_sum += unpack(amounts_, i);
+    int64_t digits = static_cast<int64_t>(static_cast<uint64_t>(amounts_.base) * count_ + delta_sum);
+    return static_cast<double>(digits) / amount_scale_;
+}
+
+double EncodedLeaf::sum_amounts_between(double min_amount, double max_amount) const {
+    // The predicate is moved into the digit domain once, so the loop compares
+    // packed integers; bounds too large for that take the decoded path
+    int64_t lo = 0, hi_exclusive = 0;
+    if (amount_exponent_ >= 0 &&
+        digits_at_least(min_amount, amount_scale_, lo) &&
+        digits_at_least(std::nextafter(max_amount, HUGE_VAL), amount_scale_, hi_exclusive)) {
+        int64_t digit_sum = 0;
+        for (size_t i = 0; i < count_; i++) {
+            int64_t digits = value(amounts_, i);
+            digit_sum += (digits >= lo && digits < hi_exclusive) ? digits : 0;
+        }
+        return static_cast<double>(digit_sum) / amount_scale_;
+    }
+    
+    double sum = 0.0;
+    for (size_t i = 0; i < count_; i++) {
+        double a = amount(i);
+        sum += (a >= min_amount && a <= max_amount) ? a : 0.0;
+    }
+    return sum;
+}
+
+CompressedLeafSet::CompressedLeafSet(std::vector<std::shared_ptr<const EncodedLeaf>> leaves, size_t raw_bytes)
+    : leaves_(std::move(leaves)), encoded_bytes_(0), raw_bytes_(raw_bytes) {
+    for (const auto& leaf : leaves_) {
+        if (leaf) encoded_bytes_ += leaf->encoded_bytes();
+    }
+}
+
+const EncodedLeaf* CompressedLeafSet::find(NodeId id, const BPlusTreeNode& leaf) const {
+    if (id >= leaves_.size() || !leaves_[id]) return nullptr;
+    const EncodedLeaf* encoded = leaves_[id].get();
+    return NodeLatch::read_begin(leaf.version) == encoded->leaf_version() ? encoded : nullptr;
+}
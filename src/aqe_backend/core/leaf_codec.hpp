@@ -0,0 +1,97 @@
+#pragma once
+
+#include "custom_bplus_db.hpp"
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Lightweight compressed copies of B+ tree leaves.
+ *
+ * Each column is reduced to small unsigned integers and bit-packed:
+ *   - id, timestamp: frame of reference (value - leaf minimum); ids are
+ *     sorted and timestamps nearly so, which keeps the ranges narrow
+ *   - region, product_id: per-leaf dictionary of distinct values plus codes
+ *   - amount: ALP-style decimals - the smallest power of ten that turns every
+ *     amount into an exact integer, then frame of reference; leaves whose
+ *     amounts don't round-trip keep raw 64-bit doubles
+ *
+ * Every value stays randomly accessible, so block samplers decode single
+ * rows, and the fused kernels aggregate straight from the packed words.
+ * An encoding is immutable and records the leaf version it was taken from;
+ * it is only used while the leaf still has that version.
+ */
+
+// `count` values of `width` bits each, stored as (value - base)
+struct PackedColumn {
+    int64_t base = 0;
+    uint32_t offset = 0;  // First word in EncodedLeaf::words
+    uint8_t width = 0;    // 0 means every value equals base
+};
+
+class EncodedLeaf {
+public:
+    // Encode a validated copy of the leaf; version is the latch value it was read at
+    static std::shared_ptr<const EncodedLeaf> encode(const BPlusTreeNode& leaf, uint64_t version);
+
+    uint64_t leaf_version() const { return leaf_version_; }
+    NodeId next_leaf() const { return next_leaf_; }  // The leaf's successor at that version
+    size_t size() const { return count_; }
+    size_t encoded_bytes() const { return sizeof(EncodedLeaf) + words_.size() * sizeof(uint64_t); }
+
+    Record record(size_t i) const;
+    double amount(size_t i) const;
+
+    // Fused decode-and-aggregate kernels over the amount column
+    double sum_amounts() const;
+    double sum_amounts_between(double min_amount, double max_amount) const;
+
+private:
+    uint64_t unpack(const PackedColumn& column, size_t i) const {
+        if (column.width == 0) return 0;
+        size_t bit = i * column.width;
+        const uint64_t* word = words_.data() + column.offset + (bit >> 6);
+        unsigned shift = bit & 63;
+        uint64_t value = word[0] >> shift;
+        if (shift + column.width > 64) value |= word[1] << (64 - shift);
+        return column.width == 64 ? value : value & ((uint64_t(1) << column.width) - 1);
+    }
+
+    // Wrapping like the encoder's deltas: for raw double bits base + delta
+    // can leave the int64 range
+    int64_t value(const PackedColumn& column, size_t i) const {
+        return static_cast<int64_t>(static_cast<uint64_t>(column.base) + unpack(column, i));
+    }
+
+    uint64_t leaf_version_ = 0;
+    NodeId next_leaf_ = INVALID_NODE;
+    uint32_t count_ = 0;
+    int amount_exponent_ = -1;  // -1: amounts are raw double bits
+    double amount_scale_ = 1.0;  // 10^amount_exponent_
+    PackedColumn ids_, timestamps_, amounts_;
+    PackedColumn region_dict_, region_codes_;
+    PackedColumn product_dict_, product_codes_;
+    std::vector<uint64_t> words_;
+
+    friend class LeafEncoder;
+};
+
+// Encoded copies of a tree's leaves, indexed by leaf node id. Immutable once
+// built; a rebuild reuses encodings of leaves whose version has not moved.
+class CompressedLeafSet {
+public:
+    CompressedLeafSet(std::vector<std::shared_ptr<const EncodedLeaf>> leaves, size_t raw_bytes);
+
+    // Encoding for a leaf, or nullptr if there is none or the leaf has changed since
+    const EncodedLeaf* find(NodeId id, const BPlusTreeNode& leaf) const;
+
+    size_t encoded_bytes() const { return encoded_bytes_; }
+    size_t raw_bytes() const { return raw_bytes_; }  // Column bytes of the same rows, uncompressed
+    const std::vector<std::shared_ptr<const EncodedLeaf>>& leaves() const { return leaves_; }
+
+private:
+    std::vector<std::shared_ptr<const EncodedLeaf>> leaves_;
+    size_t encoded_bytes_;
+    size_t raw_bytes_;
+};
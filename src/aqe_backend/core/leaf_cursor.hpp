@@ -0,0 +1,299 @@
+#pragma once
+
+#include "custom_bplus_db.hpp"
+#include "leaf_codec.hpp"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * Zero-copy access to the leaf level of a CustomBPlusDB tree.
+ *
+ * Spans and cursors point straight into the leaf columns, so they are only
+ * valid while the caller holds the database's shared lock. Rows are rebuilt
+ * one at a time, only for positions that are actually read.
+ *
+ * A view built while compressed leaf copies exist (see leaf_codec.hpp)
+ * decodes rows from the copy of every leaf that was current at build time.
+ *
+ * Writes may run while a view is in use. A view built with a
+ * LeafVersionStore is a point-in-time snapshot: leaves written since it was
+ * built are read from the copies the writers saved, so every position keeps
+ * the row it had at build time. Without one, row reads are version-validated,
+ * so a row is never torn, but positions may drift by the number of
+ * concurrent inserts.
+ */
+
+// Read-only view of one leaf's columns. The pointers are raw: the columns
+// are stable inside scan_leaves(), elsewhere a concurrent insert may shift
+// rows under the reader.
+struct LeafSpan {
+    const int64_t* ids;
+    const double* amounts;
+    const int32_t* regions;
+    const int32_t* product_ids;
+    const int64_t* timestamps;
+    size_t size;
+    size_t first_position;  // Global position of row 0 in the leaf chain
+
+    static LeafSpan of(const BPlusTreeNode& leaf, size_t first_position) {
+        return of(leaf, first_position, static_cast<size_t>(leaf.key_count));
+    }
+    
+    static LeafSpan of(const BPlusTreeNode& leaf, size_t first_position, size_t size) {
+        return {leaf.keys.data(), leaf.amounts.data(), leaf.regions.data(),
+                leaf.product_ids.data(), leaf.timestamps.data(), size, first_position};
+    }
+
+    Record record(size_t i) const {
+        return Record(ids[i], amounts[i], regions[i], product_ids[i], timestamps[i]);
+    }
+};
+
+// Runs `distance` leaves ahead of a walk along next_leaf and prefetches
+// each leaf it reaches, so the walk finds the leaves it hops to in cache.
+// Links are read without validation: a stale one costs a wasted prefetch at
+// worst, as leaves are not freed before the tree is rebuilt.
+class LeafPrefetcher {
+public:
+    LeafPrefetcher(const BPlusTreeArena& nodes, NodeId first_leaf, size_t distance)
+        : nodes_(&nodes), ahead_(distance > 0 ? first_leaf : INVALID_NODE) {
+        for (size_t i = 0; i < distance; i++) advance();
+    }
+
+    // Call once for every leaf the walk moves past
+    void advance() {
+        if (ahead_ == INVALID_NODE) return;
+        ahead_ = __atomic_load_n(&(*nodes_)[ahead_].next_leaf, __ATOMIC_RELAXED);
+        if (ahead_ != INVALID_NODE) (*nodes_)[ahead_].prefetch();
+    }
+
+private:
+    const BPlusTreeArena* nodes_;
+    NodeId ahead_;
+};
+
+// Leaf-level iterator that follows next_leaf links. Each leaf's size and
+// successor are read together under one validated read.
+class LeafCursor {
+public:
+    LeafCursor(const BPlusTreeArena& nodes, NodeId first_leaf, size_t prefetch_distance = 0)
+        : nodes_(&nodes), prefetcher_(nodes, first_leaf, prefetch_distance), position_(0) { load(first_leaf); }
+
+    bool valid() const { return leaf_ != nullptr; }
+    LeafSpan span() const { return LeafSpan::of(*leaf_, position_, size_); }
+    const BPlusTreeNode& node() const { return *leaf_; }
+    NodeId id() const { return id_; }
+    size_t size() const { return size_; }
+
+    void next() {
+        position_ += size_;
+        prefetcher_.advance();
+        load(next_);
+    }
+
+    // Continue at `next_leaf` after the caller consumed this leaf another way
+    void skip_to(NodeId next_leaf, size_t consumed) {
+        position_ += consumed;
+        prefetcher_.advance();
+        load(next_leaf);
+    }
+
+private:
+    void load(NodeId id) {
+        id_ = id;
+        leaf_ = id == INVALID_NODE ? nullptr : &(*nodes_)[id];
+        if (!leaf_) return;
+        size_ = NodeLatch::optimistic_read(leaf_->version, [&] {
+            next_ = leaf_->next_leaf;
+            return static_cast<size_t>(leaf_->key_count);
+        });
+    }
+
+    const BPlusTreeArena* nodes_;
+    LeafPrefetcher prefetcher_;
+    const BPlusTreeNode* leaf_;
+    NodeId id_ = INVALID_NODE;
+    size_t size_ = 0;
+    NodeId next_ = INVALID_NODE;
+    size_t position_;
+};
+
+class LeafView;
+
+// Record-level iterator; advance() skips whole leaves using their key counts
+class RecordCursor {
+public:
+    RecordCursor(const LeafView* view, size_t leaf_index, size_t slot)
+        : view_(view), leaf_index_(leaf_index), slot_(slot) {}
+
+    inline bool valid() const;
+    inline size_t position() const;
+    inline Record record() const;
+    inline double amount() const;
+
+    void next() { advance(1); }
+    inline void advance(size_t rows);
+
+private:
+    const LeafView* view_;
+    size_t leaf_index_;
+    size_t slot_;
+};
+
+/**
+ * Positional view over the whole leaf chain. Building it records one
+ * pointer and one offset per leaf (about 1/MAX_KEYS of the rows), after which
+ * any global position resolves to (leaf, slot) by binary search.
+ *
+ * With a LeafVersionStore the caller must hold writers off while the view is
+ * built; it then opens a snapshot, and records each leaf's version, which
+ * the last copy of the view closes again.
+ *
+ * Cursors prefetch `prefetch_distance` leaves ahead of the leaf they enter;
+ * samplers that jump between positions call prefetch() themselves.
+ */
+class LeafView {
+public:
+    LeafView(const BPlusTreeArena& nodes, NodeId first_leaf,
+             std::shared_ptr<const CompressedLeafSet> compressed = nullptr,
+             LeafVersionStore* versions = nullptr, size_t prefetch_distance = 0)
+        : compressed_(std::move(compressed)), versions_(versions), prefetch_distance_(prefetch_distance) {
+        if (versions_) {
+            snapshot_id_ = versions_->open_snapshot();
+            uint64_t snapshot = snapshot_id_;
+            pin_ = std::shared_ptr<const void>(versions_, [snapshot](LeafVersionStore* store) {
+                store->close_snapshot(snapshot);
+            });
+        }
+        offsets_.push_back(0);
+        LeafCursor cursor(nodes, first_leaf, prefetch_distance);
+        while (cursor.valid()) {
+            const EncodedLeaf* encoded = compressed_ ? compressed_->find(cursor.id(), cursor.node()) : nullptr;
+            size_t size = encoded ? encoded->size() : cursor.size();
+            if (size > 0) {
+                leaves_.push_back(&cursor.node());
+                ids_.push_back(cursor.id());
+                leaf_nodes_.push_back(static_cast<int16_t>(nodes.slab_node(cursor.id() / BPlusTreeArena::SLAB_NODES)));
+                leaf_versions_.push_back(NodeLatch::read_begin(cursor.node().version));
+                encoded_.push_back(encoded);
+                offsets_.push_back(offsets_.back() + size);
+            }
+            if (encoded) {
+                cursor.skip_to(encoded->next_leaf(), size);
+            } else {
+                cursor.next();
+            }
+        }
+        if (versions_) images_.reset(new std::atomic<const BPlusTreeNode*>[leaves_.size()]());
+    }
+
+    size_t size() const { return offsets_.back(); }
+    bool empty() const { return size() == 0; }
+    size_t leaf_count() const { return leaves_.size(); }
+    uint64_t snapshot_id() const { return snapshot_id_; }  // 0 unless built with a LeafVersionStore
+
+    // Index of the leaf that holds a global position
+    size_t leaf_index_of(size_t position) const {
+        return std::upper_bound(offsets_.begin() + 1, offsets_.end(), position) - offsets_.begin() - 1;
+    }
+
+    Record operator[](size_t position) const {
+        size_t l = leaf_index_of(position);
+        return record(l, position - offsets_[l]);
+    }
+
+    double amount_at(size_t position) const {
+        size_t l = leaf_index_of(position);
+        return amount(l, position - offsets_[l]);
+    }
+
+    Record record(size_t leaf_index, size_t slot) const {
+        if (encoded_[leaf_index]) return encoded_[leaf_index]->record(slot);
+        return read_leaf(leaf_index, [slot](const BPlusTreeNode& leaf) {
+            return Record(leaf.keys[slot], leaf.amounts[slot], leaf.regions[slot],
+                          leaf.product_ids[slot], leaf.timestamps[slot]);
+        });
+    }
+
+    double amount(size_t leaf_index, size_t slot) const {
+        if (encoded_[leaf_index]) return encoded_[leaf_index]->amount(slot);
+        return read_leaf(leaf_index, [slot](const BPlusTreeNode& leaf) { return leaf.amounts[slot]; });
+    }
+
+    // Runs `read` on a leaf as the view sees it and returns its result:
+    // validated against concurrent writes, and on the saved copy if the leaf
+    // changed after a snapshot was taken. `read` may run more than once.
+    template <typename Read>
+    auto read_leaf(size_t leaf_index, Read&& read) const -> decltype(read(std::declval<const BPlusTreeNode&>())) {
+        const BPlusTreeNode& leaf = *leaves_[leaf_index];
+        if (!versions_) return NodeLatch::optimistic_read(leaf.version, [&] { return read(leaf); });
+        
+        const BPlusTreeNode* image = images_[leaf_index].load(std::memory_order_acquire);
+        if (!image) {
+            for (;;) {
+                uint64_t version = NodeLatch::read_begin(leaf.version);
+                if (version != leaf_versions_[leaf_index]) break;
+                auto result = read(leaf);
+                if (NodeLatch::read_validate(leaf.version, version)) return result;
+            }
+            // The writer saved the copy before it released the latch
+            image = versions_->find(ids_[leaf_index], leaf_versions_[leaf_index]);
+            images_[leaf_index].store(image, std::memory_order_release);
+        }
+        return read(*image);
+    }
+
+    RecordCursor cursor(size_t position) const {
+        if (position >= size()) return RecordCursor(this, leaves_.size(), 0);
+        size_t l = leaf_index_of(position);
+        return RecordCursor(this, l, position - offsets_[l]);
+    }
+
+    size_t leaf_size(size_t leaf_index) const { return offsets_[leaf_index + 1] - offsets_[leaf_index]; }
+    size_t leaf_offset(size_t leaf_index) const { return offsets_[leaf_index]; }
+    // NUMA node the leaf's slab was bound to; see BPlusTreeArena::slab_node()
+    int leaf_node(size_t leaf_index) const { return leaf_nodes_[leaf_index]; }
+    
+    // Prefetch hints; out-of-range arguments are ignored. A leaf changed
+    // since the snapshot is read from its copy, which the hint misses.
+    size_t prefetch_distance() const { return prefetch_distance_; }
+    void prefetch_leaf(size_t leaf_index) const {
+        if (leaf_index < leaves_.size() && !encoded_[leaf_index]) leaves_[leaf_index]->prefetch();
+    }
+    void prefetch(size_t position) const {
+        if (prefetch_distance_ == 0 || position >= size()) return;
+        size_t l = leaf_index_of(position);
+        if (!encoded_[l]) leaves_[l]->prefetch(static_cast<int>(position - offsets_[l]));
+    }
+
+private:
+    std::shared_ptr<const CompressedLeafSet> compressed_;  // Keeps encoded_ alive
+    LeafVersionStore* versions_;
+    size_t prefetch_distance_;
+    uint64_t snapshot_id_ = 0;
+    std::shared_ptr<const void> pin_;  // Closes the snapshot with the last copy of the view
+    std::vector<const BPlusTreeNode*> leaves_;
+    std::vector<NodeId> ids_;
+    std::vector<int16_t> leaf_nodes_;
+    std::vector<uint64_t> leaf_versions_;  // Latch version of each leaf at build time
+    std::vector<const EncodedLeaf*> encoded_;  // Current compressed copy per leaf, or nullptr
+    std::vector<size_t> offsets_;  // offsets_[i] = global position of leaf i's row 0
+    std::shared_ptr<std::atomic<const BPlusTreeNode*>[]> images_;  // Copies found so far, per leaf
+};
+
+bool RecordCursor::valid() const { return leaf_index_ < view_->leaf_count(); }
+size_t RecordCursor::position() const { return view_->leaf_offset(leaf_index_) + slot_; }
+Record RecordCursor::record() const { return view_->record(leaf_index_, slot_); }
+double RecordCursor::amount() const { return view_->amount(leaf_index_, slot_); }
+
+void RecordCursor::advance(size_t rows) {
+    slot_ += rows;
+    while (leaf_index_ < view_->leaf_count() && slot_ >= view_->leaf_size(leaf_index_)) {
+        slot_ -= view_->leaf_size(leaf_index_);
+        leaf_index_++;
+        if (view_->prefetch_distance() > 0) view_->prefetch_leaf(leaf_index_ + view_->prefetch_distance());
+    }
+}
@@ -0,0 +1,83 @@
+#include "leaf_versions.hpp"
+#include "custom_bplus_db.hpp"
+
+uint64_t LeafVersionStore::open_snapshot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t snapshot = epoch_.load(std::memory_order_relaxed);
+    epoch_.store(snapshot + 1, std::memory_order_release);
+    open_.insert(snapshot);
+    newest_.store(snapshot, std::memory_order_release);
+    return snapshot;
+}
+
+void LeafVersionStore::close_snapshot(uint64_t snapshot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = open_.find(snapshot);
+    if (it == open_.end()) return;
+    open_.erase(it);
+    newest_.store(open_.empty() ? 0 : *open_.rbegin(), std::memory_order_release);
+    if (open_.empty()) {
+        images_.clear();
+        return;
+    }
+
+    for (auto entry = images_.begin(); entry != images_.end();) {
+        std::vector<Image>& chain = entry->second;
+        size_t kept = 0;
+        for (Image& image : chain) {
+            auto reader = open_.lower_bound(image.from);
+            if (reader != open_.end() && *reader < image.until) chain[kept++] = std::move(image);
+        }
+        chain.resize(kept);
+        entry = chain.empty() ? images_.erase(entry) : std::next(entry);
+    }
+}
+
+const BPlusTreeNode* LeafVersionStore::find(NodeId leaf, uint64_t version) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = images_.find(leaf);
+    if (entry == images_.end()) return nullptr;
+    for (const Image& image : entry->second) {
+        if (image.version == version) return image.node.get();
+    }
+    return nullptr;
+}
+
+void LeafVersionStore::before_write(NodeId id, BPlusTreeNode& leaf) {
+    // Snapshots only open while writers are held off, so neither epoch moves
+    // during a write
+    uint64_t now = epoch_.load(std::memory_order_relaxed);
+    uint64_t newest = newest_.load(std::memory_order_acquire);
+    if (newest != 0 && leaf.write_epoch <= newest) {
+        auto image = std::make_shared<BPlusTreeNode>(leaf);
+        image->version = leaf.version & ~uint64_t(1);  // As readers saw it before the latch was taken
+        std::lock_guard<std::mutex> lock(mutex_);
+        images_[id].push_back(Image{image->version, leaf.write_epoch, now, std::move(image)});
+    }
+    leaf.write_epoch = now;
+}
+
+void LeafVersionStore::reset(uint64_t epoch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    images_.clear();
+    // Never backwards: snapshots of interrupted online scans may still be open
+    uint64_t current = epoch_.load(std::memory_order_relaxed);
+    epoch_.store(std::max<uint64_t>({epoch, current, 1}), std::memory_order_release);
+}
+
+size_t LeafVersionStore::image_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto& entry : images_) count += entry.second.size();
+    return count;
+}
+
+size_t LeafVersionStore::open_snapshots() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_.size();
+}
+
+uint64_t LeafVersionStore::oldest_snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_.empty() ? 0 : *open_.begin();
+}
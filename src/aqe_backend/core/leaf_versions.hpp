@@ -0,0 +1,67 @@
+#pragma once
+
+#include "node_arena.hpp"
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class BPlusTreeNode;
+
+/**
+ * Copy-on-write leaf images behind CustomBPlusDB's point-in-time reads.
+ *
+ * A snapshot is an epoch. Opening one (while writers are held off) bumps
+ * the write epoch, and every leaf write stamps the leaf with the epoch it
+ * happened in. A writer about to change a leaf whose stamp is not newer
+ * than the newest open snapshot first saves a copy of it, keyed by the
+ * leaf's latch version, so only the first write to a leaf after a snapshot
+ * pays for a copy. A reader that finds a leaf's version changed since its
+ * snapshot reads that copy instead.
+ *
+ * A copy is needed by the snapshots opened between the leaf's previous
+ * write and the write that replaced it. Closing a snapshot frees the copies
+ * no remaining snapshot falls in that range (epoch-based reclamation);
+ * once none are open, all of them.
+ */
+class LeafVersionStore {
+public:
+    // Writers must be excluded while a snapshot opens. Returns its id (> 0).
+    uint64_t open_snapshot();
+    void close_snapshot(uint64_t snapshot);
+
+    // The copy of a leaf as it was at `version`; valid while a snapshot that
+    // saw that version is open
+    const BPlusTreeNode* find(NodeId leaf, uint64_t version) const;
+
+    // Writers call this holding the leaf's latch, before changing the leaf
+    void before_write(NodeId id, BPlusTreeNode& leaf);
+
+    uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+    // After loading leaves stamped up to `epoch` by another process. Drops
+    // every copy, so snapshots still open must no longer read the old leaves.
+    void reset(uint64_t epoch);
+
+    size_t image_count() const;
+    size_t open_snapshots() const;
+    uint64_t oldest_snapshot() const;  // 0 if none is open
+
+private:
+    struct Image {
+        uint64_t version;  // Leaf latch version the copy was taken at
+        uint64_t from;     // Epoch of the write that produced it
+        uint64_t until;    // Epoch of the write that replaced it
+        std::shared_ptr<const BPlusTreeNode> node;
+    };
+
+    std::atomic<uint64_t> epoch_{1};
+    std::atomic<uint64_t> newest_{0};  // Newest open snapshot, 0 if none
+
+    mutable std::mutex mutex_;
+    std::multiset<uint64_t> open_;
+    std::unordered_map<NodeId, std::vector<Image>> images_;
+};
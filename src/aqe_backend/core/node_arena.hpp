@@ -0,0 +1,172 @@
+#pragma once
+
+#include "numa_memory.hpp"
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Slab allocator for fixed-size B+ tree nodes.
+ *
+ * Nodes are addressed by compact 32-bit ids instead of pointers. They are
+ * placed in large slabs in allocation order, so nodes that are created
+ * together (e.g. consecutive leaves) sit next to each other in memory.
+ * Nodes never move once allocated, so references stay valid until clear().
+ * Node types must be trivially destructible: releasing the arena frees a
+ * handful of slabs without visiting individual nodes.
+ *
+ * allocate() may run concurrently with lookups. Lookups go through a
+ * published slab directory; when it fills up, a larger copy is published
+ * and the old one is kept until clear(), so a reader that loaded it earlier
+ * never sees freed memory. clear() and adopt() require exclusive access.
+ *
+ * With a MemoryPolicy set, new slabs are carved from huge-page aligned,
+ * NUMA-placed chunks instead (see numa_memory.hpp), and slab_node() tells
+ * which node a slab was bound to so scans can run on that node.
+ */
+
+using NodeId = uint32_t;
+static constexpr NodeId INVALID_NODE = UINT32_MAX;
+
+template <typename NodeT>
+class NodeArena {
+    static_assert(std::is_trivially_destructible<NodeT>::value,
+                  "arena nodes are released without running destructors");
+
+public:
+    static constexpr size_t SLAB_NODES = 256;  // Nodes per slab
+    static constexpr std::align_val_t SLAB_ALIGNMENT{alignof(NodeT) > 64 ? alignof(NodeT) : 64};
+    static constexpr int HEAP_SLAB = -2;  // slab_node() of slabs from operator new or adopt()
+
+    NodeArena() : directory_(nullptr), directory_capacity_(0), node_count_(0), external_slabs_(0) {}
+    ~NodeArena() { clear(); }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // Construct a node in place and return its id
+    template <typename... Args>
+    NodeId allocate(Args&&... args) {
+        std::lock_guard<std::mutex> lock(allocate_mutex_);
+        size_t id = node_count_.load(std::memory_order_relaxed);
+        size_t slot = id % SLAB_NODES;
+        if (slot == 0) new_slab();
+        new (slabs_.back() + slot) NodeT(std::forward<Args>(args)...);
+        node_count_.store(id + 1, std::memory_order_release);
+        return static_cast<NodeId>(id);
+    }
+
+    NodeT& operator[](NodeId id) {
+        return directory_.load(std::memory_order_acquire)[id / SLAB_NODES][id % SLAB_NODES];
+    }
+    const NodeT& operator[](NodeId id) const {
+        return directory_.load(std::memory_order_acquire)[id / SLAB_NODES][id % SLAB_NODES];
+    }
+
+    // Release every node at once - O(number of slabs)
+    void clear() {
+        for (size_t i = external_slabs_; i < slabs_.size(); ++i) {
+            if (slab_nodes_[i] == HEAP_SLAB) ::operator delete(slabs_[i], SLAB_ALIGNMENT);
+        }
+        slabs_.clear();
+        slab_nodes_.clear();
+        chunks_.release();
+        directories_.clear();
+        directory_.store(nullptr, std::memory_order_relaxed);
+        directory_capacity_ = 0;
+        node_count_ = 0;
+        external_slabs_ = 0;
+    }
+    
+    /**
+     * Serve nodes [0, node_count) from caller-owned memory, e.g. a mapped
+     * file: slab i starts at base + i * slab_stride. The memory is never
+     * freed by the arena and must outlive it (or the next clear()). The last
+     * slab must have room for SLAB_NODES nodes, because later allocations
+     * continue in place before a fresh slab is started.
+     */
+    void adopt(char* base, size_t slab_stride, size_t node_count) {
+        clear();
+        size_t slab_count = (node_count + SLAB_NODES - 1) / SLAB_NODES;
+        for (size_t i = 0; i < slab_count; ++i) {
+            push_slab(reinterpret_cast<NodeT*>(base + i * slab_stride));
+        }
+        node_count_ = node_count;
+        external_slabs_ = slab_count;
+    }
+
+    // Like adopt(), but copy the nodes into slabs of our own, so they are
+    // placed by the memory policy; the caller's memory can go afterwards
+    void copy_from(const char* base, size_t slab_stride, size_t node_count) {
+        clear();
+        for (size_t first = 0; first < node_count; first += SLAB_NODES) {
+            new_slab();
+            std::memcpy(static_cast<void*>(slabs_.back()), base + first / SLAB_NODES * slab_stride,
+                        std::min(SLAB_NODES, node_count - first) * sizeof(NodeT));
+        }
+        node_count_ = node_count;
+    }
+
+    // Where slabs allocated from now on come from
+    void set_memory_policy(const MemoryPolicy& policy) {
+        std::lock_guard<std::mutex> lock(allocate_mutex_);
+        policy_ = policy;
+    }
+    MemoryPolicy memory_policy() const { return policy_; }
+
+    // Topology index of the node a slab was bound to, SlabChunks::ANY_NODE
+    // if interleaved or unbound, HEAP_SLAB if not from a placed chunk. Not
+    // safe against a concurrent allocate().
+    int slab_node(size_t index) const { return slab_nodes_[index]; }
+    
+    // Slab access for serializers; each slab holds SLAB_NODES node slots
+    size_t slab_count() const { return slabs_.size(); }
+    const NodeT* slab(size_t index) const { return slabs_[index]; }
+
+    size_t size() const { return node_count_; }
+    size_t memory_bytes() const { return (slabs_.size() - external_slabs_) * SLAB_NODES * sizeof(NodeT); }  // Heap slabs only
+
+private:
+    void new_slab() {
+        if (!policy_.placed()) {
+            push_slab(static_cast<NodeT*>(::operator new(sizeof(NodeT) * SLAB_NODES, SLAB_ALIGNMENT)), HEAP_SLAB);
+            return;
+        }
+        int node = SlabChunks::ANY_NODE;
+        void* memory = chunks_.allocate(sizeof(NodeT) * SLAB_NODES, static_cast<size_t>(SLAB_ALIGNMENT), policy_, node);
+        push_slab(static_cast<NodeT*>(memory), node);
+    }
+
+    void push_slab(NodeT* slab, int node = HEAP_SLAB) {
+        if (slabs_.size() == directory_capacity_) {
+            size_t capacity = std::max<size_t>(64, directory_capacity_ * 2);
+            std::unique_ptr<NodeT*[]> grown(new NodeT*[capacity]);
+            std::copy(slabs_.begin(), slabs_.end(), grown.get());
+            directory_.store(grown.get(), std::memory_order_release);
+            directories_.push_back(std::move(grown));
+            directory_capacity_ = capacity;
+        }
+        directories_.back()[slabs_.size()] = slab;
+        slabs_.push_back(slab);
+        slab_nodes_.push_back(static_cast<int16_t>(node));
+    }
+
+    std::vector<NodeT*> slabs_;  // Writer-side slab list
+    std::atomic<NodeT**> directory_;  // Published copy of slabs_ that lookups read
+    size_t directory_capacity_;
+    std::vector<std::unique_ptr<NodeT*[]>> directories_;  // Every published generation
+    std::mutex allocate_mutex_;
+    std::atomic<size_t> node_count_;
+    size_t external_slabs_;  // Leading slabs owned by the caller (see adopt())
+    std::vector<int16_t> slab_nodes_;  // Per slab, see slab_node()
+    MemoryPolicy policy_;
+    SlabChunks chunks_;  // Backs the slabs allocated under a policy
+};
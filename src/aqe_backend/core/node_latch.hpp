@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+/**
+ * Optimistic version latch over a plain 64-bit word stored in each node.
+ *
+ * Bit 0 is set while a writer holds the latch, and every unlock advances
+ * the word by 2. A reader records the version, reads the node without
+ * locking, and accepts what it read only if the version is unchanged
+ * afterwards; otherwise it retries. Readers never write to shared memory,
+ * so concurrent readers do not contend on node cache lines.
+ *
+ * The word is a plain integer accessed through atomic builtins (rather than
+ * std::atomic) so nodes stay trivially copyable for the page file format.
+ */
+class NodeLatch {
+public:
+    // Wait until no writer holds the latch and return the version seen
+    static uint64_t read_begin(const uint64_t& word) {
+        for (int spins = 0;; ++spins) {
+            uint64_t version = __atomic_load_n(&word, __ATOMIC_ACQUIRE);
+            if ((version & 1) == 0) return version;
+            if (spins > 64) std::this_thread::yield();
+        }
+    }
+
+    // True if nothing was written since read_begin() returned `version`
+    static bool read_validate(const uint64_t& word, uint64_t version) {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&word, __ATOMIC_RELAXED) == version;
+    }
+
+    static void lock(uint64_t& word) {
+        for (;;) {
+            uint64_t version = read_begin(word);
+            if (__atomic_compare_exchange_n(&word, &version, version + 1, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return;
+            }
+        }
+    }
+
+    static void unlock(uint64_t& word) {
+        __atomic_store_n(&word, word + 1, __ATOMIC_RELEASE);
+    }
+
+    // Run `read` until it completes without a concurrent writer
+    template <typename Read>
+    static auto optimistic_read(const uint64_t& word, Read&& read) -> decltype(read()) {
+        for (;;) {
+            uint64_t version = read_begin(word);
+            auto result = read();
+            if (read_validate(word, version)) return result;
+        }
+    }
+};
+
+// Holds a node latch for the lifetime of the guard
+class NodeWriteGuard {
+public:
+    explicit NodeWriteGuard(uint64_t& word) : word_(word) { NodeLatch::lock(word_); }
+    ~NodeWriteGuard() { NodeLatch::unlock(word_); }
+
+    NodeWriteGuard(const NodeWriteGuard&) = delete;
+    NodeWriteGuard& operator=(const NodeWriteGuard&) = delete;
+
+private:
+    uint64_t& word_;
+};
+
+// Counter update for fields that writers on different leaves share
+inline void atomic_add(size_t& counter, size_t delta) {
+    __atomic_fetch_add(&counter, delta, __ATOMIC_RELAXED);
+}
+
+// Compare-and-swap update of a shared double. `update` maps the current
+// value to the new one; nothing is written when it returns the same value.
+template <typename Update>
+inline void atomic_update(double& value, Update&& update) {
+    double seen;
+    __atomic_load(&value, &seen, __ATOMIC_RELAXED);
+    for (;;) {
+        double desired = update(seen);
+        if (desired == seen || (desired != desired && seen != seen)) return;
+        if (__atomic_compare_exchange(&value, &seen, &desired, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return;
+    }
+}
+
+inline void atomic_add(double& value, double delta) {
+    atomic_update(value, [delta](double v) { return v + delta; });
+}
+
+inline double load_acquire(const double& value) {
+    double seen;
+    __atomic_load(&value, &seen, __ATOMIC_ACQUIRE);
+    return seen;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+/**
+ * NUMA topology and placed memory for the node arena.
+ *
+ * Without a policy, arena slabs come from operator new and land on whichever
+ * node first touches them - for a tree loaded by one thread, all on that
+ * thread's node. With one, slabs are carved from large chunks mapped here:
+ * 2 MiB aligned so transparent huge pages can back them (fewer TLB misses
+ * on long scans), and bound with mbind() before first touch, so placement
+ * does not depend on which thread fills them.
+ *
+ * mbind() is issued as a raw syscall so neither libnuma nor numaif.h is
+ * needed. Where it is unavailable (no NUMA, or a container that forbids it)
+ * memory simply stays unbound and slabs report no node.
+ */
+
+enum class NumaPlacement : uint8_t {
+    None,        // First touch
+    Interleave,  // Pages spread round-robin over all nodes
+    Partition    // Whole chunks assigned round-robin to nodes; scans can run node-local
+};
+
+struct MemoryPolicy {
+    bool huge_pages = false;
+    NumaPlacement placement = NumaPlacement::None;
+
+    bool placed() const { return huge_pages || placement != NumaPlacement::None; }
+};
+
+// Online NUMA nodes and their CPUs, read once from sysfs. A machine without
+// sysfs node information is one node holding every CPU.
+class NumaTopology {
+public:
+    static const NumaTopology& system() {
+        static const NumaTopology topology;
+        return topology;
+    }
+
+    size_t node_count() const { return nodes_.size(); }
+    int node_id(size_t index) const { return nodes_[index]; }  // Kernel node number
+    const std::vector<int>& cpus(size_t index) const { return cpus_[index]; }
+
+    // Restrict the calling thread to the CPUs of a node; false if refused
+    bool pin_current_thread(size_t index) const {
+        if (index >= cpus_.size() || cpus_[index].empty()) return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus_[index]) {
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    // Parse a sysfs range list such as "0-3,8-11"
+    static std::vector<int> parse_list(const std::string& text) {
+        std::vector<int> values;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find(',', pos);
+            if (end == std::string::npos) end = text.size();
+            std::string range = text.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int v = first; v <= last; v++) values.push_back(v);
+            } catch (...) {
+                // Blank or malformed entry
+            }
+            pos = end + 1;
+        }
+        return values;
+    }
+
+private:
+    NumaTopology() {
+        for (int node : parse_list(read_line("/sys/devices/system/node/online"))) {
+            std::vector<int> cpus =
+                parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            if (cpus.empty()) continue;  // Memory-only node
+            nodes_.push_back(node);
+            cpus_.push_back(std::move(cpus));
+        }
+        if (nodes_.empty()) {
+            std::vector<int> cpus;
+            unsigned count = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned cpu = 0; cpu < count; cpu++) cpus.push_back(static_cast<int>(cpu));
+            nodes_.push_back(0);
+            cpus_.push_back(std::move(cpus));
+        }
+    }
+
+    static std::string read_line(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    std::vector<int> nodes_;
+    std::vector<std::vector<int>> cpus_;
+};
+
+// Mapped chunks that arena slabs are carved from. Not thread-safe; the arena
+// calls it under its allocation lock.
+class SlabChunks {
+public:
+    static constexpr size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+    static constexpr size_t CHUNK_BYTES = size_t(32) << 20;  // 16 huge pages
+    static constexpr int ANY_NODE = -1;
+
+    SlabChunks() = default;
+    ~SlabChunks() { release(); }
+
+    SlabChunks(const SlabChunks&) = delete;
+    SlabChunks& operator=(const SlabChunks&) = delete;
+
+    /**
+     * `bytes` aligned to `alignment` (at most a huge page), from the current
+     * chunk or a new one. `node` receives the topology index of the node the
+     * memory was bound to, or ANY_NODE when interleaved or unbound. Throws
+     * std::bad_alloc like operator new.
+     */
+    void* allocate(size_t bytes, size_t alignment, const MemoryPolicy& policy, int& node) {
+        if (!chunks_.empty()) {
+            Chunk& chunk = chunks_.back();
+            size_t offset = (chunk.used + alignment - 1) / alignment * alignment;
+            if (offset + bytes <= chunk.bytes) {
+                chunk.used = offset + bytes;
+                node = chunk.node;
+                return chunk.base + offset;
+            }
+        }
+        Chunk chunk = map_chunk(std::max(CHUNK_BYTES, round_up(bytes, HUGE_PAGE_BYTES)), policy);
+        chunk.used = bytes;
+        chunks_.push_back(chunk);
+        node = chunk.node;
+        return chunk.base;
+    }
+
+    void release() {
+        for (const Chunk& chunk : chunks_) ::munmap(chunk.base, chunk.bytes);
+        chunks_.clear();
+    }
+
+    size_t mapped_bytes() const {
+        size_t total = 0;
+        for (const Chunk& chunk : chunks_) total += chunk.bytes;
+        return total;
+    }
+
+private:
+    struct Chunk {
+        char* base;
+        size_t bytes;
+        size_t used;
+        int node;
+    };
+
+    static size_t round_up(size_t bytes, size_t unit) { return (bytes + unit - 1) / unit * unit; }
+
+    Chunk map_chunk(size_t bytes, const MemoryPolicy& policy) {
+        // Over-map by a huge page and trim both ends to a 2 MiB boundary
+        size_t span = bytes + HUGE_PAGE_BYTES;
+        void* mapped = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) throw std::bad_alloc();
+        char* raw = static_cast<char*>(mapped);
+        char* base = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), HUGE_PAGE_BYTES));
+        if (base > raw) ::munmap(raw, static_cast<size_t>(base - raw));
+        size_t tail = static_cast<size_t>(raw + span - (base + bytes));
+        if (tail > 0) ::munmap(base + bytes, tail);
+
+#ifdef MADV_HUGEPAGE
+        if (policy.huge_pages) ::madvise(base, bytes, MADV_HUGEPAGE);
+#endif
+
+        int node = ANY_NODE;
+        const NumaTopology& topology = NumaTopology::system();
+        if (topology.node_count() > 1 || policy.placement == NumaPlacement::Partition) {
+            if (policy.placement == NumaPlacement::Interleave) {
+                std::vector<unsigned long> mask = node_mask(topology, topology.node_count());
+                bind(base, bytes, MPOL_INTERLEAVE_MODE, mask);
+            } else if (policy.placement == NumaPlacement::Partition) {
+                size_t index = next_node_++ % topology.node_count();
+                std::vector<unsigned long> mask = node_mask(topology, index);
+                // Preferred rather than bound: a full node spills over instead of failing
+                if (bind(base, bytes, MPOL_PREFERRED_MODE, mask)) node = static_cast<int>(index);
+            }
+        }
+        return Chunk{base, bytes, 0, node};
+    }
+
+    // Mask with one node, or with every node when index == node_count()
+    static std::vector<unsigned long> node_mask(const NumaTopology& topology, size_t index) {
+        const size_t bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(1);
+        for (size_t i = 0; i < topology.node_count(); i++) {
+            if (index != topology.node_count() && i != index) continue;
+            size_t id = static_cast<size_t>(topology.node_id(i));
+            if (id / bits >= mask.size()) mask.resize(id / bits + 1);
+            mask[id / bits] |= 1UL << (id % bits);
+        }
+        return mask;
+    }
+
+    static bool bind(void* base, size_t bytes, int mode, const std::vector<unsigned long>& mask) {
+#ifdef SYS_mbind
+        // maxnode counts one past the highest bit the kernel reads
+        unsigned long maxnode = mask.size() * 8 * sizeof(unsigned long) + 1;
+        return ::syscall(SYS_mbind, base, bytes, mode, mask.data(), maxnode, 0) == 0;
+#else
+        (void)base; (void)bytes; (void)mode; (void)mask;
+        return false;
+#endif
+    }
+
+    // Values of MPOL_PREFERRED and MPOL_INTERLEAVE from <linux/mempolicy.h>
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+    static constexpr int MPOL_INTERLEAVE_MODE = 3;
+
+    std::vector<Chunk> chunks_;
+    size_t next_node_ = 0;
+};
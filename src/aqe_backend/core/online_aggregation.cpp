@@ -0,0 +1,107 @@
+#include "online_aggregation.hpp"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <cmath>
+#include <limits>
+
+OnlineAggregation::OnlineAggregation(const CustomBPlusDB& db, uint64_t generation, LeafView view,
+                                     const ColumnKernel& kernel, double min_value, double max_value,
+                                     double confidence_level, unsigned int seed)
+    : db_(db), generation_(generation), view_(std::make_unique<LeafView>(std::move(view))), kernel_(kernel),
+      min_value_(min_value), max_value_(max_value),
+      z_score_(confidence_level >= 0.99 ? 2.576 : confidence_level >= 0.95 ? 1.96 : 1.645),
+      filtered_(min_value > -std::numeric_limits<double>::infinity() ||
+                max_value < std::numeric_limits<double>::infinity()) {
+    order_.resize(view_->leaf_count());
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::mt19937 gen(seed != 0 ? seed : std::random_device{}());
+    std::shuffle(order_.begin(), order_.end(), gen);
+    estimate_.population = view_->size();
+    estimate_.snapshot_id = view_->snapshot_id();
+    if (done()) {
+        update_estimate();
+        cancel();
+    }
+}
+
+const OnlineEstimate& OnlineAggregation::advance(size_t rows) {
+    std::shared_lock<std::shared_mutex> lock(db_.db_mutex);
+    if (!done() && db_.tree_generation_ != generation_) {
+        estimate_.interrupted = true;  // The view's leaves went with the old tree
+        cancel();
+        return estimate_;
+    }
+    
+    size_t target = estimate_.rows_seen + std::max<size_t>(rows, 1);
+    while (!done() && estimate_.rows_seen < target) {
+        size_t l = order_[next_++];
+        size_t distance = view_->prefetch_distance();
+        if (distance > 0 && next_ + distance < order_.size()) view_->prefetch_leaf(order_[next_ + distance]);
+
+        size_t size = view_->leaf_size(l);
+        ColumnAggregate part = view_->read_leaf(l, [&](const BPlusTreeNode& leaf) {
+            ColumnAggregate leaf_part;
+            int count = static_cast<int>(std::min<size_t>(size, BPlusTreeNode::MAX_KEYS));
+            if (filtered_) {
+                kernel_.leaf_aggregate_where(leaf, 0, count, min_value_, max_value_, leaf_part);
+            } else {
+                kernel_.leaf_aggregate(leaf, 0, count, leaf_part);
+            }
+            return leaf_part;
+        });
+
+        double y = part.sum, c = static_cast<double>(part.count), m = static_cast<double>(size);
+        y_ += y;
+        c_ += c;
+        m_ += m;
+        yy_ += y * y;
+        cc_ += c * c;
+        mm_ += m * m;
+        ym_ += y * m;
+        cm_ += c * m;
+        yc_ += y * c;
+        estimate_.rows_seen += size;
+        estimate_.leaves_seen++;
+    }
+    update_estimate();
+    if (done()) cancel();
+    return estimate_;
+}
+
+void OnlineAggregation::update_estimate() {
+    const double l = static_cast<double>(estimate_.leaves_seen);
+    const double total = static_cast<double>(order_.size());
+    const double population = static_cast<double>(estimate_.population);
+    estimate_.complete = estimate_.leaves_seen == order_.size();
+    if (m_ == 0.0) {
+        double unread = estimate_.complete ? 0.0 : std::numeric_limits<double>::infinity();
+        estimate_.sum_margin = estimate_.count_margin = estimate_.mean_margin = unread;
+        return;
+    }
+
+    // Half-width for the ratio a/b of two per-leaf totals, from the
+    // residuals a_i - r * b_i: var(r) ~ (1 - f) / (l * mean(b)^2) * s^2.
+    // Unbounded until two leaves (with rows in b) were read.
+    auto margin = [&](double r, double aa, double ab, double bb, double b) {
+        if (estimate_.complete) return 0.0;
+        if (l < 2.0 || b == 0.0) return std::numeric_limits<double>::infinity();
+        double residuals = std::max(0.0, aa - 2.0 * r * ab + r * r * bb) / (l - 1.0);
+        double mean_b = b / l;
+        return z_score_ * std::sqrt((1.0 - l / total) * residuals / (l * mean_b * mean_b));
+    };
+
+    double sum_rate = y_ / m_;
+    double count_rate = c_ / m_;
+    estimate_.sum = population * sum_rate;
+    estimate_.sum_margin = population * margin(sum_rate, yy_, ym_, mm_, m_);
+    estimate_.count = population * count_rate;
+    estimate_.count_margin = population * margin(count_rate, cc_, cm_, mm_, m_);
+    estimate_.mean = c_ > 0.0 ? y_ / c_ : 0.0;
+    estimate_.mean_margin = margin(estimate_.mean, yy_, yc_, cc_, c_);
+}
+
+void OnlineAggregation::cancel() {
+    next_ = order_.size();
+    view_.reset();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "custom_bplus_db.hpp"
+#include "leaf_cursor.hpp"
+#include <shared_mutex>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+// Running estimates of an online aggregation; each value comes with the
+// half-width of its confidence interval, infinite until there is enough to
+// bound it and 0 once complete
+struct OnlineEstimate {
+    double sum = 0.0;    // SUM(column) over matching rows
+    double sum_margin = std::numeric_limits<double>::infinity();
+    double count = 0.0;  // Matching rows
+    double count_margin = std::numeric_limits<double>::infinity();
+    double mean = 0.0;   // AVG(column) over matching rows
+    double mean_margin = std::numeric_limits<double>::infinity();
+    size_t rows_seen = 0;
+    size_t leaves_seen = 0;
+    size_t population = 0;  // Rows in the snapshot
+    uint64_t snapshot_id = 0;  // Snapshot the scan reads
+    bool complete = false;  // Every leaf read, so the values are exact
+    bool interrupted = false;  // The table was rebuilt mid-scan, which ended it early
+};
+
+/**
+ * Online aggregation of one numeric column over a snapshot of
+ * CustomBPlusDB (see CustomBPlusDB::start_online_aggregation()).
+ *
+ * Leaves are read in a random order, so every prefix of the scan is a
+ * simple random sample of leaves. The estimates are ratio estimators over
+ * that cluster sample - SUM and COUNT scale the per-row rate by the
+ * snapshot's row count, AVG divides the two - with linearized variances
+ * and the finite-population correction, so the intervals shrink to zero
+ * as the last leaf is read.
+ *
+ * The object pins a snapshot until the scan completes or cancel() is
+ * called, so writers carry on and the scan still sees the table as it was.
+ * Each advance() takes the database's shared lock only while it reads;
+ * a rebuild between steps (bulk_load(), a load, close_database()) frees
+ * the snapshot's leaves, so the next step ends the scan as interrupted.
+ * Must not outlive the database. Not thread-safe.
+ */
+class OnlineAggregation {
+public:
+    // The view is built by db under its shared lock, at tree generation `generation`
+    OnlineAggregation(const CustomBPlusDB& db, uint64_t generation, LeafView view, const ColumnKernel& kernel,
+                      double min_value, double max_value, double confidence_level, unsigned int seed);
+
+    // Read leaves until at least `rows` more rows were seen or the scan
+    // ends, and return the updated estimate
+    const OnlineEstimate& advance(size_t rows);
+    const OnlineEstimate& estimate() const { return estimate_; }
+
+    bool done() const { return next_ >= order_.size(); }
+    // Stop early: releases the snapshot
+    void cancel();
+
+private:
+    void update_estimate();
+
+    const CustomBPlusDB& db_;
+    uint64_t generation_;  // Tree generation the view belongs to
+    std::unique_ptr<LeafView> view_;  // Released once the scan ends
+    ColumnKernel kernel_;
+    double min_value_;
+    double max_value_;
+    double z_score_;
+    bool filtered_;
+    std::vector<uint32_t> order_;  // Leaf indexes in reading order
+    size_t next_ = 0;
+
+    // Per-leaf totals y (matching sum), c (matching rows), m (rows), and
+    // the sums of their squares and products, for the ratio variances
+    double y_ = 0.0, c_ = 0.0, m_ = 0.0;
+    double yy_ = 0.0, cc_ = 0.0, mm_ = 0.0, ym_ = 0.0, cm_ = 0.0, yc_ = 0.0;
+    OnlineEstimate estimate_;
+};
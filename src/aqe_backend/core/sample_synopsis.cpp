@@ -0,0 +1,244 @@
+#include "sample_synopsis.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+SynopsisLadder::SynopsisLadder(std::vector<double> sample_percents) {
+    std::sort(sample_percents.begin(), sample_percents.end());
+    sample_percents.erase(std::unique(sample_percents.begin(), sample_percents.end()), sample_percents.end());
+    for (double percent : sample_percents) {
+        rungs_.push_back(std::make_unique<Rung>());
+        rungs_.back()->sample_percent = percent;
+    }
+}
+
+std::vector<double> SynopsisLadder::sample_percents() const {
+    std::vector<double> percents;
+    for (const auto& rung : rungs_) percents.push_back(rung->sample_percent);
+    return percents;
+}
+
+bool SynopsisLadder::stale(size_t rung) const {
+    return rung >= rungs_.size() || rungs_[rung]->stale.load();
+}
+
+size_t SynopsisLadder::population() const {
+    return population_.load();
+}
+
+size_t SynopsisLadder::draw_size(size_t rung, size_t population) const {
+    if (rung >= rungs_.size() || population == 0) return 0;
+    double size = std::round(rungs_[rung]->sample_percent / 100.0 * static_cast<double>(population));
+    return std::min(population, std::max<size_t>(1, static_cast<size_t>(size)));
+}
+
+void SynopsisLadder::Rung::set(size_t slot, const Record& record) {
+    ids[slot] = record.id;
+    amounts[slot] = record.amount;
+    regions[slot] = record.region;
+    product_ids[slot] = record.product_id;
+    timestamps[slot] = record.timestamp;
+}
+
+void SynopsisLadder::Rung::clear() {
+    stale = true;
+    // Swapped out rather than cleared, so a large rung returns its memory
+    std::vector<int64_t>().swap(ids);
+    std::vector<double>().swap(amounts);
+    std::vector<int32_t>().swap(regions);
+    std::vector<int32_t>().swap(product_ids);
+    std::vector<int64_t>().swap(timestamps);
+}
+
+void SynopsisLadder::assign(size_t rung, const std::vector<Record>& rows, size_t population, uint64_t snapshot_id) {
+    if (rung >= rungs_.size()) return;
+    Rung& target = *rungs_[rung];
+    std::lock_guard<std::mutex> lock(target.mutex);
+    target.ids.assign(rows.size(), 0);
+    target.amounts.assign(rows.size(), 0.0);
+    target.regions.assign(rows.size(), 0);
+    target.product_ids.assign(rows.size(), 0);
+    target.timestamps.assign(rows.size(), 0);
+    for (size_t i = 0; i < rows.size(); i++) target.set(i, rows[i]);
+    target.capacity = rows.size();
+    target.drawn_population = population;
+    target.snapshot_id = snapshot_id;
+    target.stale = false;
+    population_ = population;
+}
+
+void SynopsisLadder::add(const Record& record) {
+    size_t population = population_.fetch_add(1) + 1;
+    if (rungs_.empty()) return;
+    // Algorithm R: row n lands in slot j of a size-k rung when j < k
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    size_t slot = static_cast<size_t>(rng() % population);
+    for (const auto& rung : rungs_) {
+        if (rung->stale.load(std::memory_order_relaxed)) continue;
+        // Rate fell below half of the rung's; redraw rather than extend
+        bool outgrown = population > 2 * rung->drawn_population;
+        if (!outgrown && slot >= rung->capacity) continue;
+        std::lock_guard<std::mutex> lock(rung->mutex);
+        if (rung->stale.load(std::memory_order_relaxed)) continue;
+        if (outgrown) {
+            rung->clear();
+        } else {
+            rung->set(slot, record);
+        }
+    }
+}
+
+void SynopsisLadder::invalidate() {
+    for (const auto& rung : rungs_) {
+        std::lock_guard<std::mutex> lock(rung->mutex);
+        rung->clear();
+    }
+}
+
+bool SynopsisLadder::estimate(size_t rung, const ColumnKernel& kernel, double min_value, double max_value,
+                              double z_score, SynopsisEstimate& out) const {
+    if (rung >= rungs_.size()) return false;
+    const Rung& r = *rungs_[rung];
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (r.stale.load()) return false;
+    const size_t k = r.ids.size();
+    const bool amounts = kernel.slot == ColumnSlot::Amount && kernel.type == ColumnType::Double;
+    const bool filtered = min_value > -std::numeric_limits<double>::infinity() ||
+                          max_value < std::numeric_limits<double>::infinity();
+
+    // Matching values x (0 for other rows) and the match indicator d
+    double sx = 0.0, sxx = 0.0, sd = 0.0;
+    for (size_t i = 0; i < k; i++) {
+        double value = amounts ? r.amounts[i]
+                               : kernel.value(Record(r.ids[i], r.amounts[i], r.regions[i], r.product_ids[i],
+                                                     r.timestamps[i]));
+        if (filtered && !(value >= min_value && value <= max_value)) continue;
+        sx += value;
+        sxx += value * value;
+        sd += 1.0;
+    }
+
+    out = SynopsisEstimate();
+    out.sample_percent = r.sample_percent;
+    out.sampled = k;
+    // Inserts racing with this read may be counted or not; either is a valid population
+    out.population = std::max(k, population_.load());
+    out.snapshot_id = r.snapshot_id;
+    out.matched = static_cast<size_t>(sd);
+    if (k == 0) return true;
+
+    // Simple random sample of k from N: scaled means for SUM and COUNT, the
+    // ratio of the two for AVG, each with the finite-population correction
+    const double n = static_cast<double>(k);
+    const double population = static_cast<double>(out.population);
+    const double fpc = std::max(0.0, 1.0 - n / population);
+    // Under two matching rows there is no spread to estimate from, so the
+    // interval is unbounded rather than zero-width
+    auto margin = [&](double residuals, double scale) {
+        if (fpc == 0.0) return 0.0;
+        if (sd < 2.0) return std::numeric_limits<double>::infinity();
+        return z_score * scale * std::sqrt(fpc * std::max(0.0, residuals) / (n - 1.0) / n);
+    };
+
+    double mean_x = sx / n;
+    double rate = sd / n;
+    out.sum = population * mean_x;
+    out.sum_margin = margin(sxx - n * mean_x * mean_x, population);
+    out.count = population * rate;
+    out.count_margin = margin(sd - n * rate * rate, population);
+    if (sd > 0.0) {
+        double mean = sx / sd;
+        out.mean = mean;
+        out.mean_margin = margin(sxx - 2.0 * mean * sx + mean * mean * sd, 1.0 / rate);
+    } else {
+        out.mean_margin = std::numeric_limits<double>::infinity();  // AVG of no rows
+    }
+    return true;
+}
+
+size_t SynopsisLadder::memory_bytes() const {
+    size_t bytes = 0;
+    for (const auto& rung : rungs_) {
+        std::lock_guard<std::mutex> lock(rung->mutex);
+        bytes += rung->ids.capacity() * sizeof(int64_t) + rung->amounts.capacity() * sizeof(double) +
+                 rung->regions.capacity() * sizeof(int32_t) + rung->product_ids.capacity() * sizeof(int32_t) +
+                 rung->timestamps.capacity() * sizeof(int64_t);
+    }
+    return bytes;
+}
+
+// Image: u32 rung count, u64 population, then per rung its rate (f64),
+// drawn population (u64), snapshot id (u64), stale flag (u8), row count
+// (u64) and the five columns one after another
+std::string SynopsisLadder::serialize() const {
+    std::string image;
+    auto put = [&](const void* data, size_t bytes) {
+        if (bytes > 0) image.append(static_cast<const char*>(data), bytes);
+    };
+    uint32_t rung_count = static_cast<uint32_t>(rungs_.size());
+    uint64_t population = population_.load();
+    put(&rung_count, sizeof(rung_count));
+    put(&population, sizeof(population));
+    for (const auto& rung : rungs_) {
+        std::lock_guard<std::mutex> lock(rung->mutex);
+        uint64_t drawn = rung->drawn_population;
+        uint64_t snapshot_id = rung->snapshot_id;
+        uint8_t stale = rung->stale.load() ? 1 : 0;
+        uint64_t rows = rung->ids.size();
+        put(&rung->sample_percent, sizeof(rung->sample_percent));
+        put(&drawn, sizeof(drawn));
+        put(&snapshot_id, sizeof(snapshot_id));
+        put(&stale, sizeof(stale));
+        put(&rows, sizeof(rows));
+        put(rung->ids.data(), rows * sizeof(int64_t));
+        put(rung->amounts.data(), rows * sizeof(double));
+        put(rung->regions.data(), rows * sizeof(int32_t));
+        put(rung->product_ids.data(), rows * sizeof(int32_t));
+        put(rung->timestamps.data(), rows * sizeof(int64_t));
+    }
+    return image;
+}
+
+std::unique_ptr<SynopsisLadder> SynopsisLadder::deserialize(const std::string& bytes) {
+    size_t pos = 0;
+    auto get = [&](void* dst, size_t size) {
+        if (bytes.size() - pos < size) return false;
+        if (size > 0) std::memcpy(dst, bytes.data() + pos, size);  // dst is null for an empty column
+        pos += size;
+        return true;
+    };
+    auto get_column = [&](auto& column, uint64_t rows) {
+        column.resize(rows);
+        return get(column.data(), rows * sizeof(column[0]));
+    };
+
+    uint32_t rung_count;
+    uint64_t population;
+    if (!get(&rung_count, sizeof(rung_count)) || !get(&population, sizeof(population))) return nullptr;
+    auto ladder = std::make_unique<SynopsisLadder>(std::vector<double>());
+    ladder->population_ = population;
+    for (uint32_t i = 0; i < rung_count; i++) {
+        auto rung = std::make_unique<Rung>();
+        uint64_t drawn, snapshot_id, rows;
+        uint8_t stale;
+        if (!get(&rung->sample_percent, sizeof(rung->sample_percent)) || !get(&drawn, sizeof(drawn)) ||
+            !get(&snapshot_id, sizeof(snapshot_id)) || !get(&stale, sizeof(stale)) || !get(&rows, sizeof(rows)) ||
+            rows > population ||
+            rows > (bytes.size() - pos) / (2 * sizeof(int64_t) + sizeof(double) + 2 * sizeof(int32_t))) {
+            return nullptr;
+        }
+        if (!get_column(rung->ids, rows) || !get_column(rung->amounts, rows) ||
+            !get_column(rung->regions, rows) || !get_column(rung->product_ids, rows) ||
+            !get_column(rung->timestamps, rows)) {
+            return nullptr;
+        }
+        rung->capacity = rows;
+        rung->drawn_population = drawn;
+        rung->snapshot_id = snapshot_id;
+        rung->stale = stale != 0;
+        if (!ladder->rungs_.empty() && rung->sample_percent <= ladder->rungs_.back()->sample_percent) return nullptr;
+        ladder->rungs_.push_back(std::move(rung));
+    }
+    return pos == bytes.size() ? std::move(ladder) : nullptr;
+}
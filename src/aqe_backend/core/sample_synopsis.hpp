@@ -0,0 +1,88 @@
+#pragma once
+
+#include "custom_bplus_db.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Ladder of precomputed uniform samples ("synopses") of CustomBPlusDB at
+ * increasing rates, so approximate queries can read a few thousand stored
+ * rows instead of sampling the tree.
+ *
+ * Each rung is a simple random sample of the rows, held column by column
+ * (the five leaf slots) and written to the page file with the tree. It is
+ * drawn with sample_percent% of the rows and kept uniform under inserts by
+ * reservoir replacement: the n-th row replaces a random slot with
+ * probability size / n. One draw serves every rung, so an insert pays an
+ * atomic increment, one random number and a comparison per rung; it locks
+ * a rung only to write a slot of it, which most inserts never do.
+ *
+ * A rung keeps its size, so its rate drifts down as the table grows; once
+ * the table has doubled since the rung was drawn it is marked stale. Deletes
+ * and updates mark every rung stale, since a rung cannot tell cheaply
+ * whether it holds the row. Stale rungs answer nothing until
+ * CustomBPlusDB redraws them.
+ *
+ * add() may run on many threads at once and alongside estimate(). assign(),
+ * invalidate() and serialize() must not overlap add(); CustomBPlusDB calls
+ * them with writers excluded.
+ */
+class SynopsisLadder {
+public:
+    explicit SynopsisLadder(std::vector<double> sample_percents);  // Sorted and deduplicated; all stale
+
+    std::vector<double> sample_percents() const;
+    size_t rung_count() const { return rungs_.size(); }
+    bool stale(size_t rung) const;
+    size_t population() const;
+
+    // Rows to draw for a rung from a table of `population` rows
+    size_t draw_size(size_t rung, size_t population) const;
+    // Replace a rung with a uniform sample of a table of `population` rows,
+    // drawn at snapshot_id
+    void assign(size_t rung, const std::vector<Record>& rows, size_t population, uint64_t snapshot_id);
+
+    void add(const Record& record);  // A row was inserted
+    void invalidate();               // Rows were deleted, updated or replaced
+
+    // SUM, COUNT and AVG of a column over the rung's rows with
+    // min_value <= value <= max_value, scaled to the population, with
+    // interval half-widths for z; false for stale or unknown rungs
+    bool estimate(size_t rung, const ColumnKernel& kernel, double min_value, double max_value,
+                  double z_score, SynopsisEstimate& out) const;
+
+    size_t memory_bytes() const;
+
+    // Binary image for the page file
+    std::string serialize() const;
+    static std::unique_ptr<SynopsisLadder> deserialize(const std::string& bytes);
+
+private:
+    struct Rung {
+        mutable std::mutex mutex;  // Guards the columns against concurrent add() and estimate()
+        double sample_percent = 0.0;
+        // Fixed between draws, so add() reads them unlocked
+        size_t capacity = 0;          // Rows drawn
+        size_t drawn_population = 0;  // Table rows when the rung was drawn
+        uint64_t snapshot_id = 0;     // Snapshot the rung was drawn at
+        std::atomic<bool> stale{true};
+        // Columns of the sampled rows
+        std::vector<int64_t> ids;
+        std::vector<double> amounts;
+        std::vector<int32_t> regions;
+        std::vector<int32_t> product_ids;
+        std::vector<int64_t> timestamps;
+
+        void set(size_t slot, const Record& record);
+        void clear();  // Drops the rows and marks the rung stale; caller holds mutex
+    };
+
+    std::vector<std::unique_ptr<Rung>> rungs_;  // By ascending rate; the ladder never gains or loses rungs
+    std::atomic<size_t> population_{0};  // Table rows, counting inserts since the last draw
+};
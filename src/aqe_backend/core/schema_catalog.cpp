@@ -0,0 +1,439 @@
+#include "schema_catalog.hpp"
+#include "custom_bplus_db.hpp"
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// Physical storage of each slot
+template <ColumnSlot S> struct SlotAccess;
+
+template <> struct SlotAccess<ColumnSlot::Id> {
+    static int64_t get(const Record& r) { return r.id; }
+    static const int64_t* column(const BPlusTreeNode& leaf) { return leaf.keys.data(); }
+    static int64_t zone_min(const BPlusTreeNode& leaf) { return leaf.keys[0]; }
+    static int64_t zone_max(const BPlusTreeNode& leaf) { return leaf.keys[leaf.key_count - 1]; }
+};
+template <> struct SlotAccess<ColumnSlot::Amount> {
+    static double get(const Record& r) { return r.amount; }
+    static const double* column(const BPlusTreeNode& leaf) { return leaf.amounts.data(); }
+    static double zone_min(const BPlusTreeNode& leaf) { return leaf.zone.amount_min; }
+    static double zone_max(const BPlusTreeNode& leaf) { return leaf.zone.amount_max; }
+};
+template <> struct SlotAccess<ColumnSlot::Region> {
+    static int32_t get(const Record& r) { return r.region; }
+    static const int32_t* column(const BPlusTreeNode& leaf) { return leaf.regions.data(); }
+    static int32_t zone_min(const BPlusTreeNode& leaf) { return leaf.zone.region_min; }
+    static int32_t zone_max(const BPlusTreeNode& leaf) { return leaf.zone.region_max; }
+};
+template <> struct SlotAccess<ColumnSlot::ProductId> {
+    static int32_t get(const Record& r) { return r.product_id; }
+    static const int32_t* column(const BPlusTreeNode& leaf) { return leaf.product_ids.data(); }
+    static int32_t zone_min(const BPlusTreeNode& leaf) { return leaf.zone.product_id_min; }
+    static int32_t zone_max(const BPlusTreeNode& leaf) { return leaf.zone.product_id_max; }
+};
+template <> struct SlotAccess<ColumnSlot::Timestamp> {
+    static int64_t get(const Record& r) { return r.timestamp; }
+    static const int64_t* column(const BPlusTreeNode& leaf) { return leaf.timestamps.data(); }
+    static int64_t zone_min(const BPlusTreeNode& leaf) { return leaf.zone.timestamp_min; }
+    static int64_t zone_max(const BPlusTreeNode& leaf) { return leaf.zone.timestamp_max; }
+};
+
+template <ColumnType T> struct Logical { using type = int32_t; };  // Int32, DictString
+template <> struct Logical<ColumnType::Int64> { using type = int64_t; };
+template <> struct Logical<ColumnType::Double> { using type = double; };
+
+// Physical -> logical: bit-cast between 8-byte types of different kinds, convert otherwise
+template <ColumnType T, typename P>
+typename Logical<T>::type decode(P physical) {
+    using L = typename Logical<T>::type;
+    if constexpr (sizeof(L) == 8 && sizeof(P) == 8 && !std::is_same<L, P>::value) {
+        L value;
+        std::memcpy(&value, &physical, sizeof(value));
+        return value;
+    } else {
+        return static_cast<L>(physical);
+    }
+}
+
+template <ColumnSlot S, ColumnType T>
+double leaf_sum_kernel(const BPlusTreeNode& leaf, int count) {
+    const auto* column = SlotAccess<S>::column(leaf);
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) sum += static_cast<double>(decode<T>(column[i]));
+    return sum;
+}
+
+template <ColumnSlot S, ColumnType T>
+void leaf_aggregate_kernel(const BPlusTreeNode& leaf, int first, int last, ColumnAggregate& out) {
+    const auto* column = SlotAccess<S>::column(leaf);
+    for (int i = first; i < last; i++) out.add(static_cast<double>(decode<T>(column[i])));
+}
+
+template <ColumnSlot S, ColumnType T>
+void leaf_aggregate_where_kernel(const BPlusTreeNode& leaf, int first, int last, double min, double max,
+                                 ColumnAggregate& out) {
+    const auto* column = SlotAccess<S>::column(leaf);
+    for (int i = first; i < last; i++) {
+        double value = static_cast<double>(decode<T>(column[i]));
+        if (value >= min && value <= max) out.add(value);
+    }
+}
+
+template <ColumnSlot S, ColumnType T>
+double value_kernel(const Record& record) {
+    return static_cast<double>(decode<T>(SlotAccess<S>::get(record)));
+}
+
+template <ColumnSlot S, ColumnType T>
+void leaf_values_kernel(const BPlusTreeNode& leaf, int first, int last, double* out) {
+    const auto* column = SlotAccess<S>::column(leaf);
+    for (int i = first; i < last; i++) *out++ = static_cast<double>(decode<T>(column[i]));
+}
+
+template <ColumnSlot S, ColumnType T>
+void leaf_integers_kernel(const BPlusTreeNode& leaf, int first, int last, int64_t* out) {
+    const auto* column = SlotAccess<S>::column(leaf);
+    for (int i = first; i < last; i++) *out++ = static_cast<int64_t>(decode<T>(column[i]));
+}
+
+template <ColumnSlot S, ColumnType T>
+int64_t integer_kernel(const Record& record) {
+    return static_cast<int64_t>(decode<T>(SlotAccess<S>::get(record)));
+}
+
+template <ColumnSlot S, ColumnType T>
+void zone_kernel(const BPlusTreeNode& leaf, int64_t& min, int64_t& max) {
+    min = static_cast<int64_t>(decode<T>(SlotAccess<S>::zone_min(leaf)));
+    max = static_cast<int64_t>(decode<T>(SlotAccess<S>::zone_max(leaf)));
+}
+
+// A bit-cast value's physical order says nothing about its logical order
+template <ColumnSlot S, ColumnType T>
+constexpr bool zone_usable() {
+    using P = decltype(SlotAccess<S>::get(std::declval<const Record&>()));
+    using L = typename Logical<T>::type;
+    return !(sizeof(L) == 8 && sizeof(P) == 8 && !std::is_same<L, P>::value);
+}
+
+using ZoneFn = void (*)(const BPlusTreeNode&, int64_t&, int64_t&);
+
+template <ColumnSlot S, ColumnType T>
+constexpr ZoneFn zone_for() {
+    if constexpr (zone_usable<S, T>()) {
+        return &zone_kernel<S, T>;
+    } else {
+        return nullptr;
+    }
+}
+
+template <ColumnSlot S>
+ColumnKernel kernel_for(ColumnType type) {
+    switch (type) {
+        case ColumnType::Int64:
+            return {type, S, &value_kernel<S, ColumnType::Int64>, &leaf_sum_kernel<S, ColumnType::Int64>,
+                    &leaf_aggregate_kernel<S, ColumnType::Int64>,
+                    &leaf_aggregate_where_kernel<S, ColumnType::Int64>, &integer_kernel<S, ColumnType::Int64>,
+                    &leaf_values_kernel<S, ColumnType::Int64>, &leaf_integers_kernel<S, ColumnType::Int64>,
+                    zone_for<S, ColumnType::Int64>()};
+        case ColumnType::Double:
+            return {type, S, &value_kernel<S, ColumnType::Double>, &leaf_sum_kernel<S, ColumnType::Double>,
+                    &leaf_aggregate_kernel<S, ColumnType::Double>,
+                    &leaf_aggregate_where_kernel<S, ColumnType::Double>, nullptr,
+                    &leaf_values_kernel<S, ColumnType::Double>, nullptr, nullptr};
+        default:
+            return {type, S, &value_kernel<S, ColumnType::Int32>, &leaf_sum_kernel<S, ColumnType::Int32>,
+                    &leaf_aggregate_kernel<S, ColumnType::Int32>,
+                    &leaf_aggregate_where_kernel<S, ColumnType::Int32>, &integer_kernel<S, ColumnType::Int32>,
+                    &leaf_values_kernel<S, ColumnType::Int32>, &leaf_integers_kernel<S, ColumnType::Int32>,
+                    zone_for<S, ColumnType::Int32>()};
+    }
+}
+
+ColumnKernel kernel_for(ColumnSlot slot, ColumnType type) {
+    switch (slot) {
+        case ColumnSlot::Id:        return kernel_for<ColumnSlot::Id>(type);
+        case ColumnSlot::Amount:    return kernel_for<ColumnSlot::Amount>(type);
+        case ColumnSlot::Region:    return kernel_for<ColumnSlot::Region>(type);
+        case ColumnSlot::ProductId: return kernel_for<ColumnSlot::ProductId>(type);
+        default:                    return kernel_for<ColumnSlot::Timestamp>(type);
+    }
+}
+
+bool is_wide(ColumnType type) {
+    return type == ColumnType::Int64 || type == ColumnType::Double;
+}
+
+// Payload slots a column may take, most natural first
+std::vector<ColumnSlot> slot_preference(ColumnType type) {
+    switch (type) {
+        case ColumnType::Double: return {ColumnSlot::Amount, ColumnSlot::Timestamp};
+        case ColumnType::Int64:  return {ColumnSlot::Timestamp, ColumnSlot::Amount};
+        default: return {ColumnSlot::Region, ColumnSlot::ProductId, ColumnSlot::Timestamp, ColumnSlot::Amount};
+    }
+}
+
+// Row-at-a-time conversions between logical values and slot storage
+void store(Record& r, ColumnSlot slot, ColumnType type, int64_t integer, double real) {
+    int64_t bits = integer;
+    if (type == ColumnType::Double) std::memcpy(&bits, &real, sizeof(bits));
+    switch (slot) {
+        case ColumnSlot::Id:        r.id = bits; break;
+        case ColumnSlot::Timestamp: r.timestamp = bits; break;
+        case ColumnSlot::Region:    r.region = static_cast<int32_t>(integer); break;
+        case ColumnSlot::ProductId: r.product_id = static_cast<int32_t>(integer); break;
+        case ColumnSlot::Amount:
+            if (type == ColumnType::Double) r.amount = real;
+            else if (type == ColumnType::Int64) std::memcpy(&r.amount, &integer, sizeof(double));
+            else r.amount = static_cast<double>(integer);
+            break;
+    }
+}
+
+ColumnValue load(const Record& r, ColumnSlot slot, ColumnType type) {
+    int64_t bits = 0;
+    switch (slot) {
+        case ColumnSlot::Id:        bits = r.id; break;
+        case ColumnSlot::Timestamp: bits = r.timestamp; break;
+        case ColumnSlot::Region:    return static_cast<int64_t>(r.region);
+        case ColumnSlot::ProductId: return static_cast<int64_t>(r.product_id);
+        case ColumnSlot::Amount:
+            if (type == ColumnType::Double) return r.amount;
+            if (type != ColumnType::Int64) return static_cast<int64_t>(r.amount);
+            std::memcpy(&bits, &r.amount, sizeof(bits));
+            return bits;
+    }
+    if (type == ColumnType::Double) {
+        double real;
+        std::memcpy(&real, &bits, sizeof(real));
+        return real;
+    }
+    return bits;
+}
+
+void put_u32(std::string& out, uint32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+void put_string(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+bool get_u32(const std::string& in, size_t& pos, uint32_t& v) {
+    if (in.size() - pos < sizeof(v)) return false;
+    std::memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+bool get_string(const std::string& in, size_t& pos, std::string& s) {
+    uint32_t size;
+    if (!get_u32(in, pos, size) || in.size() - pos < size) return false;
+    s.assign(in, pos, size);
+    pos += size;
+    return true;
+}
+
+}  // namespace
+
+SchemaCatalog::SchemaCatalog() {
+    define(default_columns());
+}
+
+std::vector<ColumnDef> SchemaCatalog::default_columns() {
+    return {{"id", ColumnType::Int64}, {"amount", ColumnType::Double}, {"region", ColumnType::Int32},
+            {"product_id", ColumnType::Int32}, {"timestamp", ColumnType::Int64}};
+}
+
+bool SchemaCatalog::assign_slots(std::vector<Column>& columns) {
+    // 64-bit columns go first so they get the two 8-byte slots; the rest fill in
+    bool used[5] = {true, false, false, false, false};  // Indexed by ColumnSlot; the key owns Id
+    for (bool wide : {true, false}) {
+        for (size_t i = 1; i < columns.size(); i++) {
+            if (is_wide(columns[i].def.type) != wide) continue;
+            bool placed = false;
+            for (ColumnSlot slot : slot_preference(columns[i].def.type)) {
+                if (!used[static_cast<int>(slot)]) {
+                    columns[i].slot = slot;
+                    used[static_cast<int>(slot)] = placed = true;
+                    break;
+                }
+            }
+            if (!placed) return false;
+        }
+    }
+    return true;
+}
+
+bool SchemaCatalog::define(const std::vector<ColumnDef>& defs) {
+    // The key must be an integer; there are four payload slots
+    if (defs.empty() || defs.size() > 5) return false;
+    if (defs[0].type != ColumnType::Int64 && defs[0].type != ColumnType::Int32) return false;
+
+    std::vector<Column> columns;
+    std::unordered_map<std::string, int> index;
+    for (const ColumnDef& def : defs) {
+        if (def.name.empty() || !index.emplace(def.name, static_cast<int>(columns.size())).second) return false;
+        columns.push_back(Column{def, ColumnSlot::Id, {}, {}});
+    }
+    if (!assign_slots(columns)) return false;
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    columns_ = std::move(columns);
+    index_ = std::move(index);
+    return true;
+}
+
+std::vector<ColumnDef> SchemaCatalog::columns() const {
+    std::vector<ColumnDef> defs;
+    for (const Column& column : columns_) defs.push_back(column.def);
+    return defs;
+}
+
+int SchemaCatalog::find(const std::string& name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? -1 : it->second;
+}
+
+bool SchemaCatalog::resolve(const std::string& name, ColumnKernel& out) const {
+    int i = find(name);
+    if (i < 0 || columns_[i].def.type == ColumnType::DictString) return false;
+
+    out = kernel_for(columns_[i].slot, columns_[i].def.type);
+    return true;
+}
+
+bool SchemaCatalog::resolve_filter(const std::string& name, ColumnKernel& out) const {
+    int i = find(name);
+    if (i < 0 || columns_[i].def.type == ColumnType::Double) return false;
+    out = kernel_for(columns_[i].slot, columns_[i].def.type);
+    return true;
+}
+
+bool SchemaCatalog::make_record(const std::vector<ColumnValue>& values, Record& out) {
+    if (values.size() != columns_.size()) return false;
+
+    Record record;
+    for (size_t i = 0; i < columns_.size(); i++) {
+        Column& column = columns_[i];
+        const ColumnValue& value = values[i];
+        int64_t integer = 0;
+        double real = 0.0;
+
+        switch (column.def.type) {
+            case ColumnType::Int32:
+            case ColumnType::Int64:
+                if (!std::holds_alternative<int64_t>(value)) return false;
+                integer = std::get<int64_t>(value);
+                if (column.def.type == ColumnType::Int32 &&
+                    (integer < std::numeric_limits<int32_t>::min() || integer > std::numeric_limits<int32_t>::max())) {
+                    return false;
+                }
+                break;
+            case ColumnType::Double:
+                if (std::holds_alternative<std::string>(value)) return false;
+                real = std::holds_alternative<double>(value) ? std::get<double>(value)
+                                                             : static_cast<double>(std::get<int64_t>(value));
+                break;
+            case ColumnType::DictString: {
+                if (!std::holds_alternative<std::string>(value)) return false;
+                const std::string& s = std::get<std::string>(value);
+                {
+                    std::shared_lock<std::shared_mutex> lock(mutex_);
+                    auto it = column.codes.find(s);
+                    if (it != column.codes.end()) {
+                        integer = it->second;
+                        break;
+                    }
+                }
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                auto inserted = column.codes.emplace(s, static_cast<int32_t>(column.dictionary.size()));
+                if (inserted.second) {
+                    if (column.dictionary.size() >= static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+                        column.codes.erase(inserted.first);
+                        return false;
+                    }
+                    column.dictionary.push_back(s);
+                }
+                integer = inserted.first->second;
+                break;
+            }
+        }
+        store(record, column.slot, column.def.type, integer, real);
+    }
+    out = record;
+    return true;
+}
+
+std::vector<ColumnValue> SchemaCatalog::row_values(const Record& record) const {
+    std::vector<ColumnValue> values;
+    values.reserve(columns_.size());
+    for (const Column& column : columns_) {
+        ColumnValue value = load(record, column.slot, column.def.type);
+        if (column.def.type == ColumnType::DictString) {
+            int64_t code = std::get<int64_t>(value);
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            value = code >= 0 && static_cast<size_t>(code) < column.dictionary.size()
+                        ? column.dictionary[code] : std::string();
+        }
+        values.push_back(std::move(value));
+    }
+    return values;
+}
+
+bool SchemaCatalog::dictionary_code(const std::string& name, const std::string& value, int32_t& code) const {
+    int i = find(name);
+    if (i < 0 || columns_[i].def.type != ColumnType::DictString) return false;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = columns_[i].codes.find(value);
+    if (it == columns_[i].codes.end()) return false;
+    code = it->second;
+    return true;
+}
+
+std::string SchemaCatalog::serialize() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::string out;
+    put_u32(out, static_cast<uint32_t>(columns_.size()));
+    for (const Column& column : columns_) {
+        out += static_cast<char>(column.def.type);
+        put_string(out, column.def.name);
+        put_u32(out, static_cast<uint32_t>(column.dictionary.size()));
+        for (const std::string& s : column.dictionary) put_string(out, s);
+    }
+    return out;
+}
+
+bool SchemaCatalog::deserialize(const std::string& bytes) {
+    size_t pos = 0;
+    uint32_t count;
+    if (!get_u32(bytes, pos, count) || count > 5) return false;
+
+    std::vector<ColumnDef> defs(count);
+    std::vector<std::vector<std::string>> dictionaries(count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (pos >= bytes.size()) return false;
+        uint8_t type = static_cast<uint8_t>(bytes[pos++]);
+        if (type > static_cast<uint8_t>(ColumnType::DictString)) return false;
+        defs[i].type = static_cast<ColumnType>(type);
+        uint32_t dictionary_size;
+        if (!get_string(bytes, pos, defs[i].name) || !get_u32(bytes, pos, dictionary_size)) return false;
+        for (uint32_t d = 0; d < dictionary_size; d++) {
+            dictionaries[i].emplace_back();
+            if (!get_string(bytes, pos, dictionaries[i].back())) return false;
+        }
+    }
+    if (!define(defs)) return false;
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint32_t i = 0; i < count; i++) {
+        Column& column = columns_[i];
+        column.dictionary = std::move(dictionaries[i]);
+        for (size_t code = 0; code < column.dictionary.size(); code++) {
+            column.codes.emplace(column.dictionary[code], static_cast<int32_t>(code));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+struct Record;
+struct ColumnAggregate;
+class BPlusTreeNode;
+
+/**
+ * Named, typed columns for CustomBPlusDB.
+ *
+ * A schema is declared once at create_database() time. The first column is
+ * the key and is stored in the id slot; every other column is bound to one
+ * of the four payload slots of a leaf (amount, region, product_id,
+ * timestamp). 64-bit columns take the 8-byte slots, 32-bit and dictionary
+ * columns take whatever is left, so any four payload columns with at most
+ * two 64-bit ones fit. Values that do not match their slot's native type are
+ * stored bit-exact (widened or bit-cast).
+ *
+ * Dictionary columns store an int32 code per row; the strings live here.
+ *
+ * Queries resolve a column name to a ColumnKernel once, then scan with its
+ * function pointers - no per-row name comparisons or type switches.
+ */
+
+enum class ColumnType : uint8_t {
+    Int32,
+    Int64,
+    Double,
+    DictString
+};
+
+enum class ColumnSlot : uint8_t {
+    Id,
+    Amount,
+    Region,
+    ProductId,
+    Timestamp
+};
+
+struct ColumnDef {
+    std::string name;
+    ColumnType type;
+
+    ColumnDef() : type(ColumnType::Int64) {}
+    ColumnDef(std::string n, ColumnType t) : name(std::move(n)), type(t) {}
+};
+
+using ColumnValue = std::variant<int64_t, double, std::string>;
+
+// Column access resolved for one query
+struct ColumnKernel {
+    ColumnType type;
+    ColumnSlot slot;
+    double (*value)(const Record& record);                           // Column value as double
+    double (*leaf_sum)(const BPlusTreeNode& leaf, int count);        // Sum of the first `count` rows
+    void (*leaf_aggregate)(const BPlusTreeNode& leaf, int first, int last, ColumnAggregate& out);  // Folds rows [first, last)
+    // Folds the rows of [first, last) whose value lies in [min, max]
+    void (*leaf_aggregate_where)(const BPlusTreeNode& leaf, int first, int last, double min, double max,
+                                 ColumnAggregate& out);
+    int64_t (*integer)(const Record& record);                        // Integer or dictionary code; null for doubles
+    // Column of rows [first, last) into out[0, last - first), as double or as integer (null for doubles)
+    void (*leaf_values)(const BPlusTreeNode& leaf, int first, int last, double* out);
+    void (*leaf_integers)(const BPlusTreeNode& leaf, int first, int last, int64_t* out);
+    // Integer min/max of a non-empty leaf from its zone map; null for doubles
+    // and for columns whose slot storage does not preserve their order
+    void (*zone)(const BPlusTreeNode& leaf, int64_t& min, int64_t& max);
+};
+
+class SchemaCatalog {
+public:
+    SchemaCatalog();  // The built-in schema: id, amount, region, product_id, timestamp
+
+    static std::vector<ColumnDef> default_columns();
+
+    // Replace the schema; false (and unchanged) if the columns don't fit
+    bool define(const std::vector<ColumnDef>& columns);
+    void reset() { define(default_columns()); }
+
+    std::vector<ColumnDef> columns() const;
+    int find(const std::string& name) const;  // Column index, or -1
+
+    // Numeric access for aggregation; false for unknown and dictionary columns
+    bool resolve(const std::string& name, ColumnKernel& out) const;
+    // Integer access for predicates and indexes; false for unknown and double columns
+    bool resolve_filter(const std::string& name, ColumnKernel& out) const;
+
+    // Row conversion. make_record() adds unseen dictionary strings.
+    bool make_record(const std::vector<ColumnValue>& values, Record& out);
+    std::vector<ColumnValue> row_values(const Record& record) const;
+
+    // Dictionary code of an existing string; false if it never occurred
+    bool dictionary_code(const std::string& column, const std::string& value, int32_t& code) const;
+
+    // Binary image for the page file
+    std::string serialize() const;
+    bool deserialize(const std::string& bytes);
+
+private:
+    struct Column {
+        ColumnDef def;
+        ColumnSlot slot;
+        std::vector<std::string> dictionary;  // Code -> string (dictionary columns)
+        std::unordered_map<std::string, int32_t> codes;
+    };
+
+    static bool assign_slots(std::vector<Column>& columns);
+
+    std::vector<Column> columns_;
+    std::unordered_map<std::string, int> index_;
+    mutable std::shared_mutex mutex_;  // Guards dictionaries; define() runs with the database locked
+};
@@ -0,0 +1,124 @@
+#include "secondary_index.hpp"
+#include "custom_bplus_db.hpp"
+#include <algorithm>
+#include <limits>
+
+SecondaryIndex::SecondaryIndex(std::string column, const ColumnKernel& kernel)
+    : column_(std::move(column)), kernel_(kernel) {}
+
+void SecondaryIndex::add(const Record& record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(Posting{kernel_.integer(record), record.id});
+    // The tail may grow with the index, which keeps merges amortized O(1) per row
+    if (merge_due()) merge_pending();
+}
+
+void SecondaryIndex::remove(const Record& record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    removed_.push_back(Posting{kernel_.integer(record), record.id});
+    if (merge_due()) merge_pending();
+}
+
+void SecondaryIndex::assign(std::vector<Posting> postings) {
+    std::sort(postings.begin(), postings.end());
+    std::lock_guard<std::mutex> lock(mutex_);
+    sorted_ = std::move(postings);
+    pending_.clear();
+    removed_.clear();
+}
+
+void SecondaryIndex::merge_pending() const {
+    if (!pending_.empty()) {
+        std::sort(pending_.begin(), pending_.end());
+        size_t middle = sorted_.size();
+        sorted_.insert(sorted_.end(), pending_.begin(), pending_.end());
+        std::inplace_merge(sorted_.begin(), sorted_.begin() + middle, sorted_.end());
+        pending_.clear();
+    }
+    if (removed_.empty()) return;
+
+    // One pass drops a posting per removal. A removal can overtake the add of
+    // a row inserted concurrently; it waits here until that posting arrives.
+    std::sort(removed_.begin(), removed_.end());
+    size_t kept = 0, unmatched = 0;
+    auto drop = removed_.begin();
+    for (size_t i = 0; i < sorted_.size(); i++) {
+        while (drop != removed_.end() && *drop < sorted_[i]) removed_[unmatched++] = *drop++;
+        if (drop != removed_.end() && !(sorted_[i] < *drop)) {
+            ++drop;
+            continue;
+        }
+        sorted_[kept++] = sorted_[i];
+    }
+    while (drop != removed_.end()) removed_[unmatched++] = *drop++;
+    sorted_.resize(kept);
+    removed_.resize(unmatched);
+}
+
+size_t SecondaryIndex::count(int64_t lo, int64_t hi) const {
+    if (lo > hi) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    merge_pending();
+    auto first = std::lower_bound(sorted_.begin(), sorted_.end(), Posting{lo, std::numeric_limits<int64_t>::min()});
+    auto last = std::upper_bound(first, sorted_.end(), Posting{hi, std::numeric_limits<int64_t>::max()});
+    return last - first;
+}
+
+std::vector<int64_t> SecondaryIndex::ids(int64_t lo, int64_t hi) const {
+    std::vector<int64_t> result;
+    if (lo > hi) return result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        merge_pending();
+        auto first = std::lower_bound(sorted_.begin(), sorted_.end(), Posting{lo, std::numeric_limits<int64_t>::min()});
+        auto last = std::upper_bound(first, sorted_.end(), Posting{hi, std::numeric_limits<int64_t>::max()});
+        result.reserve(last - first);
+        for (auto it = first; it != last; ++it) result.push_back(it->id);
+    }
+
+    // One value's postings are already in id order; a range spans several
+    if (!std::is_sorted(result.begin(), result.end())) std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<std::pair<int64_t, size_t>> SecondaryIndex::value_counts() const {
+    std::vector<std::pair<int64_t, size_t>> counts;
+    std::lock_guard<std::mutex> lock(mutex_);
+    merge_pending();
+    for (const Posting& posting : sorted_) {
+        if (counts.empty() || counts.back().first != posting.value) counts.emplace_back(posting.value, 0);
+        counts.back().second++;
+    }
+    return counts;
+}
+
+std::vector<int64_t> SecondaryIndex::ids_at(int64_t value, const std::vector<size_t>& sorted_ranks) const {
+    std::vector<int64_t> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    merge_pending();
+    auto first = std::lower_bound(sorted_.begin(), sorted_.end(), Posting{value, std::numeric_limits<int64_t>::min()});
+    auto last = std::upper_bound(first, sorted_.end(), Posting{value, std::numeric_limits<int64_t>::max()});
+    result.reserve(sorted_ranks.size());
+    for (size_t rank : sorted_ranks) {
+        if (rank >= static_cast<size_t>(last - first)) break;
+        result.push_back(first[rank].id);  // A value's postings are in id order
+    }
+    return result;
+}
+
+size_t SecondaryIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sorted_.size() + pending_.size() - std::min(removed_.size(), sorted_.size() + pending_.size());
+}
+
+size_t SecondaryIndex::memory_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (sorted_.capacity() + pending_.capacity() + removed_.capacity()) * sizeof(Posting);
+}
+
+std::vector<SecondaryIndex::Posting> SecondaryIndex::postings() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    merge_pending();
+    return sorted_;
+}
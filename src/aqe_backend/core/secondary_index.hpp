@@ -0,0 +1,69 @@
+#pragma once
+
+#include "schema_catalog.hpp"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Secondary index over one integer or dictionary column of CustomBPlusDB.
+ *
+ * Postings are (value, record id) pairs kept sorted, so an equality or
+ * range predicate is two binary searches and yields the matching ids
+ * without touching the tree. Inserts append to an unsorted tail that is
+ * sorted and merged in on the next lookup, or once it reaches an eighth of
+ * the sorted postings, so insert_record() pays one append per index.
+ * Deletes queue the posting to drop the same way.
+ */
+class SecondaryIndex {
+public:
+    struct Posting {
+        int64_t value;
+        int64_t id;
+        bool operator<(const Posting& other) const {
+            return value != other.value ? value < other.value : id < other.id;
+        }
+    };
+
+    SecondaryIndex(std::string column, const ColumnKernel& kernel);
+
+    const std::string& column() const { return column_; }
+    int64_t value_of(const Record& record) const { return kernel_.integer(record); }
+
+    void add(const Record& record);
+    void remove(const Record& record);  // Drops one posting of the record, even one added later
+    void assign(std::vector<Posting> postings);  // Replaces every posting; need not be sorted
+
+    // Rows with lo <= value <= hi
+    size_t count(int64_t lo, int64_t hi) const;
+    std::vector<int64_t> ids(int64_t lo, int64_t hi) const;  // Ascending, without duplicates
+
+    // Distinct values with their posting counts, ascending by value
+    std::vector<std::pair<int64_t, size_t>> value_counts() const;
+    // Ids of the postings of one value at the given ranks (ascending, below
+    // its count; larger ranks are ignored), for sampling within the value
+    std::vector<int64_t> ids_at(int64_t value, const std::vector<size_t>& sorted_ranks) const;
+
+    size_t size() const;
+    size_t memory_bytes() const;
+
+    // Raw postings, for the page file
+    std::vector<Posting> postings() const;
+
+private:
+    static constexpr size_t MIN_MERGE = 4096;  // Pending postings that always trigger a merge
+
+    void merge_pending() const;  // Caller holds mutex_
+    bool merge_due() const { return pending_.size() + removed_.size() >= std::max(MIN_MERGE, sorted_.size() / 8); }
+
+    std::string column_;
+    ColumnKernel kernel_;
+    mutable std::mutex mutex_;
+    mutable std::vector<Posting> sorted_;
+    mutable std::vector<Posting> pending_;
+    mutable std::vector<Posting> removed_;  // Dropped at the next merge; kept until their posting arrives
+};
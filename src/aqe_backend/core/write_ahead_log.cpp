@@ -0,0 +1,184 @@
+#include "write_ahead_log.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t WAL_MAGIC = 0x31304C4157455141ULL;  // "AQEWAL01"
+constexpr uint32_t WAL_VERSION = 1;
+constexpr size_t FRAME_HEADER_BYTES = 9;  // Payload size, CRC, type
+
+struct CrcTable {
+    uint32_t entries[256];
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t bytes) {
+    static const CrcTable table;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < bytes; i++) crc = table.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+bool write_all(int fd, const char* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, data, bytes);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        bytes -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(std::string path)
+    : path_(std::move(path)), fd_(-1), appended_lsn_(0), durable_lsn_(0),
+      flushing_(false), failed_(false), size_(0) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close_file();
+}
+
+void WriteAheadLog::close_file() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool WriteAheadLog::open(uint64_t checkpoint_id, std::vector<Frame>& replay) {
+    replay.clear();
+    std::string image;
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            image.resize(static_cast<size_t>(st.st_size));
+            if (::pread(fd, &image[0], image.size(), 0) != static_cast<ssize_t>(image.size())) image.clear();
+        }
+        ::close(fd);
+    }
+
+    uint64_t magic = 0, logged_checkpoint = 0;
+    uint32_t version = 0;
+    if (image.size() >= HEADER_BYTES) {
+        std::memcpy(&magic, image.data(), sizeof(magic));
+        std::memcpy(&version, image.data() + 8, sizeof(version));
+        std::memcpy(&logged_checkpoint, image.data() + 16, sizeof(logged_checkpoint));
+    }
+    if (magic != WAL_MAGIC || version != WAL_VERSION || logged_checkpoint != checkpoint_id) {
+        return reset(checkpoint_id);
+    }
+
+    // Frames up to the first short or corrupt one
+    size_t pos = HEADER_BYTES;
+    while (image.size() - pos >= FRAME_HEADER_BYTES) {
+        uint32_t bytes, crc;
+        std::memcpy(&bytes, image.data() + pos, sizeof(bytes));
+        std::memcpy(&crc, image.data() + pos + 4, sizeof(crc));
+        if (image.size() - pos - FRAME_HEADER_BYTES < bytes ||
+            crc32_update(0, image.data() + pos + 8, 1 + bytes) != crc) {
+            break;
+        }
+        replay.push_back(Frame{static_cast<FrameType>(image[pos + 8]),
+                               image.substr(pos + FRAME_HEADER_BYTES, bytes)});
+        pos += FRAME_HEADER_BYTES + bytes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_file();
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND);
+    if (fd_ < 0 || ::ftruncate(fd_, static_cast<off_t>(pos)) != 0) {
+        close_file();
+        return false;
+    }
+    buffer_.clear();
+    durable_lsn_ = appended_lsn_;
+    failed_ = false;
+    size_ = pos;
+    return true;
+}
+
+bool WriteAheadLog::reset(uint64_t checkpoint_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    flushed_.wait(lock, [&] { return !flushing_; });
+
+    // Everything buffered is part of the checkpoint
+    buffer_.clear();
+    durable_lsn_ = appended_lsn_;
+    flushed_.notify_all();
+
+    close_file();
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    failed_ = fd_ < 0 || !write_header(checkpoint_id);
+    if (failed_) close_file();
+    size_ = HEADER_BYTES;
+    return !failed_;
+}
+
+bool WriteAheadLog::write_header(uint64_t checkpoint_id) {
+    char header[HEADER_BYTES] = {};
+    std::memcpy(header, &WAL_MAGIC, sizeof(WAL_MAGIC));
+    std::memcpy(header + 8, &WAL_VERSION, sizeof(WAL_VERSION));
+    std::memcpy(header + 16, &checkpoint_id, sizeof(checkpoint_id));
+    return write_all(fd_, header, sizeof(header)) && ::fdatasync(fd_) == 0;
+}
+
+uint64_t WriteAheadLog::append(FrameType type, const void* payload, size_t bytes) {
+    uint32_t size = static_cast<uint32_t>(bytes);
+    uint8_t tag = static_cast<uint8_t>(type);
+    uint32_t crc = crc32_update(crc32_update(0, &tag, 1), payload, bytes);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    buffer_.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    buffer_.push_back(static_cast<char>(tag));
+    buffer_.append(static_cast<const char*>(payload), bytes);
+    appended_lsn_ += FRAME_HEADER_BYTES + bytes;
+    size_ += FRAME_HEADER_BYTES + bytes;
+    return appended_lsn_;
+}
+
+bool WriteAheadLog::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (durable_lsn_ < lsn && !failed_) {
+        if (flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+
+        // Lead this round: write out everything buffered so far with one sync
+        flushing_ = true;
+        flush_buffer_.swap(buffer_);
+        uint64_t target = appended_lsn_;
+        lock.unlock();
+        bool written = fd_ >= 0 && write_all(fd_, flush_buffer_.data(), flush_buffer_.size()) &&
+                       ::fdatasync(fd_) == 0;
+        flush_buffer_.clear();
+        lock.lock();
+
+        flushing_ = false;
+        if (written) {
+            durable_lsn_ = std::max(durable_lsn_, target);
+        } else {
+            failed_ = true;
+        }
+        flushed_.notify_all();
+    }
+    return durable_lsn_ >= lsn;
+}
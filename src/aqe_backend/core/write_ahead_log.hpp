@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Append-only redo log for CustomBPlusDB (`<db_path>.wal`).
+ *
+ * Every change since the last checkpoint is a checksummed frame:
+ *   u32 payload bytes | u32 CRC-32 of type and payload | u8 type | payload
+ * after a header naming the checkpoint the log continues. A page file
+ * carries the id of the checkpoint it is, so a log left behind by a crash
+ * between writing a checkpoint and resetting the log is recognised as
+ * already applied and discarded. A torn frame at the tail ends the log.
+ *
+ * Group commit: append() only copies the frame into a buffer and returns its
+ * log sequence number. commit() waits until the frame is on disk; the first
+ * waiter writes and fdatasync()s everything buffered so far, so writers that
+ * arrive meanwhile share the next sync instead of each paying for one.
+ */
+class WriteAheadLog {
+public:
+    enum class FrameType : uint8_t {
+        Insert = 1,   // Records, raw
+        Row,          // insert_row() values; see encode_row() in custom_bplus_db.cpp
+        Delete,       // int64 ids
+        Update,       // (int64 id, double amount) pairs
+        CreateIndex,  // Column name
+        DropIndex,    // Column name
+        Synopses      // Ladder rates (double); none drops the ladder
+    };
+
+    struct Frame {
+        FrameType type;
+        std::string payload;
+    };
+
+    explicit WriteAheadLog(std::string path);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    const std::string& path() const { return path_; }
+
+    // Open the log for appending. Frames of the given checkpoint are returned
+    // for replay and a torn tail is cut off; a missing log or one from
+    // another checkpoint starts empty. False on I/O errors.
+    bool open(uint64_t checkpoint_id, std::vector<Frame>& replay);
+    // Start an empty log for a checkpoint that is already on disk
+    bool reset(uint64_t checkpoint_id);
+
+    // Buffer a frame; returns the LSN commit() takes to make it durable
+    uint64_t append(FrameType type, const void* payload, size_t bytes);
+    // Block until every frame up to lsn is synced; false once a write failed
+    bool commit(uint64_t lsn);
+
+    size_t size() const { return size_.load(std::memory_order_relaxed); }  // Bytes incl. the header
+    bool has_frames() const { return size() > HEADER_BYTES; }
+
+private:
+    static constexpr size_t HEADER_BYTES = 24;
+
+    void close_file();
+    bool write_header(uint64_t checkpoint_id);
+
+    std::string path_;
+    int fd_;
+
+    std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::string buffer_;        // Appended, not yet written
+    std::string flush_buffer_;  // Being written by the flushing thread
+    uint64_t appended_lsn_;     // LSNs count frame bytes and never restart
+    uint64_t durable_lsn_;
+    bool flushing_;
+    bool failed_;
+    std::atomic<size_t> size_;
+};